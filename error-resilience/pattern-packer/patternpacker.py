@@ -0,0 +1,102 @@
+'''
+patternpacker, version 1.0
+Copyright(c) 2021 Matteo Naccari
+All Rights Reserved.
+
+email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+
+The copyright in this software is being made available under the BSD
+License, included below. This software may be subject to other third party
+and contributor rights, including patent rights, and no such rights are
+granted under this license.
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the author may be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+
+The patternpacker software converts an error pattern file, i.e. a plain text
+file of '0' and '1' characters such as the ones generated by gilbertmodel, into
+the packed format read by the transmitter simulators. The packed format stores
+one bit per packet, so that error patterns of hundreds of millions of packets
+are memory mapped by the simulators without being read:
+
+    bytes 0-7:   the magic number LOSSBIT1
+    bytes 8-15:  the number of packets N as a 64 bit little endian integer
+    bytes 16-:   ceil(N / 8) bytes, the i-th packet is the bit (i mod 8) of byte
+                 16 + i / 8, where 1 means that the packet is lost
+
+The packets are the ones the simulators read from the plain text file: the
+first line of the file, where the last character of the file is never part
+of the pattern (usually it is the new line character).
+
+Parameters:
+    - Input:
+        ascii_file  = string containing the name of the plain text error
+                      pattern file
+        packed_file = string containing the name of the packed error pattern
+                      file being written
+Usage:
+    python patternpacker.py <ascii_file> <packed_file>
+'''
+
+import sys
+
+MAGIC = b"LOSSBIT1"
+
+
+def patternpacker(ascii_file: str, packed_file: str) -> int:
+    with open(ascii_file, "rb") as fh:
+        data = fh.read()
+
+    cells = data[: max(len(data) - 1, 0)]
+    end = len(cells)
+    for terminator in (b"\n", b"\0"):
+        idx = cells.find(terminator)
+        if idx != -1:
+            end = min(end, idx)
+
+    if end == 0:
+        raise ValueError(f"Empty error pattern file {ascii_file}")
+    if end != len(cells):
+        raise ValueError(f"{ascii_file} must contain a single line of '0' and '1' characters")
+
+    pattern = cells[:end]
+    if pattern.translate(None, b"01"):
+        raise ValueError(f"Wrong character used in the error pattern file {ascii_file}")
+
+    # Packet i is bit i of a little endian integer, i.e. of the reversed binary string
+    packets = len(pattern)
+    bits = int(pattern[::-1], 2).to_bytes((packets + 7) // 8, "little")
+
+    with open(packed_file, "wb") as fh:
+        fh.write(MAGIC)
+        fh.write(packets.to_bytes(8, "little"))
+        fh.write(bits)
+
+    return packets
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: python patternpacker.py <ascii_file> <packed_file>")
+        sys.exit(1)
+
+    packets = patternpacker(sys.argv[1], sys.argv[2])
+    print(f"Packets written: {packets}")
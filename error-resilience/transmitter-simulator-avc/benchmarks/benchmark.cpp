@@ -0,0 +1,365 @@
+/*  transmitter-simulator-avc, version 0.2
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include "benchmark/benchmark.h"
+#include "parameters.h"
+#include "packet.h"
+#include "simulator.h"
+#include "emulation_prevention.h"
+#include <string>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////
+// Input bitstreams: the bundled one and larger synthetic ones,
+// made of the bundled bitstream repeated several times
+//////////////////////////////////////////////////////////////////
+static const string bundled_bitstream = "../unit-tests/bitstream_annexb.264";
+static vector<string> synthetic_bitstreams;
+
+static string bitstream_file_name(int repetitions)
+{
+  if (repetitions == 1) {
+    return bundled_bitstream;
+  }
+
+  const string file_name = "bitstream_annexb_x" + to_string(repetitions) + ".264";
+  ifstream exists(file_name, ios::binary);
+  if (!exists) {
+    ifstream ifs(bundled_bitstream, ios::binary);
+    const string data = string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    ofstream ofs(file_name, ios::binary);
+    for (int i = 0; i < repetitions; i++) {
+      ofs << data;
+    }
+    synthetic_bitstreams.push_back(file_name);
+  }
+  return file_name;
+}
+
+static int64_t file_size(const string& file_name)
+{
+  ifstream ifs(file_name, ios::binary | ios::ate);
+  return static_cast<int64_t>(ifs.tellg());
+}
+
+//! Reports the throughput as bytes and NAL units per second
+static void set_throughput(benchmark::State& state, int64_t bytes, int64_t nalus)
+{
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["NALs"] = benchmark::Counter(static_cast<double>(state.iterations() * nalus), benchmark::Counter::kIsRate);
+}
+
+//////////////////////////////////////////////////////////////////
+// Packet module benchmarks
+//////////////////////////////////////////////////////////////////
+static void BM_GetPacketAnnexB(benchmark::State& state)
+{
+  const string file_name = bitstream_file_name(static_cast<int>(state.range(0)));
+  int64_t nalus = 0;
+
+  for (auto _ : state) {
+    ifstream ifs(file_name, ios::binary);
+    AnnexBPacket packet;
+    nalus = 0;
+    while (packet.get_packet(ifs) > 0) {
+      if (packet.is_nalu_vcl()) {
+        packet.decode_slice_type();
+      }
+      nalus++;
+    }
+    benchmark::DoNotOptimize(packet.get_slice_type());
+  }
+
+  set_throughput(state, file_size(file_name), nalus);
+}
+BENCHMARK(BM_GetPacketAnnexB)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+static void BM_WritePacketAnnexB(benchmark::State& state)
+{
+  const string file_name = bitstream_file_name(static_cast<int>(state.range(0)));
+  const string output_file_name = "benchmark_out.264";
+  vector<vector<uint8_t>> payloads;
+  vector<NALU> nalus;
+  int64_t bytes = 0;
+
+  // The NAL units are read once, only their writing is measured
+  ifstream ifs(file_name, ios::binary);
+  AnnexBPacket reader;
+  while (reader.get_packet(ifs) > 0) {
+    const NALU& nalu = reader.get_nalu();
+    payloads.emplace_back(nalu.buf, nalu.buf + nalu.len);
+    nalus.push_back(nalu);
+    bytes += nalu.startcodeprefix_len + nalu.len;
+  }
+  for (size_t n = 0; n < nalus.size(); n++) {
+    nalus[n].buf = payloads[n].data();
+  }
+
+  for (auto _ : state) {
+    NaluWriter writer;
+    AnnexBPacket packet;
+    writer.open(output_file_name);
+    for (const auto& nalu : nalus) {
+      packet.set_nalu(nalu);
+      packet.write_packet(writer);
+    }
+    writer.close();
+  }
+
+  set_throughput(state, bytes, static_cast<int64_t>(nalus.size()));
+  remove(output_file_name.c_str());
+}
+BENCHMARK(BM_WritePacketAnnexB)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+static void BM_ExpGolombDecoding(benchmark::State& state)
+{
+  const int num_codes = 1 << 16;
+  vector<uint8_t> buffer;
+  uint64_t bit_buffer = 0;
+  int num_bits = 0;
+  mt19937 rng(1979);
+  geometric_distribution<uint32_t> values(0.2);
+
+  // Codewords of small values, as the ones found in the slice headers
+  auto put_bits = [&](uint32_t value, int bits) {
+    for (int b = bits - 1; b >= 0; b--) {
+      bit_buffer = (bit_buffer << 1) | ((value >> b) & 1);
+      if (++num_bits == 8) {
+        buffer.push_back(static_cast<uint8_t>(bit_buffer));
+        bit_buffer = 0;
+        num_bits = 0;
+      }
+    }
+  };
+  for (int i = 0; i < num_codes; i++) {
+    const uint32_t code = values(rng) + 1;
+    int len = 0;
+    while ((code >> (len + 1)) != 0) {
+      len++;
+    }
+    put_bits(0, len);
+    put_bits(code, len + 1);
+  }
+  put_bits(0, 7);
+  buffer.resize(buffer.size() + 8, 0);
+
+  for (auto _ : state) {
+    Reader r(buffer.data(), buffer.size());
+    uint32_t sum = 0;
+    for (int i = 0; i < num_codes; i++) {
+      sum += r.read_ue();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(buffer.size()));
+  state.SetItemsProcessed(state.iterations() * num_codes);
+}
+BENCHMARK(BM_ExpGolombDecoding)->Unit(benchmark::kMicrosecond);
+
+static void BM_DecodeSliceHeader(benchmark::State& state)
+{
+  // Slice header of a P slice: first_mb_in_slice = 396, slice_type = 5, pic_parameter_set_id = 0,
+  // frame_num = 7 (log2_max_frame_num = 8 in the SPS), followed by some slice data
+  uint8_t nalu_payload[] = {0x41, 0x00, 0xc6, 0x9a, 0x0e, 0x2a, 0xb0, 0x5f, 0x3c, 0x91, 0x7e, 0x22, 0xd4, 0x6b, 0x88, 0x19, 0xe7};
+  uint8_t sps_payload[] = {0x67, 0x42, 0xc0, 0x1e, 0x95, 0xa0, 0x58, 0x25, 0x90};
+  uint8_t pps_payload[] = {0x68, 0xce, 0x30};
+  AnnexBPacket packet;
+  NALU nalu = packet.get_nalu();
+
+  nalu.nal_unit_type = NaluType::NALU_TYPE_SPS;
+  nalu.buf = sps_payload;
+  nalu.len = sizeof(sps_payload);
+  packet.set_nalu(nalu);
+  packet.parse_sps();
+  nalu.nal_unit_type = NaluType::NALU_TYPE_PPS;
+  nalu.buf = pps_payload;
+  nalu.len = sizeof(pps_payload);
+  packet.set_nalu(nalu);
+  packet.parse_pps();
+  nalu.nal_unit_type = NaluType::NALU_TYPE_SLICE;
+  nalu.buf = nalu_payload;
+  nalu.len = sizeof(nalu_payload);
+  packet.set_nalu(nalu);
+
+  for (auto _ : state) {
+    packet.decode_slice_type();
+    benchmark::DoNotOptimize(packet.get_slice_header().m_frame_num);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeSliceHeader);
+
+//////////////////////////////////////////////////////////////////
+// Emulation prevention module benchmarks
+//////////////////////////////////////////////////////////////////
+
+//! Kernels measured: the argument of the benchmarks selects one of them (0 = scalar, 1 = SSE2, 2 = AVX2)
+static bool select_kernels(benchmark::State& state, EmulationPreventionKernel& strip, EmulationPreventionKernel& insert)
+{
+  switch (state.range(0)) {
+  case 0:
+    state.SetLabel("scalar");
+    strip = strip_emulation_prevention_scalar;
+    insert = insert_emulation_prevention_scalar;
+    return true;
+#if defined(SIMULATOR_SSE2)
+  case 1:
+    state.SetLabel("sse2");
+    strip = strip_emulation_prevention_sse2;
+    insert = insert_emulation_prevention_sse2;
+    return true;
+#endif
+#if defined(SIMULATOR_X86)
+  case 2:
+    if (cpu_has_avx2()) {
+      state.SetLabel("avx2");
+      strip = strip_emulation_prevention_avx2;
+      insert = insert_emulation_prevention_avx2;
+      return true;
+    }
+    break;
+#endif
+  }
+  state.SkipWithError("Kernel not supported");
+  return false;
+}
+
+//! One megabyte of slice data like payload: random bytes with an emulation prevention byte every few kilobytes
+static vector<uint8_t> slice_data_rbsp()
+{
+  vector<uint8_t> rbsp(1 << 20);
+  mt19937 rng(1979);
+  for (auto& b : rbsp) {
+    b = static_cast<uint8_t>(rng());
+  }
+  for (size_t i = 0; i + 3 < rbsp.size(); i += 1000 + rng() % 4000) {
+    rbsp[i] = rbsp[i + 1] = 0;
+    rbsp[i + 2] = static_cast<uint8_t>(rng() % 4);
+  }
+  return rbsp;
+}
+
+static void BM_StripEmulationPrevention(benchmark::State& state)
+{
+  EmulationPreventionKernel strip, insert;
+  if (!select_kernels(state, strip, insert)) {
+    return;
+  }
+
+  const vector<uint8_t> rbsp = slice_data_rbsp();
+  vector<uint8_t> ebsp(max_ebsp_size(rbsp.size()));
+  ebsp.resize(insert_emulation_prevention_scalar(rbsp.data(), rbsp.size(), ebsp.data()));
+  vector<uint8_t> output(ebsp.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(strip(ebsp.data(), ebsp.size(), output.data()));
+    benchmark::ClobberMemory();
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(ebsp.size()));
+}
+BENCHMARK(BM_StripEmulationPrevention)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+static void BM_InsertEmulationPrevention(benchmark::State& state)
+{
+  EmulationPreventionKernel strip, insert;
+  if (!select_kernels(state, strip, insert)) {
+    return;
+  }
+
+  const vector<uint8_t> rbsp = slice_data_rbsp();
+  vector<uint8_t> output(max_ebsp_size(rbsp.size()));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(insert(rbsp.data(), rbsp.size(), output.data()));
+    benchmark::ClobberMemory();
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(rbsp.size()));
+}
+BENCHMARK(BM_InsertEmulationPrevention)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+//////////////////////////////////////////////////////////////////
+// Simulator module benchmarks
+//////////////////////////////////////////////////////////////////
+static void BM_RunSimulator(benchmark::State& state)
+{
+  const string file_name = bitstream_file_name(static_cast<int>(state.range(0)));
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", file_name.c_str(), "benchmark_err.264", "../error_plr_3", "1", "10", "0" };
+  int64_t nalus = 0;
+
+  ifstream ifs(file_name, ios::binary);
+  AnnexBPacket packet;
+  while (packet.get_packet(ifs) > 0) {
+    nalus++;
+  }
+
+  Parameters p(cmdLine);
+  streambuf* cout_buffer = cout.rdbuf(nullptr);
+  for (auto _ : state) {
+    Simulator s(p);
+    s.run_simulator();
+  }
+  cout.rdbuf(cout_buffer);
+
+  set_throughput(state, file_size(file_name), nalus);
+  remove("benchmark_err.264");
+}
+BENCHMARK(BM_RunSimulator)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv)
+{
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+
+  for (const auto& file_name : synthetic_bitstreams) {
+    remove(file_name.c_str());
+  }
+  return 0;
+}
@@ -52,107 +52,108 @@
 /*!
  *
  * \brief
- * Allocates the memory space for a given NALU
- *
- * \param
- * buffersize the maximum dimension for the NALU buffer
+ * Decodes the slice type for the current NALU (i.e. the current packet).
+ * Following the specification given in: "Information Technology - Coding of
+ * audio-visual objects - Part 10: advanced video coding", the slice header syntax
+ * contains firstly the number of the first macroblock belonging to the current slice
+ * then it follows the slice type. The parsing continues up to idr_pic_id when the
+ * parameter sets referred by the slice have been parsed beforehand
  *
  * \author
  * Matteo Naccari
  *
 */
 
-void Packet::alloc_nalu(int buffersize)
+void Packet::decode_slice_type()
 {
-  m_nalu.buf.resize(buffersize, 0);
-  m_nalu.max_size = buffersize;
+  if (m_nalu.len <= 1) {
+    // A NALU made of its header only carries no slice header to parse
+    m_slice_header = SliceHeader();
+    return;
+  }
+
+  Reader r = ebsp_reader();
+
+  m_slice_header = parse_slice_header(r, m_nalu.nal_unit_type == NaluType::NALU_TYPE_IDR, m_pps_memory, m_sps_memory);
 }
 
 /*!
  *
  * \brief
- * Decodes the slice type for the current NALU (i.e. the current packet).
- * Following the specification given in: "Information Technology - Coding of
- * audio-visual objects - Part 10: advanced video coding", the slice header syntax
- * contains firstly the number of the first macroblock belonging to the current slice
- * then it follows the slice type.
- * Both these two syntax elements are retrived by a simple exp-Golomb decoding with
- * unsigned direct mapping of the informative codeword
+ * Parse the sequence parameter set carried by the current NALU. The SPS is then stored in the
+ * memory of sps in case the stream is using multiple versions of it.
  *
  * \author
  * Matteo Naccari
  *
 */
-
-void Packet::decode_slice_type()
+void Packet::parse_sps()
 {
-  uint8_t* buffer = &m_nalu.buf[1];
-  int dummy;
+  if (m_nalu.len <= 1) {
+    return;
+  }
 
-  //First syntax element in the slice header: first_mb_in_slice
-  dummy = exp_golomb_decoding(buffer);
+  Reader r = ebsp_reader();
 
-  //Second syntax element in the slice header: slice_type
-  dummy = exp_golomb_decoding(buffer);
+  auto sps = parse_reduced_sps(r);
 
-  if (dummy > 4) {
-    dummy -= 5;
+  // A parameter set with an out of range identifier cannot be referred, hence it is not stored
+  if (sps.m_id < max_num_sps) {
+    m_sps_memory[sps.m_id] = sps;
   }
-
-  m_slice_type = SliceType(dummy);
 }
 
 /*!
  *
  * \brief
- * It performs the Exponential-Golomb decoding with unsigned direct mapping
+ * Parse the picture parameter set carried by the current NALU. The PPS is then stored in the
+ * memory of pps in case the stream is using multiple versions of it.
  *
- * \param
- * buffer a pointer to the memory area which contains the coded data
+ * \author
+ * Matteo Naccari
  *
- * \return the slice type casted to the SliceType enumeration
 */
+void Packet::parse_pps()
+{
+  if (m_nalu.len <= 1) {
+    return;
+  }
+
+  Reader r = ebsp_reader();
+
+  auto pps = parse_reduced_pps(r);
+
+  // A parameter set with an out of range identifier cannot be referred, hence it is not stored
+  if (pps.m_id < max_num_pps) {
+    m_pps_memory[pps.m_id] = pps;
+  }
+}
 
-int Packet::exp_golomb_decoding(uint8_t* buffer)
+/*!
+ *
+ * \brief
+ * Parses the parameter sets and the slice header of the NALU just read, as needed to know the slice type
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+void Packet::parse()
 {
-  register int info = 0;
-  long byteoffset = m_frame_bitoffset >> 3;         //! Byte containing the current starting bit
-  int bitoffset = (7 - (m_frame_bitoffset & 0x07)); //! Starting bit inside the current byte
-  int len = 0;                                      //! Control variable for exp-golomb decoding
-  int M = 0;                                        //! Number of zeros before the first 1
-  uint8_t* curr_byte = &(buffer[byteoffset]);       //! Current byte's address
-  int ctr_bit = ((*curr_byte >> bitoffset) & 0x01); //! Control bit
-
-  m_frame_bitoffset++;
-
-  //First step of exp-golomb decoding: finding the leading 1
-  while (ctr_bit == 0) {
-    len++;
-    m_frame_bitoffset++;
-    bitoffset--;
-    bitoffset &= 0x07; //Modulo 8 conversion
-    curr_byte += (bitoffset == 7);
-    byteoffset += (bitoffset == 7);
-    ctr_bit = ((*curr_byte >> bitoffset) & 0x01);
-  }
-
-  M = len;
-
-  //Second step of exp-golomb decoding: read the info part
-  while (len) {
-    len--;
-    m_frame_bitoffset++;
-    bitoffset--;
-    bitoffset &= 0x07;
-    curr_byte += (bitoffset == 7);
-    info <<= 1;
-    info |= ((*curr_byte >> bitoffset) & 0x01);
-  }
-
-  //Third step of exp-golomb decoding: info = 2^M + info - 1
-  info = (1 << M) + info - 1;
-
-  return info;
+  // Parse the sequence parameter set whose information will be then needed to parse the slice header
+  if (is_nalu_sps()) {
+    parse_sps();
+  }
+
+  // Parse the picture parameter set whose information will be then needed to parse the slice header
+  if (is_nalu_pps()) {
+    parse_pps();
+  }
+
+  //Slice type decoding only for coded data slices [1:5]
+  if (is_nalu_vcl()) {
+    decode_slice_type();
+  }
 }
 /////////////////////////////////////////////////////////////////////////////////////////
 
@@ -188,12 +189,8 @@ int RtpPacket::decompose_rtp_packet()
     throw logic_error("Condition: p.packlen >= 12, violated");
   }
 
-  if (m_rtp_data.payload.size() == 0) {
-    throw logic_error("p.payload not allocated");
-  }
-
-  if (m_rtp_data.packet.size() == 0) {
-    throw logic_error("p.packet not allocated");
+  if (!m_rtp_data.packet) {
+    throw logic_error("p.packet not read");
   }
 
   // Extract header information
@@ -219,8 +216,8 @@ int RtpPacket::decompose_rtp_packet()
     dump_rtp_header();
     return -1;
   }
+  // The payload is left in place, after the header
   m_rtp_data.paylen = m_rtp_data.packlen - 12;
-  memcpy(&m_rtp_data.payload[0], &m_rtp_data.packet[12], m_rtp_data.paylen);
   return 0;
 }
 
@@ -241,29 +238,34 @@ int RtpPacket::decompose_rtp_packet()
  * Original author: Stephan Wenger   stewe@cs.tu-berlin.de
 */
 
-int RtpPacket::rtp_read_packet(ifstream& ifs)
+int RtpPacket::rtp_read_packet(istream& ifs)
 {
-  uint32_t pos, intime;
-
-  if (m_rtp_data.payload.size() == 0) {
-    throw logic_error("p.payload has zero size");
+  if (m_reader.stream() != &ifs) {
+    m_reader.attach(ifs);
   }
 
-  if (m_rtp_data.packet.size() == 0) {
-    throw logic_error("p.packed has zero size");
+  // The dump header made of the packet length and of the time of arrival (unused) precedes each packet
+  if (!buffer_bytes(8)) {
+    if (m_reader.available() >= 4) {
+      throw logic_error("The last RTP packet is truncated");
+    }
+    return 0;
   }
 
-  pos = static_cast<uint32_t>(ifs.tellg());
-
-  ifs.read(reinterpret_cast<char*>(&m_rtp_data.packlen), 4);
-
-  ifs.read(reinterpret_cast<char*>(&intime), 4);
+  memcpy(&m_rtp_data.packlen, m_reader.data(), 4);
 
   if (!(m_rtp_data.packlen < MAXRTPPACKETSIZE)) {
     throw logic_error("Condition: p.packlen < MAXRTPPACKETSIZE, violated");
   }
 
-  ifs.read(reinterpret_cast<char*>(&m_rtp_data.packet[0]), m_rtp_data.packlen);
+  if (!buffer_bytes(8 + m_rtp_data.packlen)) {
+    throw logic_error("The last RTP packet is truncated");
+  }
+
+  // The packet is a view on the data of the reader, valid until the next packet is read
+  m_rtp_data.packet = m_reader.data() + 8;
+  m_packet_offset = m_reader.position() + 8;
+  m_reader.consume(8 + m_rtp_data.packlen);
 
   if (decompose_rtp_packet() < 0) {
     // this should never happen. We probably do not want to attempt
@@ -281,6 +283,28 @@ int RtpPacket::rtp_read_packet(ifstream& ifs)
 
   return m_rtp_data.packlen;
 }
+
+/*!
+ *
+ * \brief
+ * Makes the reader hold at least the given number of bytes not yet consumed, reading further blocks if needed
+ *
+ * \return
+ * False if the stream ends before
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+bool RtpPacket::buffer_bytes(size_t bytes)
+{
+  while (m_reader.available() < bytes) {
+    if (m_reader.refill() == 0) {
+      return false;
+    }
+  }
+  return true;
+}
 /*!
  *****************************************************************************
  *
@@ -295,7 +319,7 @@ int RtpPacket::rtp_read_packet(ifstream& ifs)
 void RtpPacket::dump_rtp_header()
 {
   int i;
-  for (i = 0; i < 30; i++) {
+  for (i = 0; i < 30 && unsigned(i) < m_rtp_data.packlen; i++) {
     cout << setw(2) << hex << m_rtp_data.packet[i] << dec << endl;
   }
 
@@ -320,7 +344,7 @@ void RtpPacket::dump_rtp_header()
  * Matteo Naccari
  *
 */
-int RtpPacket::get_packet(ifstream& ifs)
+int RtpPacket::get_packet(istream& ifs)
 {
   int ret;
 
@@ -328,8 +352,6 @@ int RtpPacket::get_packet(ifstream& ifs)
   m_nalu.forbidden_bit = 1;
   m_nalu.len = 0;
 
-  m_frame_bitoffset = 0;
-
   if (ret < 0) {
     return -1;
   }
@@ -338,32 +360,19 @@ int RtpPacket::get_packet(ifstream& ifs)
     return 0;
   }
 
-  if (!(m_rtp_data.paylen < m_nalu.max_size)) {
-    throw logic_error("Condition: p.paylen < m_nalu.max_size, violated");
-  }
-
+  // The NALU payload is left in place, after the RTP header of the packet
   m_nalu.len = m_rtp_data.paylen;
-  memcpy(&m_nalu.buf[0], &m_rtp_data.payload[0], m_rtp_data.paylen);
-  m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
-  m_nalu.nal_reference_idc = (m_nalu.buf[0] >> 5) & 3;
-  m_nalu.nal_unit_type = NaluType((m_nalu.buf[0]) & 0x1f);
+  m_nalu.buf = m_rtp_data.packet + rtp_header_len;
+  m_nalu.offset = m_packet_offset + rtp_header_len;
 
-  return ret;
-}
+  // An empty payload keeps the header of the previous NALU
+  if (m_nalu.len > 0) {
+    m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
+    m_nalu.nal_reference_idc = (m_nalu.buf[0] >> 5) & 3;
+    m_nalu.nal_unit_type = NaluType((m_nalu.buf[0]) & 0x1f);
+  }
 
-/*!
- *
- * \brief
- * Allocates the memory space for an RTP packet
- *
- * \author
- * Matteo Naccari
- *
-*/
-void RtpPacket::allocate_rtp_packet()
-{
-  m_rtp_data.packet.resize(MAXRTPPACKETSIZE, 0);
-  m_rtp_data.payload.resize(MAXRTPPACKETSIZE, 0);
+  return ret;
 }
 
 /*!
@@ -382,13 +391,13 @@ void RtpPacket::allocate_rtp_packet()
  * Original author: Stephan Wenger   stewe@cs.tu-berlin.de
  *
 */
-int RtpPacket::write_packet(ofstream& ofs)
+int RtpPacket::write_packet(NaluWriter& writer)
 {
   if (!(m_nalu.len < 65000)) {
     throw logic_error("Condition m_nalu.len < 65000, violated");
   }
 
-  m_nalu.buf[0] = (byte)(m_nalu.forbidden_bit << 7 | m_nalu.nal_reference_idc << 5 | int(m_nalu.nal_unit_type));
+  update_nalu_header();
 
   m_rtp_data.v = 2;
   m_rtp_data.p = 0;
@@ -405,9 +414,8 @@ int RtpPacket::write_packet(ofstream& ofs)
   m_rtp_data.timestamp = current_rtp_time_stamp;
   m_rtp_data.ssrc = H264SSRC;
   m_rtp_data.paylen = m_nalu.len;
-  memcpy(&m_rtp_data.payload[0], &m_nalu.buf[0], m_nalu.len);
 
-  if (write_rtp_packet(ofs) < 0)
+  if (write_rtp_packet(writer) < 0)
   {
     throw logic_error("RTP packet writing didn't complete successfully");
   }
@@ -434,61 +442,20 @@ int RtpPacket::write_packet(ofstream& ofs)
  *
  *****************************************************************************/
 
-int RtpPacket::write_rtp_packet(ofstream& ofs)
+int RtpPacket::write_rtp_packet(NaluWriter& writer)
 {
   int intime = -1;
+  unsigned int packlen = m_nalu.len + rtp_header_len;
+  uint8_t dump_header[8];
 
-  ofs.write(reinterpret_cast<char*>(&m_rtp_data.packlen), 4);
-  ofs.write(reinterpret_cast<char*>(&intime), 4);
-  ofs.write(reinterpret_cast<char*>(&m_rtp_data.packet[0]), m_rtp_data.packlen);
+  // The packet is written as it was read: its RTP header precedes the NALU payload
+  memcpy(dump_header, &packlen, 4);
+  memcpy(dump_header + 4, &intime, 4);
+  writer.write(dump_header, 8, m_nalu.buf - rtp_header_len, packlen);
 
   return 0;
 }
 
-/*!
- *****************************************************************************
- *
- * \brief
- *    ComposeRTPpacket composes the complete RTP packet using the various
- *    structure members of the RTPpacket_t structure
- *
- * \return
- *    0 in case of success
- *    negative error code in case of failure
- *
- *
- * \author
- * Adapted from the H.264/AVC reference implementation (aka JM)
- * Original author: Stephan Wenger   stewe@cs.tu-berlin.de
- *
- *****************************************************************************/
-
-int RtpPacket::compose_rtp_packet()
-{
-  unsigned int temp32;
-  unsigned short temp16;
-
-  // Compose RTP header, little endian
-
-  m_rtp_data.packet[0] = (uint8_t)(((m_rtp_data.v & 0x03) << 6) | ((m_rtp_data.p & 0x01) << 5) | ((m_rtp_data.x & 0x01) << 4) | ((m_rtp_data.cc & 0x0F) << 0));
-  m_rtp_data.packet[1] = (uint8_t)(((m_rtp_data.m & 0x01) << 7) | ((m_rtp_data.pt & 0x7F) << 0));
-
-  // sequence number, msb first
-  temp16 = htons((unsigned short)m_rtp_data.seq);
-  memcpy(&m_rtp_data.packet[2], &temp16, 2);  // change to shifts for unified byte sex
-
-  //declare a temporary variable to perform network byte order converson
-  temp32 = htonl(m_rtp_data.timestamp);
-  memcpy(&m_rtp_data.packet[4], &temp32, 4);  // change to shifts for unified byte sex
-
-  temp32 = htonl(m_rtp_data.ssrc);
-  memcpy(&m_rtp_data.packet[8], &temp32, 4);// change to shifts for unified byte sex
-
-  // Copy payload
-  memcpy(&m_rtp_data.packet[12], &m_rtp_data.payload[0], m_rtp_data.paylen);
-  m_rtp_data.packlen = m_rtp_data.paylen + 12;
-  return 0;
-}
 /////////////////////////////////////////////////////////////////////////////////////////
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -509,169 +476,90 @@ int RtpPacket::compose_rtp_packet()
  *  \note Side-effect: Returns length of start-code in bytes.
  *
  * \note
- *   GetAnnexbNALU expects start codes at byte aligned positions in the file
+ *   GetAnnexbNALU expects start codes at byte aligned positions in the file.
+ *   The file is read in blocks by the AnnexBReader bound to it on the first call,
+ *   hence a packet must keep reading from the same stream until the end of it.
  *
  * \author
  * Matteo Naccari (adapted from the H.264/AVC decoder reference software)
  */
 
-int AnnexBPacket::get_packet(ifstream& ifs)
+int AnnexBPacket::get_packet(istream& ifs)
 {
-  int info2, info3;
-  uint32_t pos = 0;
-  int start_code_found, rewind;
-  vector<unsigned char> buf(m_nalu.max_size, 0);
-  int leading_zero_8bits_count = 0, trailing_zero_8bits = 0;
-  m_frame_bitoffset = 0;
-
-  for (pos = 0; pos < m_nalu.max_size; pos++) {
-    ifs.read(reinterpret_cast<char*>(&buf[pos]), 1);
-    if (ifs.eof() || buf[pos] != 0) {
-      pos++;
-      break;
-    }
-  }
-
-  if (ifs.eof()) {
-    if (pos == 0) {
-      return 0;
-    } else {
-      throw logic_error("getpacket: can't read start code");
-    }
-  }
-
-  if (buf[pos - 1] != 1) {
-    throw logic_error("getpacket: no Start Code at the begin of the NALU");
-  }
-
-  if (pos < 3) {
-    throw logic_error("getpacket: no Start Code at the begin of the NALU");
-  } else if (pos == 3) {
-    m_nalu.startcodeprefix_len = 3;
-    leading_zero_8bits_count = 0;
-  } else {
-    leading_zero_8bits_count = pos - 4;
-    m_nalu.startcodeprefix_len = 4;
-  }
+  AnnexBUnit unit;
 
-  // the 1st byte stream NAL unit can has leading_zero_8bits, but subsequent ones are not
-  // allowed to contain it since these zeros(if any) are considered trailing_zero_8bits
-  // of the previous byte stream NAL unit.
-  if (!m_is_first_byte_stream_nalu && leading_zero_8bits_count > 0) {
-    throw logic_error("getpacket: The leading_zero_8bits syntax can only be present in the first byte stream NAL unit");
+  if (m_reader.stream() != &ifs) {
+    m_reader.attach(ifs);
   }
-  m_is_first_byte_stream_nalu = 0;
 
-  start_code_found = 0;
-  info2 = 0;
-  info3 = 0;
+  uint32_t bytes = m_reader.next(unit);
 
-  while (!start_code_found) {
-    if (ifs.eof()) {
-      //Count the trailing_zero_8bits
-      while (buf[pos - 2 - trailing_zero_8bits] == 0) {
-        trailing_zero_8bits++;
-      }
-      m_nalu.len = (pos - 1) - m_nalu.startcodeprefix_len - leading_zero_8bits_count - trailing_zero_8bits;
-      memcpy(&m_nalu.buf[0], &buf[leading_zero_8bits_count + m_nalu.startcodeprefix_len], m_nalu.len);
-      m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
-      m_nalu.nal_reference_idc = (m_nalu.buf[0] >> 5) & 3;
-      m_nalu.nal_unit_type = NaluType(m_nalu.buf[0] & 0x1f);
-
-      return pos - 1;
-    }
-    ifs.read(reinterpret_cast<char*>(&buf[pos++]), 1);
-    info3 = find_start_code(&buf[pos - 4], 3);
-    if (info3 != 1) {
-      info2 = find_start_code(&buf[pos - 3], 2);
-    }
-    start_code_found = (info2 == 1 || info3 == 1);
+  if (bytes == 0) {
+    return 0;
   }
 
-  //Count the trailing_zero_8bits
-  if (info3 == 1) {	//if the detected start code is 00 00 01, trailing_zero_8bits is sure not to be present
-    while (buf[pos - 5 - trailing_zero_8bits] == 0) {
-      trailing_zero_8bits++;
-    }
-  }
-  // Here, we have found another start code (and read length of startcode bytes more than we should
-  // have.  Hence, go back in the file
-  rewind = 0;
-  if (info3 == 1) {
-    rewind = -4;
-  } else if (info2 == 1) {
-    rewind = -3;
-  } else {
-    // Should this be a game stopper?
-    cerr << " Panic: Error in next start code search \n";
-  }
+  m_nalu.startcodeprefix_len = unit.startcodeprefix_len;
+  m_nalu.len = unit.len;
+  m_nalu.buf = unit.data;
+  m_nalu.offset = unit.offset;
 
-  ifs.seekg(rewind, ios::cur);
-  if (ifs.fail() || ifs.bad()) {
-    throw logic_error("Something went wrong when moving the file pointer by " + to_string(rewind) + " bytes in the bitstream file");
+  // An empty NALU keeps the header of the previous one
+  if (m_nalu.len > 0) {
+    m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
+    m_nalu.nal_reference_idc = (m_nalu.buf[0] >> 5) & 3;
+    m_nalu.nal_unit_type = NaluType(m_nalu.buf[0] & 0x1f);
   }
 
-  m_nalu.len = (pos + rewind) - m_nalu.startcodeprefix_len - leading_zero_8bits_count - trailing_zero_8bits;
-  memcpy(&m_nalu.buf[0], &buf[leading_zero_8bits_count + m_nalu.startcodeprefix_len], m_nalu.len);
-  m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
-  m_nalu.nal_reference_idc = (m_nalu.buf[0] >> 5) & 3;
-  m_nalu.nal_unit_type = NaluType(m_nalu.buf[0] & 0x1f);
-
-  return (pos + rewind);
+  return bytes;
 }
 
 /*!
  *
  * \brief
- *    Returns if new start code is found at byte aligned position buf.
- *    new-startcode is of form N 0x00 bytes, followed by a 0x01 byte.
- *
- *  \return
- *     1 if start-code is found or                      \n
- *     0, indicating that there is no start code
+ *    Writes a NALU to the Annex B Byte Stream
  *
- *  \param Buf
- *     pointer to byte-stream
- *  \param zeros_in_startcode
- *     indicates number of 0x00 bytes in start-code.
+ * \return
+ *    number of bits written
  *
  * \author
  * Matteo Naccari (adapted from the H.264/AVC decoder reference software)
 */
-int AnnexBPacket::find_start_code(unsigned char* Buf, int zeros_in_startcode)
+int AnnexBPacket::write_packet(NaluWriter& writer)
 {
-  int info;
-  int i;
+  static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+  int bits_written = 0;
 
-  info = 1;
-  for (i = 0; i < zeros_in_startcode; i++) {
-    if (Buf[i] != 0)
-      info = 0;
+  if (m_nalu.forbidden_bit) {
+    throw logic_error("Forbidden bit is not zero");
   }
 
-  if (Buf[i] != 1) {
-    info = 0;
+  if (!(m_nalu.startcodeprefix_len == 3 || m_nalu.startcodeprefix_len == 4)) {
+    throw logic_error("m_nalu.startcodeprefix_len == 3 || m_nalu.startcodeprefix_len == 4, violated");
   }
 
-  return info;
+  update_nalu_header();
+
+  // Start code and payload are gathered by the writer, which decides when they actually reach the file
+  writer.write(start_code + 4 - m_nalu.startcodeprefix_len, m_nalu.startcodeprefix_len, m_nalu.buf, m_nalu.len);
+  bits_written += (m_nalu.startcodeprefix_len + m_nalu.len) * 8;
+
+  return bits_written;
 }
 
 /*!
  *
  * \brief
- *    Writes a NALU to the Annex B Byte Stream
+ *    Writes a NALU to the Annex B Byte Stream as the range of the bitstream file spanning its start code
+ *    and payload, which are written back unchanged by write_packet (see is_header_rewritten)
  *
  * \return
  *    number of bits written
  *
  * \author
- * Matteo Naccari (adapted from the H.264/AVC decoder reference software)
+ * Matteo Naccari
 */
-int AnnexBPacket::write_packet(ofstream& ofs)
+int AnnexBPacket::copy_packet(NaluWriter& writer)
 {
-  int bits_written = 0;
-  unsigned char zero = 0, one = 1;
-
   if (m_nalu.forbidden_bit) {
     throw logic_error("Forbidden bit is not zero");
   }
@@ -680,22 +568,8 @@ int AnnexBPacket::write_packet(ofstream& ofs)
     throw logic_error("m_nalu.startcodeprefix_len == 3 || m_nalu.startcodeprefix_len == 4, violated");
   }
 
-  if (m_nalu.startcodeprefix_len > 3) {
-    ofs.write(reinterpret_cast<char*>(&zero), 1);
-    bits_written += 8;
-  }
-  ofs.write(reinterpret_cast<char*>(&zero), 1);
-  ofs.write(reinterpret_cast<char*>(&zero), 1);
-  ofs.write(reinterpret_cast<char*>(&one), 1);
-  bits_written += 24;
+  writer.copy(m_nalu.offset - m_nalu.startcodeprefix_len, m_nalu.startcodeprefix_len + m_nalu.len);
 
-  m_nalu.buf[0] = (unsigned char)((m_nalu.forbidden_bit << 7) | (m_nalu.nal_reference_idc << 5) | int(m_nalu.nal_unit_type));
-
-  ofs.write(reinterpret_cast<char*>(&m_nalu.buf[0]), m_nalu.len);
-  bits_written += m_nalu.len * 8;
-
-  ofs.flush();
-
-  return bits_written;
+  return (m_nalu.startcodeprefix_len + m_nalu.len) * 8;
 }
 /////////////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
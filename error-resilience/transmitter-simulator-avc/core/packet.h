@@ -41,42 +41,16 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <array>
+#include "reader.h"
+#include "syntax.h"
+#include "annexb_reader.h"
+#include "nalu_writer.h"
 
 using namespace std;
 
-constexpr uint32_t nalu_max_size = 8000000;
-
 typedef unsigned char byte;
 
-enum class SliceType
-{
-  P_SLICE = 0,
-  B_SLICE,
-  I_SLICE,
-  SP_SLICE,
-  SI_SLICE
-};
-
-enum class NaluType
-{
-  NALU_TYPE_SLICE = 1,
-  NALU_TYPE_DPA = 2,
-  NALU_TYPE_DPB = 3,
-  NALU_TYPE_DPC = 4,
-  NALU_TYPE_IDR = 5,
-  NALU_TYPE_SEI = 6,
-  NALU_TYPE_SPS = 7,
-  NALU_TYPE_PPS = 8,
-  NALU_TYPE_AUD = 9,
-  NALU_TYPE_EOSEQ = 10,
-  NALU_TYPE_EOSTREAM = 11,
-  NALU_TYPE_FILL = 12,
-  NALU_TYPE_PREFIX = 14,
-  NALU_TYPE_SUB_SPS = 15,
-  NALU_TYPE_SLC_EXT = 20,
-  NALU_TYPE_VDRD = 24  // View and Dependency Representation Delimiter NAL Unit
-};
-
 /*!
  *
  * \brief
@@ -89,11 +63,11 @@ struct NALU
 {
   int startcodeprefix_len; //! 4 for parameter sets and first slice in picture, 3 for everything else (suggested)
   unsigned len;            //! Length of the NAL unit (Excluding the start code, which does not belong to the NALU)
-  unsigned max_size;       //! Nal Unit Buffer size
   NaluType nal_unit_type;  //! NALU_TYPE
   int nal_reference_idc;   //! NALU_PRIORITY
   int forbidden_bit;       //! Should be always FALSE
-  vector<uint8_t> buf;     //! Contains the first byte followed by the EBSP
+  uint8_t* buf;            //! Contains the first byte followed by the EBSP (view on the buffer of the packet reader)
+  uint64_t offset;         //! Offset of the first byte in the bitstream file
 
   bool is_nalu_vcl()
   {
@@ -111,7 +85,8 @@ struct NALU
  * \brief
  * The Packet which models a coded packet corresponding to the bitstream being transmitted
  * This class will be specialized into the Rtp_packet and AnnexB_packet classes in order
- * to tackle different bitstream packetizations
+ * to tackle different bitstream packetizations. The specializations are final, hence the
+ * simulation engine, which is compiled for each of them, calls their functions directly
  *
  * \author
  * Matteo Naccari
@@ -119,38 +94,78 @@ struct NALU
 class Packet
 {
 
+  array<ReducedPPS, max_num_pps> m_pps_memory;
+  array<ReducedSPS, max_num_sps> m_sps_memory;
+
+  //! Reader of the slice data or parameter set carried by the NALU, i.e. the bytes after the NALU header
+  Reader ebsp_reader() const { return Reader(m_nalu.buf + 1, m_nalu.len - 1); }
+
 public:
   NALU m_nalu;
-  //! Offset in bit units inside the current packet. It will serve for exp-Golomb decoding
-  int m_frame_bitoffset;
 
-  //! Type of the slice contained in the packet being transmitted
-  SliceType m_slice_type;
-
-  //! It allocates the memory space for a NALU
-  void alloc_nalu(int buffersize);
+  //! Slice header of the packet being transmitted, up to idr_pic_id
+  SliceHeader m_slice_header;
 
   void decode_slice_type();
+  void parse_sps();
+  void parse_pps();
 
-  //! Performs exponential-Golomb decoding with unsigned direct mapping of the VLC codeword
-  int exp_golomb_decoding(uint8_t* buffer);
+  //! Parses the parameter sets and the slice header of the NALU just read, as needed to know the slice type
+  void parse();
 
-  //! Packet constructor, it just allocates memory for a coded packet (NALU).
-  //! Further operation will follow in the class' specializations
-  Packet() { alloc_nalu(8000000); }
+  //! Packet constructor, the NALU does not own any memory: its payload is a view on the data read by
+  //! the class' specializations
+  Packet() { m_nalu.buf = nullptr; m_nalu.len = 0; m_nalu.offset = 0; }
 
   //! Packet destructor
   ~Packet() {}
 
   bool is_nalu_vcl() { return m_nalu.is_nalu_vcl(); }
-  SliceType get_slice_type() { return m_slice_type; }
+  SliceType get_slice_type() { return m_slice_header.m_slice_type; }
+  const SliceHeader& get_slice_header() const { return m_slice_header; }
   NaluType get_nalu_type() { return m_nalu.get_nalu_type(); }
+  bool is_nalu_sps() { return m_nalu.nal_unit_type == NaluType::NALU_TYPE_SPS; }
+  bool is_nalu_pps() { return m_nalu.nal_unit_type == NaluType::NALU_TYPE_PPS; }
+  const NALU& get_nalu() const { return m_nalu; }
+
+  //! Makes the packet carry a NALU read beforehand, e.g. from the parsed bitstream of the batch mode.
+  //! The NALU payload must be preceded by the get_prefix_len() bytes read with it
+  void set_nalu(const NALU& nalu) { m_nalu = nalu; }
+
+  //! Writes the NALU header fields back into the first byte of the payload. The byte is only stored when
+  //! it changes, so that the payloads shared by concurrent realizations are just read
+  void update_nalu_header()
+  {
+    if (m_nalu.len > 0) {
+      const uint8_t header = nalu_header();
+      if (m_nalu.buf[0] != header) {
+        m_nalu.buf[0] = header;
+      }
+    }
+  }
+
+  //! First byte of the payload as written by the packets, built from the NALU header fields
+  uint8_t nalu_header() const { return (uint8_t)((m_nalu.forbidden_bit << 7) | (m_nalu.nal_reference_idc << 5) | int(m_nalu.nal_unit_type)); }
+
+  //! True if update_nalu_header is going to change the first byte of the payload, i.e. the packet written
+  //! differs from the bytes read
+  bool is_header_rewritten() const { return m_nalu.len > 0 && m_nalu.buf[0] != nalu_header(); }
+
+  //! Number of bytes preceding the NALU payload which are needed to write the packet again (e.g. the RTP header)
+  virtual uint32_t get_prefix_len() { return 0; }
 
   //! The following functions will be implemented in the class' specialisations
-  virtual int get_packet(ifstream& ifs) = 0;
-  virtual int write_packet(ofstream& ofs) = 0;
+  virtual int get_packet(istream& ifs) = 0;
+  virtual int write_packet(NaluWriter& writer) = 0;
+
+  //! Writes the packet as a copy of its bytes in the bitstream file, which must be the ones write_packet
+  //! would write. Packetizations which do not write back the bytes read just write the packet
+  virtual int copy_packet(NaluWriter& writer) { return write_packet(writer); }
 };
 
+//! Size of the fixed RTP header which precedes the NALU payload
+constexpr uint32_t rtp_header_len = 12;
+
 /*!
  *
  * \brief
@@ -160,7 +175,7 @@ public:
  * Matteo Naccari
 */
 
-class RtpPacket : public Packet
+class RtpPacket final : public Packet
 {
 
 private:
@@ -180,9 +195,8 @@ private:
     unsigned int old_seq;    //!< to detect wether packets were lost
     unsigned int timestamp;  //!< timestamp, 27 MHz for H.264
     unsigned int ssrc;       //!< Synchronization Source, chosen randomly
-    vector<uint8_t> payload; //!< the payload including payload headers
     unsigned int paylen;     //!< length of payload in bytes
-    vector<uint8_t> packet;  //!< complete packet including header and payload
+    uint8_t* packet;         //!< complete packet including header and payload, view on the data of the reader
     unsigned int packlen;    //!< length of packet, typically paylen+12
   } RtpData;
 
@@ -190,31 +204,36 @@ private:
 
   int current_rtp_sequence_number, current_rtp_time_stamp;
 
-  int decompose_rtp_packet();
+  BlockReader m_reader;      //! Reads the RTP stream in large blocks, the packets are views on its data
+  uint64_t m_packet_offset;  //! Offset of the current packet (i.e. of its RTP header) in the stream
 
-  int rtp_read_packet(ifstream& ifs);
+  int decompose_rtp_packet();
 
-  void dump_rtp_header();
+  int rtp_read_packet(istream& ifs);
 
-  void allocate_rtp_packet();
+  bool buffer_bytes(size_t bytes);
 
-  int compose_rtp_packet();
+  void dump_rtp_header();
 
-  int write_rtp_packet(ofstream& ofs);
+  int write_rtp_packet(NaluWriter& writer);
 
 public:
   RtpPacket()
   {
-    allocate_rtp_packet();
+    m_rtp_data.packet = nullptr;
+    m_rtp_data.packlen = 0;
     current_rtp_sequence_number = 0;
     current_rtp_time_stamp = 0;
+    m_packet_offset = 0;
   }
 
   ~RtpPacket() {}
 
-  int get_packet(ifstream& ifs);
+  int get_packet(istream& ifs);
+
+  int write_packet(NaluWriter& writer);
 
-  int write_packet(ofstream& ofs);
+  uint32_t get_prefix_len() { return rtp_header_len; }
 };
 
 /*!
@@ -226,17 +245,17 @@ public:
  * Matteo Naccari
 */
 
-class AnnexBPacket : public Packet
+class AnnexBPacket final : public Packet
 {
 
 private:
-  int m_is_first_byte_stream_nalu;
-  int find_start_code(unsigned char* buf, int zeros_in_startcode);
+  AnnexBReader m_reader;
 
 public:
-  AnnexBPacket() { m_is_first_byte_stream_nalu = 1; }
-  int get_packet(ifstream& ifs);
-  int write_packet(ofstream& ofs);
+  AnnexBPacket() {}
+  int get_packet(istream& ifs);
+  int write_packet(NaluWriter& writer);
+  int copy_packet(NaluWriter& writer);
 };
 
 #endif
@@ -35,9 +35,7 @@
  *
 */
 #include "parameters.h"
-#include <regex>
 #include <iostream>
-#include <fstream>
 
 /*!
  *
@@ -51,12 +49,13 @@
  * Matteo Naccari
  *
 */
-
 Parameters::Parameters(const char** argv)
-  : m_bitstream_original(argv[1])
-  , m_bitstream_transmitted(argv[2])
-  , m_loss_pattern_file(argv[3])
+  : m_packet_type(0)
 {
+  m_bitstream_original = argv[1];
+  m_bitstream_transmitted = argv[2];
+  m_loss_pattern_file = argv[3];
+
   m_packet_type = stoi(argv[4]);
 
   m_offset = stoi(argv[5]);
@@ -69,7 +68,8 @@ Parameters::Parameters(const char** argv)
 /*!
  *
  * \brief
- * Second constructor whereby the parameters are passed via configuration file
+ * Second constructor whereby the parameters are passed via a configuration file, one per line in the order
+ * of the command line. Options can be given in any place of the file
  *
  * \param
  * argv, name of the configuration file
@@ -78,102 +78,34 @@ Parameters::Parameters(const char** argv)
  * Matteo Naccari
  *
 */
-
 Parameters::Parameters(const char* argv)
+  : m_packet_type(0)
 {
-  string line;
-  int i = 0;
-  ifstream fin;
-
-  regex pattern_str("[^ ]+");
-  regex pattern_nr("[+-]?[0-9]+");
-  smatch match;
-
-  fin.open(argv, ifstream::in);
+  const vector<string> lines = read_config_file(argv);
 
-  if (!fin) {
-    throw runtime_error("Cannot open config file " + string(argv) + " abort");
-  }
-
-  while (getline(fin, line, '\n')) {
-    if (valid_line(line)) {
-      switch (i) {
+  for (size_t i = 0; i < lines.size(); i++) {
+    switch (i) {
       case 0:
-        regex_search(line, match, pattern_str);
-        m_bitstream_original = match[0];
+        m_bitstream_original = config_string(lines[i]);
         break;
       case 1:
-        regex_search(line, match, pattern_str);
-        m_bitstream_transmitted = match[0];
+        m_bitstream_transmitted = config_string(lines[i]);
         break;
       case 2:
-        regex_search(line, match, pattern_str);
-        m_loss_pattern_file = match[0];
+        m_loss_pattern_file = config_string(lines[i]);
         break;
       case 3:
-        regex_search(line, match, pattern_nr);
-        m_packet_type = stoi(match[0]);
+        m_packet_type = config_number(lines[i]);
         break;
       case 4:
-        regex_search(line, match, pattern_nr);
-        m_offset = stoi(match[0]);
+        m_offset = config_number(lines[i]);
         break;
       case 5:
-        regex_search(line, match, pattern_nr);
-        m_modality = stoi(match[0]);
+        m_modality = config_number(lines[i]);
         break;
       default:
-        cout << "Something wrong: (?)" << line << endl;
-      }
-      i++;
+        cerr << "Something wrong: (?)" << lines[i] << endl;
     }
   }
   check_parameters();
 }
-
-/*!
- *
- * \brief
- * Reads a valid line from the configuration file. A valid line is a text line
- * that does not start with the following characters: #, carriage return, space or
- * new line
- *
- * \param
- * line a char array containing the current line read from the configuration file
- *
- * \return
- * True if the current line is a valid line
- * False otherwise
- *
- * \author
- * Matteo Naccari
-*/
-
-bool Parameters::valid_line(const string& line)
-{
-  if (line.length() == 0 || line.at(0) == '\r' || line.at(0) == '#' || line.at(0) == ' ' || line.at(0) == '\n') {
-    return 0;
-  }
-  return 1;
-}
-
-/*!
- *
- * \brief
- * Checks the compliance of the input parameters. A fault tolerant policy is adopted, i.e. only warnings are issued and the default values
- * are set accordingly
- *
- * \author
- * Matteo Naccari
-*/
-void Parameters::check_parameters()
-{
-  if (m_offset < 0) {
-    cout << "Warning! Offset = " << m_offset << " is not allowed, set it to zero\n";
-    m_offset = 0;
-  }
-  if (!(0 <= m_modality && m_modality <= 2)) {
-    cout << "Warning! Modality = " << m_modality << " is not allowed, set it to zero\n";
-    m_modality = 0;
-  }
-}
\ No newline at end of file
@@ -37,28 +37,26 @@
 #ifndef H_PARAMETERS_
 #define H_PARAMETERS_
 
-#include <string>
+#include "parameters_base.h"
 
 using namespace std;
 
 /*!
  *
  * \brief
- * Models the parameters related to the transmission conditions
+ * Models the parameters related to the transmission conditions. The command line and the configuration
+ * file give the packet type (0 for RTP, 1 for Annex B) after the loss pattern file
  *
  * \author
  * Matteo Naccari
  *
 */
 
-class Parameters
+class Parameters : public ParametersBase
 {
 
 private:
-  string m_bitstream_original, m_bitstream_transmitted, m_loss_pattern_file;
-  int m_modality, m_offset, m_packet_type;
-  bool valid_line(const string& line);
-  void check_parameters();
+  int m_packet_type;
 
 public:
   //! First constructor: parameters are passed through command line
@@ -69,11 +67,6 @@ public:
 
   ~Parameters() {};
 
-  const string& get_bitstream_original_filename() const { return m_bitstream_original; }
-  const string& get_bitstream_transmitted_filename() const { return m_bitstream_transmitted; }
-  const string& get_loss_pattern_filename() const { return m_loss_pattern_file; }
-  int get_modality() const { return m_modality; }
-  int get_offset() const { return m_offset; }
   int get_packet_type() const { return m_packet_type; }
 };
 
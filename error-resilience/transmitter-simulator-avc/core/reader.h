@@ -0,0 +1,242 @@
+/*  transmitter-simulator-avc, version 0.2
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_READER_
+#define H_READER_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include "intrinsics.h"
+
+using namespace std;
+
+//! Number of bits looked up at once when decoding short Exponential-Golomb codewords
+constexpr uint32_t ue_table_bits = 9;
+
+/*!
+ *
+ * \brief
+ * Table decoding the Exponential-Golomb codewords which fit in ue_table_bits bits: each entry gives the
+ * value and the length of the codeword starting with the entry index. A length equal to zero marks the
+ * codewords which are longer than the table
+ *
+ * \author
+ * Matteo Naccari
+*/
+struct UeTable
+{
+  uint8_t value[1 << ue_table_bits];
+  uint8_t len[1 << ue_table_bits];
+};
+
+constexpr UeTable make_ue_table()
+{
+  UeTable table{};
+  for (uint32_t code = 0; code < (1u << ue_table_bits); code++) {
+    uint32_t leading_zeros = 0;
+    while (leading_zeros < ue_table_bits && ((code >> (ue_table_bits - 1 - leading_zeros)) & 1) == 0) {
+      leading_zeros++;
+    }
+    const uint32_t len = 2 * leading_zeros + 1;
+    if (len <= ue_table_bits) {
+      table.value[code] = static_cast<uint8_t>((code >> (ue_table_bits - len)) - 1);
+      table.len[code] = static_cast<uint8_t>(len);
+    }
+  }
+  return table;
+}
+
+static constexpr UeTable ue_table = make_ue_table();
+
+/*!
+ *
+ * \brief
+ * Class modelling a bit reader over the EBSP of an H.264/AVC NAL unit.
+ * The bits are served from a 64 bit cache, left aligned, which is refilled with up to eight bytes at a time.
+ * The emulation prevention bytes (i.e. 0x03 after two zero bytes) are dropped while the cache is refilled,
+ * so the syntax elements are read as if from the RBSP. The refill never reads beyond the end of the buffer:
+ * past the end the reader returns zero bits.
+ *
+ * \author
+ * Matteo Naccari
+*/
+class Reader
+{
+  const uint8_t* m_buffer;     //! Next byte to be loaded in the cache
+  const uint8_t* m_end;
+
+  uint64_t m_cache;            //! Bits to be read, starting from the most significant one
+  uint32_t m_cache_bits;       //! Number of valid bits in the cache
+  uint32_t m_zero_bytes;       //! Number of consecutive zero bytes loaded last, to spot emulation prevention bytes
+
+  //! Flags the zero bytes of w: the most significant bit of each zero byte is set, all other bits are cleared
+  static uint64_t zero_bytes(uint64_t w)
+  {
+    const uint64_t low_bits = 0x7f7f7f7f7f7f7f7full;
+    return ~(((w & low_bits) + low_bits) | w | low_bits);
+  }
+
+  //! Loads whole bytes into the cache, at least 32 bits are available afterwards
+  void refill()
+  {
+    if (m_end - m_buffer >= 8) {
+      // Without two consecutive zero bytes there is no emulation prevention byte: a single load serves.
+      // The bits below the valid ones are loaded again by the next refill, with the same value
+      const uint64_t w = load_big_endian64(m_buffer);
+      const uint64_t zeros = zero_bytes(w);
+      if ((zeros & (zeros << 8)) == 0 && m_zero_bytes + (zeros >> 63) < 2) {
+        m_cache |= w >> m_cache_bits;
+        const uint32_t bytes = (64 - m_cache_bits) >> 3;
+        m_buffer += bytes;
+        m_cache_bits += bytes << 3;
+        m_zero_bytes = static_cast<uint32_t>(zeros >> (71 - 8 * bytes)) & 1;
+        return;
+      }
+    }
+
+    while (m_cache_bits <= 56 && m_buffer < m_end) {
+      const uint8_t b = *m_buffer++;
+      if (m_zero_bytes >= 2 && b == 0x03) {
+        m_zero_bytes = 0;
+        continue;
+      }
+      m_cache |= uint64_t(b) << (56 - m_cache_bits);
+      m_cache_bits += 8;
+      m_zero_bytes = b == 0 ? m_zero_bytes + 1 : 0;
+    }
+    if (m_buffer == m_end) {
+      // End of the buffer: the cache is padded with zeros
+      m_cache_bits = 64;
+    }
+  }
+
+  void consume(uint32_t bits)
+  {
+    m_cache <<= bits;
+    m_cache_bits -= bits;
+  }
+
+public:
+  Reader(const uint8_t* b, size_t size)
+    : m_buffer(b)
+    , m_end(b + size)
+    , m_cache(0)
+    , m_cache_bits(0)
+    , m_zero_bytes(0)
+  {}
+
+  //! True if the bits left to read are all zeros (e.g. past the end of the buffer), hence no codeword can follow
+  bool only_zeros_left()
+  {
+    if (m_cache_bits < 32) {
+      refill();
+    }
+    return m_cache == 0 && m_buffer == m_end;
+  }
+
+  uint32_t read_bits(uint32_t bits_to_read)
+  {
+    if (bits_to_read > 32) {
+      throw logic_error("Cannot read: " + to_string(bits_to_read) + " bits in one go");
+    }
+    if (bits_to_read == 0) {
+      return 0;
+    }
+
+    if (m_cache_bits < bits_to_read) {
+      refill();
+    }
+
+    const uint32_t retval = static_cast<uint32_t>(m_cache >> (64 - bits_to_read));
+    consume(bits_to_read);
+
+    return retval;
+  }
+
+  bool read_flag() { return read_bits(1) != 0; }
+
+  /*!
+   *
+   * \brief
+   * Reads an Exponential-Golomb codeword with unsigned direct mapping, i.e. ue(v).
+   * Short codewords, as the ones of the slice header, are decoded with one table look up; longer ones
+   * with a count of the leading zeros of the cache
+   *
+   * \author
+   * Matteo Naccari
+  */
+  uint32_t read_ue()
+  {
+    if (m_cache_bits < 32) {
+      refill();
+    }
+
+    const uint32_t code = static_cast<uint32_t>(m_cache >> (64 - ue_table_bits));
+    if (ue_table.len[code] != 0) {
+      consume(ue_table.len[code]);
+      return ue_table.value[code];
+    }
+
+    const uint32_t leading_zeros = m_cache != 0 ? count_leading_zeros64(m_cache) : 64;
+
+    if (leading_zeros < 16) {
+      const uint32_t len = 2 * leading_zeros + 1;
+      const uint32_t value = static_cast<uint32_t>(m_cache >> (64 - len)) - 1;
+      consume(len);
+      return value;
+    }
+
+    // Long codewords: the prefix is skipped first, then the suffix is read
+    uint32_t prefix_length = 0;
+    while (read_bits(1) == 0) {
+      if (++prefix_length > 31) {
+        throw logic_error("Exp-Golomb codeword longer than 32 bits");
+      }
+    }
+    return read_bits(prefix_length) + ((1u << prefix_length) - 1);
+  }
+
+  //! Reads an Exponential-Golomb codeword with signed mapping, i.e. se(v)
+  int32_t read_se()
+  {
+    const uint32_t code = read_ue();
+    return code & 1 ? static_cast<int32_t>((code >> 1) + 1) : -static_cast<int32_t>(code >> 1);
+  }
+};
+#endif // !H_READER_
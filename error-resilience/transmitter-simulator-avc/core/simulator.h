@@ -34,42 +34,81 @@
  * THE POSSIBILITY OF SUCH DAMAGE.
  *
 */
+
 #ifndef H_SIMULATOR_
 #define H_SIMULATOR_
 
-#include <fstream>
-#include <memory>
+#include <string>
+#include <stdexcept>
 #include "packet.h"
 #include "parameters.h"
+#include "simulator_engine.h"
 
 using namespace std;
 
 /*!
  *
  * \brief
- * The simulator class which models the bitstream transmission over an error prone channel
+ * Codec traits of H.264/AVC for the simulation engine: the bitstream is packetized either as RTP packets (0)
+ * or as Annex B NAL units (1) and the priority of a NALU is its nal_ref_idc
  *
  * \author
  * Matteo Naccari
 */
-
-class Simulator
+struct AvcCodec
 {
+  typedef ::Parameters Parameters;
+  typedef NALU Nalu;
+  typedef ::NaluType NaluType;
+  typedef ::SliceType SliceType;
+
+  static constexpr uint32_t index_codec = 1;
+  static constexpr bool has_packet_types = true;
+
+  static const char* packet_type_name(int packet_type) { return packet_type == 0 ? "RTP" : "AnnexB"; }
+
+  //! Calls action with the tag of the packet class of the given type (0 = RTP, 1 = AnnexB)
+  template <class Action>
+  static void with_packet_type(int packet_type, const Action& action)
+  {
+    if (packet_type == 0) { //RTP
+      action(PacketTag<RtpPacket>());
+    } else if (packet_type == 1) { //Annex B
+      action(PacketTag<AnnexBPacket>());
+    } else {
+      throw runtime_error("Bad packet type: " + to_string(packet_type));
+    }
+  }
+
+  static uint8_t get_priority(const NALU& nalu) { return uint8_t(nalu.nal_reference_idc); }
+  static void set_priority(NALU& nalu, uint8_t priority) { nalu.nal_reference_idc = priority; }
+
+  static bool is_reference(const NALU& nalu) { return nalu.nal_reference_idc != 0; }
+
+  static const char* slice_type_name(int slice_type)
+  {
+    const char* names[] = { "P", "B", "I", "SP", "SI" };
+    return 0 <= slice_type && slice_type < 5 ? names[slice_type] : "invalid";
+  }
+};
 
-private:
-  unique_ptr<Packet> m_packet;
-  const Parameters& m_param;
-  ifstream m_fp_bitstream;     //! Transmitted bitstream
-  ofstream m_fp_tr_bitstream;  //! Received bitstream
-  string m_loss_pattern;
-  int m_numchar;
+// The engine is compiled once, in simulator.cpp
+extern template class SimulatorEngine<AvcCodec>;
 
-  void print_header();
+/*!
+ *
+ * \brief
+ * The simulator class which models the bitstream transmission over an error prone channel
+ *
+ * \author
+ * Matteo Naccari
+*/
+
+class Simulator : public SimulatorEngine<AvcCodec>
+{
 
 public:
-  Simulator(const Parameters& p);  //! Constructor with configuration parameters
-  ~Simulator() {}
-  void run_simulator();    //! Method to simulate the bitstream transmission
+  Simulator(const Parameters& p) : SimulatorEngine<AvcCodec>(p) {}  //! Constructor with configuration parameters
 };
 
-#endif
\ No newline at end of file
+#endif
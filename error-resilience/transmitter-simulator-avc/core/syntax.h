@@ -0,0 +1,343 @@
+/*  transmitter-simulator-avc, version 0.2
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_SYNTAX_
+#define H_SYNTAX_
+
+#include <cstdint>
+#include <array>
+#include "reader.h"
+
+using namespace std;
+
+//! Number of sequence and picture parameter sets which can be stored (Clause 7.4.2 of the H.264/AVC standard)
+constexpr uint32_t max_num_sps = 32;
+constexpr uint32_t max_num_pps = 256;
+
+enum class SliceType
+{
+  P_SLICE = 0,
+  B_SLICE,
+  I_SLICE,
+  SP_SLICE,
+  SI_SLICE
+};
+
+enum class NaluType
+{
+  NALU_TYPE_SLICE = 1,
+  NALU_TYPE_DPA = 2,
+  NALU_TYPE_DPB = 3,
+  NALU_TYPE_DPC = 4,
+  NALU_TYPE_IDR = 5,
+  NALU_TYPE_SEI = 6,
+  NALU_TYPE_SPS = 7,
+  NALU_TYPE_PPS = 8,
+  NALU_TYPE_AUD = 9,
+  NALU_TYPE_EOSEQ = 10,
+  NALU_TYPE_EOSTREAM = 11,
+  NALU_TYPE_FILL = 12,
+  NALU_TYPE_PREFIX = 14,
+  NALU_TYPE_SUB_SPS = 15,
+  NALU_TYPE_SLC_EXT = 20,
+  NALU_TYPE_VDRD = 24  // View and Dependency Representation Delimiter NAL Unit
+};
+
+/*!
+ *
+ * \brief
+ * Structure corresponding to the Picture Parameter Set (PPS) syntax element (only the relevant information is retained)
+ *
+ * \author
+ * Matteo Naccari
+*/
+struct ReducedPPS
+{
+  bool m_valid = false;  //! True once the PPS has been parsed
+  uint32_t m_id = 0;
+  uint32_t m_sps_id = 0;
+};
+
+/*!
+ *
+ * \brief
+ * Structure corresponding to the Sequence Parameter Set (SPS) syntax element (only the relevant information is retained)
+ *
+ * \author
+ * Matteo Naccari
+*/
+struct ReducedSPS
+{
+  bool m_valid = false;  //! True once the SPS has been parsed
+  uint32_t m_id = 0;
+  bool m_separate_colour_plane_flag = false;
+  uint32_t m_log2_max_frame_num = 4;
+  bool m_frame_mbs_only_flag = true;
+};
+
+/*!
+ *
+ * \brief
+ * Structure corresponding to the first syntax elements of the slice header, up to idr_pic_id.
+ * The elements following pic_parameter_set_id are only known if the parameter sets referred by the slice
+ * have been parsed beforehand
+ *
+ * \author
+ * Matteo Naccari
+*/
+struct SliceHeader
+{
+  uint32_t m_first_mb_in_slice = 0;
+  SliceType m_slice_type = SliceType::P_SLICE;
+  uint32_t m_pps_id = 0;
+  bool m_has_frame_num = false;   //! False when the parameter sets of the slice are not known
+  uint32_t m_frame_num = 0;
+  bool m_field_pic_flag = false;
+  bool m_bottom_field_flag = false;
+  uint32_t m_idr_pic_id = 0;      //! Only meaningful for IDR slices
+};
+
+/*!
+ *
+ * \brief
+ * Skips a scaling list as specified in Clause 7.3.2.1.1.1 of the H.264/AVC standard
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+inline void skip_scaling_list(Reader& r, const int size_of_scaling_list)
+{
+  int last_scale = 8, next_scale = 8;
+
+  for (int j = 0; j < size_of_scaling_list; j++) {
+    if (next_scale != 0) {
+      const int delta_scale = r.read_se();
+      next_scale = (last_scale + delta_scale + 256) % 256;
+    }
+    last_scale = next_scale == 0 ? last_scale : next_scale;
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Parse the sequence parameter set RBSP as specified in Clause 7.3.2.1.1 of the H.264/AVC standard, up to
+ * frame_mbs_only_flag. Only the information needed to parse the slice header is retained. An SPS with an
+ * out of range seq_parameter_set_id or log2_max_frame_num_minus4 is returned as not valid
+ *
+ * \param
+ * Reference to a reader object positioned after the NALU header
+ *
+ * \return
+ * An sps object which can be stored in the whole memory associated with this syntax element
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+inline ReducedSPS parse_reduced_sps(Reader& r)
+{
+  ReducedSPS sps;
+
+  const uint32_t profile_idc = r.read_bits(8);
+  r.read_bits(8); // constraint_set0_flag ... constraint_set5_flag, reserved_zero_2bits
+  r.read_bits(8); // level_idc
+  sps.m_id = r.read_ue();
+  if (sps.m_id >= max_num_sps) {
+    return sps;
+  }
+
+  if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
+      profile_idc == 83 || profile_idc == 86 || profile_idc == 118 || profile_idc == 128 || profile_idc == 138 ||
+      profile_idc == 139 || profile_idc == 134 || profile_idc == 135) {
+    const uint32_t chroma_format_idc = r.read_ue();
+    if (chroma_format_idc == 3) {
+      sps.m_separate_colour_plane_flag = r.read_flag();
+    }
+    r.read_ue(); // bit_depth_luma_minus8
+    r.read_ue(); // bit_depth_chroma_minus8
+    r.read_flag(); // qpprime_y_zero_transform_bypass_flag
+    if (r.read_flag()) { // seq_scaling_matrix_present_flag
+      const int num_lists = chroma_format_idc != 3 ? 8 : 12;
+      for (int i = 0; i < num_lists; i++) {
+        if (r.read_flag()) { // seq_scaling_list_present_flag[ i ]
+          skip_scaling_list(r, i < 6 ? 16 : 64);
+        }
+      }
+    }
+  }
+
+  const uint32_t log2_max_frame_num_minus4 = r.read_ue();
+  if (log2_max_frame_num_minus4 > 12) {
+    return sps;
+  }
+  sps.m_log2_max_frame_num = log2_max_frame_num_minus4 + 4;
+
+  const uint32_t pic_order_cnt_type = r.read_ue();
+  if (pic_order_cnt_type == 0) {
+    r.read_ue(); // log2_max_pic_order_cnt_lsb_minus4
+  }
+  else if (pic_order_cnt_type == 1) {
+    r.read_flag(); // delta_pic_order_always_zero_flag
+    r.read_se(); // offset_for_non_ref_pic
+    r.read_se(); // offset_for_top_to_bottom_field
+    const uint32_t num_ref_frames_in_pic_order_cnt_cycle = r.read_ue();
+    for (uint32_t i = 0; i < num_ref_frames_in_pic_order_cnt_cycle; i++) {
+      r.read_se(); // offset_for_ref_frame[ i ]
+    }
+  }
+
+  r.read_ue(); // max_num_ref_frames
+  r.read_flag(); // gaps_in_frame_num_value_allowed_flag
+  r.read_ue(); // pic_width_in_mbs_minus1
+  r.read_ue(); // pic_height_in_map_units_minus1
+  sps.m_frame_mbs_only_flag = r.read_flag();
+  sps.m_valid = true;
+
+  return sps;
+}
+
+/*!
+ *
+ * \brief
+ * Parse the picture parameter set RBSP as specified in Clause 7.3.2.2 of the H.264/AVC standard, up to
+ * seq_parameter_set_id. A PPS with an out of range identifier is returned as not valid
+ *
+ * \param
+ * Reference to a reader object positioned after the NALU header
+ *
+ * \return
+ * A pps object which can be stored in the whole memory associated with this syntax element
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+inline ReducedPPS parse_reduced_pps(Reader& r)
+{
+  ReducedPPS pps;
+  pps.m_id = r.read_ue();
+  if (pps.m_id >= max_num_pps) {
+    return pps;
+  }
+  pps.m_sps_id = r.read_ue();
+  if (pps.m_sps_id >= max_num_sps) {
+    return pps;
+  }
+  pps.m_valid = true;
+
+  return pps;
+}
+
+/*!
+ *
+ * \brief
+ * Parse the first syntax elements of the slice header as specified in Clause 7.3.3 of the H.264/AVC standard:
+ * first_mb_in_slice, slice_type and pic_parameter_set_id are always parsed. Then frame_num, field_pic_flag,
+ * bottom_field_flag and idr_pic_id follow if the parameter sets of the slice have been parsed
+ *
+ * \param
+ * Reference to a reader object positioned after the NALU header
+ *
+ * \param
+ * True for the slices of an IDR picture
+ *
+ * \return
+ * The parsed slice header
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+inline SliceHeader parse_slice_header(Reader& r, const bool idr_pic_flag, const array<ReducedPPS, max_num_pps>& pps_memory, const array<ReducedSPS, max_num_sps>& sps_memory)
+{
+  SliceHeader sh;
+
+  // Truncated slice headers are parsed as long as there are bits left
+  if (r.only_zeros_left()) {
+    return sh;
+  }
+  sh.m_first_mb_in_slice = r.read_ue();
+
+  if (r.only_zeros_left()) {
+    return sh;
+  }
+  uint32_t slice_type = r.read_ue();
+  if (slice_type > 9) {
+    // An invalid slice_type is handled as a truncated slice header
+    return sh;
+  }
+  if (slice_type > 4) {
+    slice_type -= 5;
+  }
+  sh.m_slice_type = SliceType(slice_type);
+
+  if (r.only_zeros_left()) {
+    return sh;
+  }
+  sh.m_pps_id = r.read_ue();
+
+  if (sh.m_pps_id >= max_num_pps || !pps_memory[sh.m_pps_id].m_valid) {
+    return sh;
+  }
+  const auto& sps = sps_memory[pps_memory[sh.m_pps_id].m_sps_id];
+  if (!sps.m_valid) {
+    return sh;
+  }
+
+  if (sps.m_separate_colour_plane_flag) {
+    r.read_bits(2); // colour_plane_id
+  }
+  sh.m_frame_num = r.read_bits(sps.m_log2_max_frame_num);
+  sh.m_has_frame_num = true;
+
+  if (!sps.m_frame_mbs_only_flag) {
+    sh.m_field_pic_flag = r.read_flag();
+    if (sh.m_field_pic_flag) {
+      sh.m_bottom_field_flag = r.read_flag();
+    }
+  }
+
+  if (idr_pic_flag && !r.only_zeros_left()) {
+    sh.m_idr_pic_id = r.read_ue();
+  }
+
+  return sh;
+}
+
+#endif // !H_SYNTAX_
@@ -40,12 +40,31 @@
 #include "packet.h"
 #include "simulator.h"
 #include "md5.h"
+#include "annexb_reader.h"
+#include "start_code.h"
+#include "nalu_writer.h"
+#include "io_uring_writer.h"
+#include "worker_pool.h"
+#include "nalu_index.h"
+#include "loss_pattern.h"
+#include "emulation_prevention.h"
+#include "spsc_ring.h"
+#include "run_stats.h"
+#include "nalu_tracer.h"
+#include "realization_dedupe.h"
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <random>
+#include <atomic>
+#include <regex>
+#include <thread>
+#include <algorithm>
+#include <streambuf>
 
 using namespace std;
 
@@ -92,6 +111,99 @@ TEST(TestParameter, TestParametersInitialisationFromFile)
   EXPECT_EQ(0, p.get_offset());
 }
 
+TEST(TestParameter, TestParametersOptionsFromCmdLine)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "bistream.264", "bistream_err.264", "error.txt", "1", "0", "0",
+                            "--flush-size", "4096" };
+
+  Parameters p(cmdLine);
+  p.parse_options(9, cmdLine, 7);
+
+  EXPECT_EQ(4096, p.get_flush_size());
+
+  const char* wrongCmdLine[] = { "transmitter-simulator-avc.exe", "bistream.264", "bistream_err.264", "error.txt", "1", "0", "0",
+                                 "--flush-size" };
+
+  EXPECT_THROW(p.parse_options(8, wrongCmdLine, 7), logic_error);
+}
+
+TEST(TestParameter, TestOffsetRangesAreBounded)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "bistream.264", "bistream_err.264", "error.txt", "1", "0", "0",
+                            "--offsets", "2147483640:2147483647:5" };
+
+  Parameters p(cmdLine);
+  p.parse_options(9, cmdLine, 7);
+
+  // The last offset is not followed by a wrapped around one
+  EXPECT_EQ(vector<int>({ 2147483640, 2147483645 }), p.get_offsets());
+
+  const vector<const char*> wrongOffsets = { "0:2147483647", "0:1048576", "0:1048575,0", "0:99999999999", "10:0:0" };
+  for (const auto& offsets : wrongOffsets) {
+    cmdLine[8] = offsets;
+    EXPECT_THROW(p.parse_options(9, cmdLine, 7), logic_error) << offsets;
+  }
+
+  cmdLine[8] = "0:1048575";
+  p.parse_options(9, cmdLine, 7);
+  EXPECT_EQ(Parameters::max_num_offsets, p.get_offsets().size());
+}
+
+TEST(TestParameter, TestIntegerOptionsAreNonNegative)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "bistream.264", "bistream_err.264", "error.txt", "1", "0", "0",
+                            "--jobs", "4" };
+
+  Parameters p(cmdLine);
+  p.parse_options(9, cmdLine, 7);
+  EXPECT_EQ(4u, p.get_jobs());
+
+  const vector<const char*> names = { "--jobs", "--flush-size", "--modalities" };
+  const vector<const char*> wrongValues = { "-1", "+1", "abc", "4x", " 4", "99999999999999999999999" };
+  for (const auto& name : names) {
+    for (const auto& value : wrongValues) {
+      cmdLine[7] = name;
+      cmdLine[8] = value;
+      try {
+        p.parse_options(9, cmdLine, 7);
+        ADD_FAILURE() << name << " " << value;
+      } catch (logic_error& e) {
+        EXPECT_EQ("Option " + string(name) + " requires a non-negative integer", string(e.what())) << value;
+      }
+    }
+  }
+
+  cmdLine[7] = "--modalities";
+  cmdLine[8] = "0,-1";
+  EXPECT_THROW(p.parse_options(9, cmdLine, 7), logic_error);
+}
+
+TEST(TestParameter, TestRepeatedRealizationsAreDropped)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "bistream.264", "bistream_err.264", "error.txt", "1", "0", "0",
+                            "--offsets", "0:20:10,10,-5,30", "--patterns", "a,b,a", "--modalities", "1,0,1" };
+
+  Parameters p(cmdLine);
+  p.parse_options(13, cmdLine, 7);
+
+  // The negative offset is set to zero, which is given already
+  EXPECT_EQ(vector<int>({ 0, 10, 20, 30 }), p.get_offsets());
+  EXPECT_EQ(vector<string>({ "a", "b" }), p.get_loss_pattern_files());
+  EXPECT_EQ(vector<int>({ 1, 0 }), p.get_modalities());
+}
+
+TEST(TestParameter, TestPipelineIsIgnoredInBatchMode)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "bistream.264", "bistream_err.264", "error.txt", "1", "0", "0",
+                            "--pipeline", "on", "--offsets", "0,10" };
+
+  Parameters p(cmdLine);
+  p.parse_options(11, cmdLine, 7);
+
+  EXPECT_TRUE(p.is_batch());
+  EXPECT_FALSE(p.get_use_pipeline());
+}
+
 //////////////////////////////////////////////////////////////////
 // AnnexB packet module tests
 //////////////////////////////////////////////////////////////////
@@ -284,6 +396,855 @@ TEST(TestPacketAnnexB, TestPacketParserFailsOnWrongStartCode2)
   remove(nalu_file_name.c_str());
 }
 
+TEST(TestPacketAnnexB, TestPacketLargerThanEightMegabytes)
+{
+  const string nalu_file_name = "nalu_stream.bin";
+  const uint32_t nalu_size = 9000000;
+  vector<uint8_t> idr_stream = { 0, 0, 0, 1, uint8_t(int(NaluType::NALU_TYPE_IDR) | 0x60), 0x88 };
+  idr_stream.resize(4 + nalu_size, 0xaa);
+  idr_stream.insert(idr_stream.end(), { 0, 0, 0, 1, int(NaluType::NALU_TYPE_PPS), 0xce });
+
+  ofstream ofs(nalu_file_name.c_str(), ios::binary);
+  ofs.write(reinterpret_cast<char*>(&idr_stream[0]), idr_stream.size());
+  ofs.close();
+
+  ifstream ifs(nalu_file_name.c_str(), ios::binary);
+  unique_ptr<Packet> p = make_unique<AnnexBPacket>();
+
+  EXPECT_EQ(4 + nalu_size, p->get_packet(ifs));
+  EXPECT_EQ(NaluType::NALU_TYPE_IDR, p->get_nalu_type());
+  EXPECT_EQ(6, p->get_packet(ifs));
+  EXPECT_EQ(NaluType::NALU_TYPE_PPS, p->get_nalu_type());
+
+  ifs.close();
+  remove(nalu_file_name.c_str());
+}
+
+TEST(TestPacketAnnexB, TestSliceHeaderIsParsedUpToIdrPicId)
+{
+  const string nalu_file_name = "nalu_stream.bin";
+  // High profile SPS with scaling lists, pic_order_cnt_type = 1 and fields (log2_max_frame_num = 16), then the PPS
+  // and an IDR slice whose frame_num and idr_pic_id = 1500 contain an emulation prevention byte
+  vector<uint8_t> stream = { 0, 0, 0, 1, 0x67, 0x64, 0x00, 0x28, 0x4b, 0x64, 0x61, 0x30, 0x52, 0x49, 0x24, 0x92, 0x49, 0x24,
+                             0x92, 0x49, 0x24, 0x92, 0x49, 0x24, 0x92, 0x49, 0x24, 0x92, 0x49, 0x24, 0x92, 0x49, 0x24, 0x92,
+                             0x49, 0x24, 0x83, 0x50, 0xe2, 0x98, 0x82, 0x94, 0x07, 0x80, 0x44, 0x90,
+                             0, 0, 0, 1, 0x68, 0x6a, 0xe2,
+                             0, 0, 0, 1, 0x65, 0x88, 0x60, 0x00, 0x00, 0x03, 0x02, 0xee, 0xdc };
+
+  ofstream ofs(nalu_file_name.c_str(), ios::binary);
+  ofs.write(reinterpret_cast<char*>(&stream[0]), stream.size());
+  ofs.close();
+
+  ifstream ifs(nalu_file_name.c_str(), ios::binary);
+  unique_ptr<Packet> p = make_unique<AnnexBPacket>();
+
+  p->get_packet(ifs);
+  EXPECT_TRUE(p->is_nalu_sps());
+  p->parse_sps();
+  p->get_packet(ifs);
+  EXPECT_TRUE(p->is_nalu_pps());
+  p->parse_pps();
+  p->get_packet(ifs);
+  p->decode_slice_type();
+
+  ifs.close();
+  remove(nalu_file_name.c_str());
+
+  const SliceHeader& sh = p->get_slice_header();
+  EXPECT_EQ(0u, sh.m_first_mb_in_slice);
+  EXPECT_EQ(SliceType::I_SLICE, sh.m_slice_type);
+  EXPECT_EQ(2u, sh.m_pps_id);
+  EXPECT_TRUE(sh.m_has_frame_num);
+  EXPECT_EQ(0u, sh.m_frame_num);
+  EXPECT_FALSE(sh.m_field_pic_flag);
+  EXPECT_EQ(1500u, sh.m_idr_pic_id);
+}
+
+TEST(TestPacketAnnexB, TestInvalidParameterSetsAndSliceTypesAreTolerated)
+{
+  const string nalu_file_name = "nalu_stream.bin";
+  // Valid SPS 0 and PPS 0 followed by a slice, then an SPS with id 32, the SPS 0 with log2_max_frame_num_minus4 = 13,
+  // a PPS with id 256 and the PPS 1 referring to the SPS 32. The last two slices have slice_type = 7 and 10
+  vector<uint8_t> stream = { 0, 0, 0, 1, 0x67, 0x42, 0x00, 0x1e, 0xf4, 0xf0,
+                             0, 0, 0, 1, 0x68, 0xe0,
+                             0, 0, 0, 1, 0x41, 0x88, 0xc0,
+                             0, 0, 0, 1, 0x67, 0x42, 0x00, 0x1e, 0x04, 0x30,
+                             0, 0, 0, 1, 0x67, 0x42, 0x00, 0x1e, 0x8e, 0x80,
+                             0, 0, 0, 1, 0x68, 0x00, 0x80, 0xc0,
+                             0, 0, 0, 1, 0x68, 0x40, 0x86,
+                             0, 0, 0, 1, 0x41, 0x88, 0xc0,
+                             0, 0, 0, 1, 0x41, 0x8b, 0x24 };
+
+  ofstream ofs(nalu_file_name.c_str(), ios::binary);
+  ofs.write(reinterpret_cast<char*>(&stream[0]), stream.size());
+  ofs.close();
+
+  ifstream ifs(nalu_file_name.c_str(), ios::binary);
+  unique_ptr<Packet> p = make_unique<AnnexBPacket>();
+  vector<SliceHeader> slice_headers;
+
+  while (p->get_packet(ifs) > 0) {
+    if (p->is_nalu_sps()) {
+      EXPECT_NO_THROW(p->parse_sps());
+    } else if (p->is_nalu_pps()) {
+      EXPECT_NO_THROW(p->parse_pps());
+    } else {
+      p->decode_slice_type();
+      slice_headers.push_back(p->get_slice_header());
+    }
+  }
+
+  ifs.close();
+  remove(nalu_file_name.c_str());
+
+  ASSERT_EQ(3u, slice_headers.size());
+  EXPECT_EQ(SliceType::I_SLICE, slice_headers[0].m_slice_type);
+  EXPECT_TRUE(slice_headers[0].m_has_frame_num);
+
+  // The SPS 0 referred by the PPS 0 is no longer valid
+  EXPECT_EQ(SliceType::I_SLICE, slice_headers[1].m_slice_type);
+  EXPECT_FALSE(slice_headers[1].m_has_frame_num);
+
+  // An invalid slice_type ends the parsing as a truncated slice header does
+  EXPECT_EQ(SliceType::P_SLICE, slice_headers[2].m_slice_type);
+  EXPECT_EQ(0u, slice_headers[2].m_pps_id);
+}
+
+TEST(TestPacketAnnexB, TestFrameNumIsParsedForEverySlice)
+{
+  ifstream ifs("../unit-tests/bitstream_annexb.264", ios::binary);
+  unique_ptr<Packet> p = make_unique<AnnexBPacket>();
+  int slices = 0;
+
+  while (p->get_packet(ifs) > 0) {
+    if (p->is_nalu_sps()) {
+      p->parse_sps();
+    }
+    if (p->is_nalu_pps()) {
+      p->parse_pps();
+    }
+    if (p->is_nalu_vcl()) {
+      p->decode_slice_type();
+      EXPECT_TRUE(p->get_slice_header().m_has_frame_num);
+      if (p->get_nalu_type() == NaluType::NALU_TYPE_IDR) {
+        EXPECT_EQ(0u, p->get_slice_header().m_frame_num);
+      }
+      slices++;
+    }
+  }
+
+  EXPECT_GT(slices, 0);
+}
+
+//////////////////////////////////////////////////////////////////
+// Bit reader module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestReader, TestExpGolombCodesAreDecoded)
+{
+  // Short codewords are decoded by the table, long ones by counting the leading zeros
+  vector<uint32_t> values = { 0, 1, 2, 6, 7, 14, 15, 29, 30, 31, 254, 255, 1000, 65534, 65535, 65536, 1u << 20, 0xfffffffeu };
+  vector<uint8_t> buffer;
+  uint64_t bit_buffer = 0;
+  int num_bits = 0;
+
+  auto put_bits = [&](uint64_t value, int bits) {
+    for (int b = bits - 1; b >= 0; b--) {
+      bit_buffer = (bit_buffer << 1) | ((value >> b) & 1);
+      if (++num_bits == 8) {
+        buffer.push_back(static_cast<uint8_t>(bit_buffer));
+        bit_buffer = 0;
+        num_bits = 0;
+      }
+    }
+  };
+  for (const auto value : values) {
+    const uint64_t code = uint64_t(value) + 1;
+    int len = 0;
+    while ((code >> (len + 1)) != 0) {
+      len++;
+    }
+    put_bits(0, len);
+    put_bits(code, len + 1);
+    put_bits(1, 1);
+  }
+  put_bits(1, 8);
+
+  Reader r(buffer.data(), buffer.size());
+  for (const auto value : values) {
+    EXPECT_EQ(value, r.read_ue());
+    EXPECT_EQ(1u, r.read_bits(1));
+  }
+}
+
+TEST(TestReader, TestEmulationPreventionBytesAreDropped)
+{
+  const vector<uint8_t> ebsp = { 0xff, 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0xaa, 0x55, 0x66, 0x77 };
+  const vector<uint8_t> rbsp = { 0xff, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0xaa, 0x55, 0x66, 0x77 };
+
+  Reader r(ebsp.data(), ebsp.size());
+  for (const auto byte : rbsp) {
+    EXPECT_EQ(byte, r.read_bits(8));
+  }
+  EXPECT_TRUE(r.only_zeros_left());
+
+  // Random payloads rich in zero bytes, read with reads of any size across the refills
+  mt19937 rng(2021);
+  for (int trial = 0; trial < 200; trial++) {
+    vector<uint8_t> payload(1 + rng() % 64);
+    for (auto& byte : payload) {
+      byte = rng() % 4 == 0 ? static_cast<uint8_t>(rng() % 4) : static_cast<uint8_t>(rng());
+    }
+
+    vector<uint8_t> expected_rbsp;
+    int zero_bytes = 0;
+    for (const auto byte : payload) {
+      if (zero_bytes >= 2 && byte == 0x03) {
+        zero_bytes = 0;
+        continue;
+      }
+      expected_rbsp.push_back(byte);
+      zero_bytes = byte == 0 ? zero_bytes + 1 : 0;
+    }
+
+    Reader payload_reader(payload.data(), payload.size());
+    uint32_t bits_read = 0;
+    while (bits_read < expected_rbsp.size() * 8) {
+      const uint32_t bits = min<uint32_t>(1 + rng() % 32, static_cast<uint32_t>(expected_rbsp.size() * 8 - bits_read));
+      uint32_t expected = 0;
+      for (uint32_t b = bits_read; b < bits_read + bits; b++) {
+        expected = (expected << 1) | ((expected_rbsp[b >> 3] >> (7 - (b & 7))) & 1);
+      }
+      ASSERT_EQ(expected, payload_reader.read_bits(bits));
+      bits_read += bits;
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+// AnnexB reader module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestAnnexBReader, TestNalusAreSplitAcrossBlocks)
+{
+  // Leading zeros, four and three byte start codes, trailing zeros and a start code straddling two blocks
+  vector<uint8_t> stream = { 0, 0, 0, 0, 1, 7, 1, 2, 0, 0, 0, 0, 1, 8, 3, 0, 0, 1, 5, 0, 0, 3, 1, 9, 0, 0 };
+  istringstream iss(string(stream.begin(), stream.end()));
+  AnnexBReader reader(4);
+  AnnexBUnit unit;
+
+  reader.attach(iss);
+
+  EXPECT_EQ(9, reader.next(unit));
+  EXPECT_EQ(4, unit.startcodeprefix_len);
+  EXPECT_EQ(3, unit.len);
+  EXPECT_EQ(5, unit.offset);
+  EXPECT_EQ(vector<uint8_t>({ 7, 1, 2 }), vector<uint8_t>(unit.data, unit.data + unit.len));
+
+  EXPECT_EQ(6, reader.next(unit));
+  EXPECT_EQ(4, unit.startcodeprefix_len);
+  EXPECT_EQ(2, unit.len);
+  EXPECT_EQ(vector<uint8_t>({ 8, 3 }), vector<uint8_t>(unit.data, unit.data + unit.len));
+
+  EXPECT_EQ(11, reader.next(unit));
+  EXPECT_EQ(3, unit.startcodeprefix_len);
+  EXPECT_EQ(6, unit.len);
+  EXPECT_EQ(18, unit.offset);
+  EXPECT_EQ(vector<uint8_t>({ 5, 0, 0, 3, 1, 9 }), vector<uint8_t>(unit.data, unit.data + unit.len));
+
+  EXPECT_EQ(0, reader.next(unit));
+}
+
+TEST(TestAnnexBReader, TestLeadingZerosOnlyInFirstNalu)
+{
+  vector<uint8_t> stream = { 0, 0, 1, 7, 0, 0, 0, 0, 0, 1, 8 };
+  istringstream iss(string(stream.begin(), stream.end()));
+  AnnexBReader reader;
+  AnnexBUnit unit;
+
+  reader.attach(iss);
+
+  // The zeros in front of the second start code are trailing_zero_8bits of the first NAL unit
+  EXPECT_EQ(6, reader.next(unit));
+  EXPECT_EQ(1, unit.len);
+  EXPECT_EQ(5, reader.next(unit));
+  EXPECT_EQ(4, unit.startcodeprefix_len);
+  EXPECT_EQ(0, reader.next(unit));
+}
+
+TEST(TestAnnexBReader, TestStartCodeScannersAgree)
+{
+  mt19937 generator(1979);
+  vector<uint8_t> buffer(4096);
+
+  // Sparse non zero bytes so that zero pairs, start codes and chunk boundaries are hit often
+  for (auto& b : buffer) {
+    b = generator() % 4 ? 0 : generator() % 3;
+  }
+
+  for (size_t begin = 0; begin < 64; begin++) {
+    for (size_t end = buffer.size() - 64; end <= buffer.size(); end++) {
+      const uint8_t* first = buffer.data() + begin;
+      const uint8_t* last = buffer.data() + end;
+      const uint8_t* expected = find_start_code_scalar(first, last);
+      for (const uint8_t* p = first; p < last; p = expected + 1) {
+        expected = find_start_code_scalar(p, last);
+#if defined(SIMULATOR_SSE2)
+        EXPECT_EQ(expected, find_start_code_sse2(p, last));
+#endif
+#if defined(SIMULATOR_X86)
+        if (cpu_has_avx2()) {
+          EXPECT_EQ(expected, find_start_code_avx2(p, last));
+        }
+#endif
+        EXPECT_EQ(expected, find_start_code(p, last));
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+// Emulation prevention module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestEmulationPrevention, TestKernelsAgree)
+{
+  mt19937 generator(1979);
+  vector<uint8_t> buffer(1024);
+
+  // Mostly bytes in [0x00, 0x03] so that triplets and chunk boundaries are hit often
+  for (auto& b : buffer) {
+    b = generator() % 8 ? static_cast<uint8_t>(generator() % 4) : static_cast<uint8_t>(generator());
+  }
+
+  vector<uint8_t> expected(max_ebsp_size(buffer.size())), actual(max_ebsp_size(buffer.size()));
+  for (size_t begin = 0; begin < 70; begin += 3) {
+    for (size_t len = 0; begin + len <= buffer.size(); len += 1 + len / 4) {
+      const uint8_t* src = buffer.data() + begin;
+
+      const size_t rbsp_size = strip_emulation_prevention_scalar(src, len, expected.data());
+#if defined(SIMULATOR_SSE2)
+      ASSERT_EQ(rbsp_size, strip_emulation_prevention_sse2(src, len, actual.data()));
+      ASSERT_TRUE(equal(expected.begin(), expected.begin() + rbsp_size, actual.begin()));
+#endif
+#if defined(SIMULATOR_X86)
+      if (cpu_has_avx2()) {
+        ASSERT_EQ(rbsp_size, strip_emulation_prevention_avx2(src, len, actual.data()));
+        ASSERT_TRUE(equal(expected.begin(), expected.begin() + rbsp_size, actual.begin()));
+      }
+#endif
+      ASSERT_EQ(rbsp_size, strip_emulation_prevention(src, len, actual.data()));
+      ASSERT_TRUE(equal(expected.begin(), expected.begin() + rbsp_size, actual.begin()));
+
+      const size_t ebsp_size = insert_emulation_prevention_scalar(src, len, expected.data());
+#if defined(SIMULATOR_SSE2)
+      ASSERT_EQ(ebsp_size, insert_emulation_prevention_sse2(src, len, actual.data()));
+      ASSERT_TRUE(equal(expected.begin(), expected.begin() + ebsp_size, actual.begin()));
+#endif
+#if defined(SIMULATOR_X86)
+      if (cpu_has_avx2()) {
+        ASSERT_EQ(ebsp_size, insert_emulation_prevention_avx2(src, len, actual.data()));
+        ASSERT_TRUE(equal(expected.begin(), expected.begin() + ebsp_size, actual.begin()));
+      }
+#endif
+      ASSERT_EQ(ebsp_size, insert_emulation_prevention(src, len, actual.data()));
+      ASSERT_TRUE(equal(expected.begin(), expected.begin() + ebsp_size, actual.begin()));
+    }
+  }
+}
+
+TEST(TestEmulationPrevention, TestStrippingUndoesInsertion)
+{
+  mt19937 generator(2021);
+
+  for (int trial = 0; trial < 100; trial++) {
+    vector<uint8_t> rbsp(generator() % 300);
+    for (auto& b : rbsp) {
+      b = generator() % 2 ? 0 : static_cast<uint8_t>(generator() % 5);
+    }
+    // An RBSP ends with the byte of the rbsp_stop_one_bit or with cabac_zero_words (0x0000)
+    if (trial % 2) {
+      rbsp.push_back(0x80);
+    } else {
+      rbsp.insert(rbsp.end(), { 0x80, 0x00, 0x00 });
+    }
+
+    vector<uint8_t> ebsp(max_ebsp_size(rbsp.size()));
+    ebsp.resize(insert_emulation_prevention(rbsp.data(), rbsp.size(), ebsp.data()));
+
+    // No start code can be emulated and the EBSP never ends with a zero byte
+    for (size_t i = 2; i < ebsp.size(); i++) {
+      ASSERT_FALSE(ebsp[i - 2] == 0 && ebsp[i - 1] == 0 && ebsp[i] < 0x03) << i;
+    }
+    EXPECT_NE(0, ebsp.back());
+
+    vector<uint8_t> stripped(ebsp.size());
+    stripped.resize(strip_emulation_prevention(ebsp.data(), ebsp.size(), stripped.data()));
+    EXPECT_EQ(rbsp, stripped);
+
+    // The bit reader strips the emulation prevention bytes in the same way
+    Reader r(ebsp.data(), ebsp.size());
+    for (const auto b : rbsp) {
+      ASSERT_EQ(b, r.read_bits(8));
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////
+// Loss pattern module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestLossPattern, TestPackedPatternMatchesAscii)
+{
+  const string ascii_file_name = "loss_pattern.txt";
+  const string packed_file_name = "loss_pattern.bin";
+  const string cells = "0010110001110";
+
+  ofstream ofs(ascii_file_name.c_str());
+  ofs << cells << '\n';
+  ofs.close();
+
+  LossPattern::pack(ascii_file_name, packed_file_name);
+
+  LossPattern ascii(ascii_file_name);
+  LossPattern packed(packed_file_name);
+
+  EXPECT_FALSE(ascii.is_packed());
+  EXPECT_TRUE(packed.is_packed());
+  EXPECT_EQ(cells.size(), ascii.get_length());
+  EXPECT_EQ(cells.size(), packed.get_length());
+  EXPECT_EQ(cells.size(), packed.get_period());
+
+  // The cursors read the pattern circularly from the offset, as a rotated copy of it would do
+  LossPatternCursor ascii_cursor(ascii, 30);
+  LossPatternCursor packed_cursor(packed, 30);
+  for (size_t i = 0; i < 3 * cells.size(); i++) {
+    EXPECT_EQ(cells[(i + 30) % cells.size()], ascii_cursor.get()) << i;
+    EXPECT_EQ(cells[(i + 30) % cells.size()], packed_cursor.get()) << i;
+    ascii_cursor.advance();
+    packed_cursor.advance();
+  }
+
+  remove(ascii_file_name.c_str());
+  remove(packed_file_name.c_str());
+}
+
+TEST(TestLossPattern, TestPackingRejectsWrongCharacters)
+{
+  const string ascii_file_name = "loss_pattern.txt";
+  const string packed_file_name = "loss_pattern.bin";
+
+  ofstream ofs(ascii_file_name.c_str());
+  ofs << "0010x10\n";
+  ofs.close();
+
+  EXPECT_THROW(LossPattern::pack(ascii_file_name, packed_file_name), runtime_error);
+  EXPECT_THROW(LossPattern("missing_loss_pattern.txt"), runtime_error);
+
+  remove(ascii_file_name.c_str());
+  remove(packed_file_name.c_str());
+}
+
+TEST(TestLossPattern, TestGeneratedPatternIsReproducibleAtAnyOffset)
+{
+  LossPattern pattern("gilbert:plr=10:burst=4:seed=3");
+  LossPattern same_pattern("gilbert:plr=10:burst=4:seed=3");
+  LossPatternCursor from_start(pattern, 0);
+  int lost = 0;
+
+  EXPECT_TRUE(pattern.is_generated());
+
+  for (int i = 0; i < 1000; i++) {
+    from_start.advance();
+  }
+
+  // A cursor starting at an offset reads the cells which a cursor starting at zero reads after the offset
+  LossPatternCursor from_offset(same_pattern, 1000);
+  for (int i = 0; i < 100000; i++) {
+    ASSERT_EQ(from_start.get(), from_offset.get()) << i;
+    lost += from_start.get() == '1';
+    from_start.advance();
+    from_offset.advance();
+  }
+
+  EXPECT_NEAR(10.0, lost / 1000.0, 1.0);
+}
+
+TEST(TestLossPattern, TestBernoulliPatternHasTheGivenLossRate)
+{
+  LossPattern pattern("bernoulli:plr=3:seed=11");
+  LossPattern other_seed("bernoulli:plr=3:seed=12");
+  LossPatternCursor cursor(pattern, 0), other_cursor(other_seed, 0);
+  int lost = 0, differences = 0;
+
+  for (int i = 0; i < 100000; i++) {
+    lost += cursor.get() == '1';
+    differences += cursor.get() != other_cursor.get();
+    cursor.advance();
+    other_cursor.advance();
+  }
+
+  EXPECT_NEAR(3.0, lost / 1000.0, 0.3);
+  EXPECT_GT(differences, 0);
+
+  EXPECT_THROW(LossPattern("bernoulli:plr=300"), logic_error);
+  EXPECT_THROW(LossPattern("gilbert:plr=3"), logic_error);
+  EXPECT_THROW(LossPattern("markov:loss=0/1:p=0.5/0.4/0.5/0.5"), logic_error);
+  EXPECT_THROW(LossPattern("markov:loss=0/1:q=1"), logic_error);
+  EXPECT_TRUE(MarkovLossModel::tag("markov:loss=0/1:p=0.9/0.1/0.5/0.5:seed=2") == "markov_loss0-1_p0.9-0.1-0.5-0.5_seed2");
+}
+
+//////////////////////////////////////////////////////////////////
+// NALU writer module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestNaluWriter, TestSmallPacketsAreGathered)
+{
+  const string nalu_file_name = "nalu_stream.bin";
+  const uint8_t start_code[4] = { 0, 0, 0, 1 };
+  vector<uint8_t> payload = { 0x67, 0x42, 0x00, 0x1e };
+  vector<uint8_t> expected;
+
+  NaluWriter writer(64);
+  writer.open(nalu_file_name);
+  for (int i = 0; i < 20; i++) {
+    const int startcodeprefix_len = i % 2 ? 3 : 4;
+    writer.write(start_code + 4 - startcodeprefix_len, startcodeprefix_len, &payload[0], payload.size());
+    expected.insert(expected.end(), start_code + 4 - startcodeprefix_len, start_code + 4);
+    expected.insert(expected.end(), payload.begin(), payload.end());
+  }
+  writer.close();
+
+  // 150 bytes gathered in a 64 byte buffer
+  EXPECT_EQ(3, writer.get_num_writes());
+  EXPECT_EQ(expected.size(), writer.get_bytes_written());
+
+  ifstream ifs(nalu_file_name.c_str(), ios::binary);
+  vector<uint8_t> written((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+  ifs.close();
+  remove(nalu_file_name.c_str());
+
+  EXPECT_EQ(expected, written);
+}
+
+TEST(TestNaluWriter, TestLargePacketIsWrittenWithBufferedData)
+{
+  const string nalu_file_name = "nalu_stream.bin";
+  const uint8_t start_code[4] = { 0, 0, 0, 1 };
+  vector<uint8_t> small_payload = { 0x68, 0xce };
+  vector<uint8_t> large_payload(1000, 0x65);
+
+  NaluWriter writer(256);
+  writer.open(nalu_file_name);
+  writer.write(start_code, 4, &small_payload[0], small_payload.size());
+  writer.write(start_code + 1, 3, &large_payload[0], large_payload.size());
+
+  // The large payload goes out straight away, together with the small packet buffered before it
+  EXPECT_EQ(1, writer.get_num_writes());
+  EXPECT_EQ(4 + small_payload.size() + 3 + large_payload.size(), writer.get_bytes_written());
+
+  writer.close();
+
+  ifstream ifs(nalu_file_name.c_str(), ios::binary);
+  vector<uint8_t> written((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+  ifs.close();
+  remove(nalu_file_name.c_str());
+
+  ASSERT_EQ(4 + small_payload.size() + 3 + large_payload.size(), written.size());
+  EXPECT_EQ(vector<uint8_t>({ 0, 0, 0, 1, 0x68, 0xce, 0, 0, 1, 0x65 }), vector<uint8_t>(written.begin(), written.begin() + 10));
+  EXPECT_EQ(0x65, written.back());
+}
+
+//////////////////////////////////////////////////////////////////
+// io_uring writer module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestIoUringWriter, TestInterleavedFilesAreWrittenInOrder)
+{
+  if (!IoUringWriter::is_supported()) {
+    GTEST_SKIP();
+  }
+
+  const vector<string> file_names = { "ring_0.bin", "ring_1.bin", "ring_2.bin" };
+  vector<vector<uint8_t>> expected(file_names.size());
+  mt19937 gen(7);
+
+  {
+    IoUringWriter ring(4096, 4);
+    vector<unique_ptr<NaluWriter>> writers;
+    for (const auto& file_name : file_names) {
+      writers.push_back(make_unique<NaluWriter>());
+      writers.back()->open(file_name, ring);
+    }
+
+    // Packets of random lengths, some larger than the buffers of the ring, go to the files in turn
+    for (int n = 0; n < 300; n++) {
+      const size_t f = n % file_names.size();
+      const uint8_t header[4] = { 0, 0, 1, uint8_t(n) };
+      vector<uint8_t> payload(gen() % 10000);
+      for (auto& byte : payload) {
+        byte = uint8_t(gen());
+      }
+      writers[f]->write(header, 4, payload.data(), payload.size());
+      expected[f].insert(expected[f].end(), header, header + 4);
+      expected[f].insert(expected[f].end(), payload.begin(), payload.end());
+    }
+
+    for (auto& writer : writers) {
+      writer->close();
+    }
+    ring.drain();
+  }
+
+  for (size_t f = 0; f < file_names.size(); f++) {
+    ifstream ifs(file_names[f], ios::binary);
+    vector<uint8_t> written((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    ifs.close();
+    EXPECT_TRUE(expected[f] == written) << file_names[f];
+    remove(file_names[f].c_str());
+  }
+
+  IoUringWriter ring(4096, 4);
+  EXPECT_THROW(ring.open("missing_directory/ring.bin"), runtime_error);
+}
+
+//////////////////////////////////////////////////////////////////
+// Run statistics module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestRunStats, TestCountsAreMergedAndWrittenAsJson)
+{
+  const RunStats::NaluClass idr = { 5, int(SliceType::I_SLICE), 1 };
+  const RunStats::NaluClass sps = { 7, -1, -1 };
+  RunStats stats, realization;
+
+  stats.count_read(sps, 10);
+  stats.count_read(idr, 1000);
+  realization.count_transmission(sps, 10, true);
+  realization.count_transmission(idr, 1000, false);
+  realization.add_time(RunStats::WRITE, 2000000, 1000000);
+  realization.add_loss_pattern({ "dir\\\"plr\"", 3, 0, 7, 1 });
+  stats.merge(realization);
+  stats.merge(realization);
+
+  EXPECT_EQ(2u, stats.get_total().read.nalus);
+  EXPECT_EQ(2u, stats.get_total().written.nalus);
+  EXPECT_EQ(2000u, stats.get_total().dropped.bytes);
+  EXPECT_EQ(2000u, stats.get_nalu_type(5).dropped.bytes);
+  EXPECT_EQ(1u, stats.get_slice_type(int(SliceType::I_SLICE)).read.nalus);
+  EXPECT_EQ(0u, stats.get_reference(false).read.nalus);
+  EXPECT_EQ(4000000u, stats.get_stage(RunStats::WRITE).wall_ns);
+  EXPECT_EQ(2u, stats.get_loss_patterns().size());
+
+  // The CPU time of a span is shared out in proportion to the wall time of the stages
+  const array<uint64_t, RunStats::NUM_STAGES> wall = stats.get_wall_times();
+  stats.add_time(RunStats::SCAN, 3000, 0);
+  stats.add_time(RunStats::PARSE, 1000, 0);
+  stats.add_cpu_time(400, wall);
+  EXPECT_EQ(300u, stats.get_stage(RunStats::SCAN).cpu_ns);
+  EXPECT_EQ(100u, stats.get_stage(RunStats::PARSE).cpu_ns);
+
+  ostringstream os;
+  stats.write_json(os, "batch", 5000000, [](int slice_type) { return to_string(slice_type); });
+  const string json = os.str();
+  EXPECT_NE(string::npos, json.find("\"mode\": \"batch\""));
+  EXPECT_NE(string::npos, json.find("\"wall_s\": 0.005000"));
+  EXPECT_NE(string::npos, json.find("\"7\": { \"read\": { \"nalus\": 1, \"bytes\": 10 }, \"written\": { \"nalus\": 2, \"bytes\": 20 }"));
+  EXPECT_NE(string::npos, json.find("\"2\": { \"read\""));
+  EXPECT_NE(string::npos, json.find("{ \"file\": \"dir\\\\\\\"plr\\\"\", \"offset\": 3, \"modality\": 0, \"position\": 7, \"wraps\": 1 }"));
+  EXPECT_NE(string::npos, json.find("\"write\": { \"wall_s\": 0.004000, \"cpu_s\": 0.002000 }"));
+  EXPECT_EQ(string::npos, json.find("\"1\": {"));
+}
+
+//////////////////////////////////////////////////////////////////
+// Tracer module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestTracer, TestRingBufferKeepsTheLastEvents)
+{
+  Tracer& tracer = Tracer::instance();
+  tracer.enable(4, false);
+  for (uint32_t size = 100; size < 106; size++) {
+    TraceScope scope(TraceName::PARSE, 5, size);
+  }
+  {
+    TraceScope scope(TraceName::GET_PACKET);
+    scope.set_nalu(7, 9);
+  }
+  tracer.disable();
+  {
+    TraceScope scope(TraceName::WRITE_PACKET, 1, 1);
+  }
+
+  ostringstream os;
+  tracer.write_chrome_trace(os);
+  const string trace = os.str();
+
+  if (!tracing_compiled_in) {
+    // Compiled out: the scopes are empty and nothing is recorded
+    EXPECT_EQ(0u, tracer.get_num_events());
+    EXPECT_TRUE(trace.empty());
+    return;
+  }
+
+  EXPECT_EQ(7u, tracer.get_num_events());
+  size_t num_events = 0;
+  for (size_t pos = trace.find("\"ph\": \"X\""); pos != string::npos; pos = trace.find("\"ph\": \"X\"", pos + 1)) {
+    num_events++;
+  }
+  EXPECT_EQ(4u, num_events);
+  EXPECT_EQ(string::npos, trace.find("\"size\": 102"));
+  EXPECT_NE(string::npos, trace.find("\"name\": \"parse\""));
+  EXPECT_NE(string::npos, trace.find("\"nal_unit_type\": 5, \"size\": 105"));
+  EXPECT_NE(string::npos, trace.find("\"name\": \"get_packet\""));
+  EXPECT_NE(string::npos, trace.find("\"nal_unit_type\": 7, \"size\": 9"));
+  EXPECT_EQ(string::npos, trace.find("write_packet"));
+}
+
+//////////////////////////////////////////////////////////////////
+// Range copier module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestRangeCopier, TestRangesAreCopiedWithEveryMethod)
+{
+  vector<uint8_t> source_data(100000);
+  mt19937 gen(11);
+  for (auto& byte : source_data) {
+    byte = uint8_t(gen());
+  }
+  {
+    ofstream ofs("range_source.bin", ios::binary);
+    ofs.write(reinterpret_cast<const char*>(source_data.data()), source_data.size());
+  }
+
+  const uint8_t header[4] = { 0, 0, 0, 1 };
+  vector<uint8_t> expected(source_data.begin(), source_data.begin() + 1500);
+  expected.insert(expected.end(), header, header + 4);
+  expected.insert(expected.end(), source_data.begin() + 5000, source_data.begin() + 25000);
+  expected.insert(expected.end(), source_data.begin() + 99000, source_data.end());
+
+  for (auto method : { RangeCopier::Method::COPY_FILE_RANGE, RangeCopier::Method::SENDFILE, RangeCopier::Method::READ_WRITE }) {
+    RangeCopier source("range_source.bin");
+    source.set_method(method);
+    NaluWriter writer;
+    writer.open("range_copy.bin");
+    writer.set_source(&source);
+
+    // The first two ranges follow each other in the source, hence they are copied together
+    writer.copy(0, 1000);
+    writer.copy(1000, 500);
+    writer.write(header, 4);
+    writer.copy(5000, 20000);
+    writer.copy(99000, 1000);
+    writer.close();
+
+    ifstream ifs("range_copy.bin", ios::binary);
+    vector<uint8_t> written((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    ifs.close();
+    EXPECT_TRUE(expected == written) << int(method);
+    EXPECT_EQ(expected.size(), writer.get_bytes_written());
+#if !defined(_WIN32)
+    if (method == RangeCopier::Method::READ_WRITE) {
+      EXPECT_EQ(6u, source.get_num_calls());
+    }
+#endif
+  }
+
+  RangeCopier source("range_source.bin");
+  NaluWriter writer;
+  writer.open("range_copy.bin");
+  writer.set_source(&source);
+  writer.copy(99000, 2000);
+  EXPECT_THROW(writer.close(), runtime_error);
+
+  remove("range_source.bin");
+  remove("range_copy.bin");
+  EXPECT_THROW(RangeCopier("range_source.bin"), runtime_error);
+}
+
+//////////////////////////////////////////////////////////////////
+// Worker pool module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestWorkerPool, TestEveryTaskRunsOnce)
+{
+  vector<atomic<int>> runs(1000);
+  WorkerPool pool(4);
+
+  pool.run(runs.size(), [&](size_t i) { runs[i]++; });
+
+  for (const auto& r : runs) {
+    EXPECT_EQ(1, r.load());
+  }
+}
+
+TEST(TestWorkerPool, TestExceptionIsRethrown)
+{
+  WorkerPool pool(4);
+
+  EXPECT_THROW(pool.run(100, [](size_t i) { if (i == 42) throw runtime_error("task failed"); }), runtime_error);
+}
+
+//////////////////////////////////////////////////////////////////
+// Realization dedupe module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestRealizationDedupe, TestEqualKeptSetsAreFound)
+{
+  vector<RealizationDedupe::KeptSet> kept_sets(5, RealizationDedupe::make_kept_set(130));
+
+  for (size_t n = 0; n < 130; n += 7) {
+    RealizationDedupe::keep(kept_sets[0], n);
+    RealizationDedupe::keep(kept_sets[2], n);
+    RealizationDedupe::keep(kept_sets[3], n);
+  }
+  // Differs from the first set in the last NAL unit only, which lives in the last word
+  RealizationDedupe::keep(kept_sets[3], 129);
+
+  EXPECT_TRUE(RealizationDedupe::is_kept(kept_sets[3], 129));
+  EXPECT_FALSE(RealizationDedupe::is_kept(kept_sets[2], 129));
+  EXPECT_EQ(RealizationDedupe::fingerprint(kept_sets[0]), RealizationDedupe::fingerprint(kept_sets[2]));
+  EXPECT_NE(RealizationDedupe::fingerprint(kept_sets[0]), RealizationDedupe::fingerprint(kept_sets[3]));
+  EXPECT_EQ(vector<size_t>({ 0, 1, 0, 3, 1 }), RealizationDedupe::find_first_equal(kept_sets));
+}
+
+//////////////////////////////////////////////////////////////////
+// SPSC ring module tests
+//////////////////////////////////////////////////////////////////
+TEST(TestSpscRing, TestItemsArriveInOrder)
+{
+  SpscRing<size_t> ring(100);
+  atomic<bool> cancel(false);
+  const size_t num_items = 100000;
+  size_t errors = 0;
+
+  EXPECT_EQ(128u, ring.capacity());
+
+  thread producer([&]() {
+    for (size_t i = 0; i < num_items; i++) {
+      ring.push(i, cancel);
+    }
+  });
+
+  for (size_t i = 0; i < num_items; i++) {
+    size_t item = num_items;
+    const bool popped = ring.pop(item, cancel);
+    if (!popped) {
+      // The producer has to be stopped before the test bails out
+      cancel = true;
+      producer.join();
+    }
+    ASSERT_TRUE(popped);
+    errors += item != i;
+  }
+  producer.join();
+
+  EXPECT_EQ(0u, errors);
+}
+
+TEST(TestSpscRing, TestWaitIsCancelled)
+{
+  SpscRing<int> ring(2);
+  atomic<bool> cancel(true);
+  int item;
+
+  EXPECT_FALSE(ring.pop(item, cancel));
+  EXPECT_TRUE(ring.push(1, cancel));
+  EXPECT_TRUE(ring.push(2, cancel));
+  EXPECT_FALSE(ring.push(3, cancel));
+  EXPECT_TRUE(ring.pop(item, cancel));
+  EXPECT_EQ(1, item);
+}
+
 //////////////////////////////////////////////////////////////////
 // RTP packet module tests
 //////////////////////////////////////////////////////////////////
@@ -512,6 +1473,58 @@ TEST(TestPacketRTP, TestPacketParserFailsOnWrongSsrc)
   remove(nalu_file_name.c_str());
 }
 
+TEST(TestPacketRTP, TestPacketParserFailsOnTruncatedPacket)
+{
+  const vector<uint8_t> truncated_rtp_stream = { 20, 0, 0, 0, 255, 255, 255, 255, 128, 233, 0, 0, 0, 0, 0, 0, 18, 52, 86, 120, int(NaluType::NALU_TYPE_SLICE), 77 };
+  istringstream iss(string(truncated_rtp_stream.begin(), truncated_rtp_stream.end()));
+  RtpPacket p;
+
+  EXPECT_THROW(p.get_packet(iss), logic_error);
+}
+
+//! Stream buffer handing its data over in small chunks and unable to seek, as the one of a pipe
+class PipeBuffer : public streambuf
+{
+  string m_data;
+  size_t m_next;
+  size_t m_chunk;
+
+protected:
+  int_type underflow() override
+  {
+    if (m_next >= m_data.size()) {
+      return traits_type::eof();
+    }
+    const size_t len = min(m_chunk, m_data.size() - m_next);
+    setg(&m_data[m_next], &m_data[m_next], &m_data[m_next] + len);
+    m_next += len;
+    return traits_type::to_int_type(*gptr());
+  }
+
+public:
+  PipeBuffer(const string& data, size_t chunk) : m_data(data), m_next(0), m_chunk(chunk) {}
+};
+
+TEST(TestPacketRTP, TestOffsetsAreCountedOnNonSeekableStream)
+{
+  const vector<uint8_t> rtp_stream = { 13, 0, 0, 0, 255, 255, 255, 255, 128, 233, 0, 0, 0, 0, 0, 0, 18, 52, 86, 120, int(NaluType::NALU_TYPE_SPS),
+                                       15, 0, 0, 0, 255, 255, 255, 255, 128, 233, 0, 1, 0, 0, 0, 0, 18, 52, 86, 120, int(NaluType::NALU_TYPE_SLICE), 77, 78 };
+  PipeBuffer pipe(string(rtp_stream.begin(), rtp_stream.end()), 5);
+  istream is(&pipe);
+  RtpPacket p;
+
+  EXPECT_EQ(13, p.get_packet(is));
+  EXPECT_EQ(NaluType::NALU_TYPE_SPS, p.get_nalu_type());
+  EXPECT_EQ(20u, p.get_nalu().offset);
+
+  EXPECT_EQ(15, p.get_packet(is));
+  EXPECT_EQ(NaluType::NALU_TYPE_SLICE, p.get_nalu_type());
+  EXPECT_EQ(41u, p.get_nalu().offset);
+  EXPECT_EQ(3u, p.get_nalu().len);
+
+  EXPECT_EQ(0, p.get_packet(is));
+}
+
 //////////////////////////////////////////////////////////////////
 // Simulator module tests
 //////////////////////////////////////////////////////////////////
@@ -581,6 +1594,340 @@ TEST(TestSimulator, TestPlr3GivesTheExpectMD5)
   remove("bitstream_annexb_err.264");
 }
 
+TEST(TestSimulator, TestPipelinedRunGivesTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "10", "0",
+                            "--pipeline", "on" };
+  ifstream ifs;
+  const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+
+  Parameters p(cmdLine);
+  p.parse_options(9, cmdLine, 7);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("bitstream_annexb_err.264", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  remove("bitstream_annexb_err.264");
+}
+
+TEST(TestSimulator, TestLibraryInterfaceWorksInMemory)
+{
+  ifstream ifs("../unit-tests/bitstream_annexb.264", ios::binary);
+  const string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+  const uint8_t* bitstream = reinterpret_cast<const uint8_t*>(data_original.data());
+  const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+
+  LossPattern loss_pattern("../error_plr_3");
+  vector<uint8_t> transmitted;
+  Simulator::transmit(bitstream, data_original.size(), 1, { LossPatternCursor(loss_pattern, 10), 0 }, transmitted);
+
+  EXPECT_TRUE(expected_md5 == md5(string(transmitted.begin(), transmitted.end())));
+
+  // Every packet reaches the sink with its start code
+  LossPattern no_losses;
+  no_losses.assign("0");
+  string received;
+  int num_packets = 0;
+  Simulator::transmit(bitstream, data_original.size(), 1, { LossPatternCursor(no_losses, 0), 0 }, [&](const uint8_t* data, size_t len) {
+    EXPECT_TRUE(len >= 3 && data[0] == 0 && data[1] == 0);
+    received.append(reinterpret_cast<const char*>(data), len);
+    num_packets++;
+  });
+
+  EXPECT_TRUE(md5(data_original) == md5(received));
+  EXPECT_LT(1, num_packets);
+  EXPECT_THROW(no_losses.assign(""), runtime_error);
+}
+
+TEST(TestSimulator, TestPacketTypeIsCheckedOnce)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "2", "0", "0" };
+  const uint8_t bitstream[] = { 0, 0, 0, 1, 0x67 };
+
+  // The packetization is chosen before the engine runs, so an unknown one never reaches the packets
+  Parameters p(cmdLine);
+  EXPECT_THROW(Simulator s(p), runtime_error);
+
+  LossPattern no_losses;
+  no_losses.assign("0");
+  vector<uint8_t> transmitted;
+  EXPECT_THROW(Simulator::transmit(bitstream, sizeof(bitstream), 2, { LossPatternCursor(no_losses, 0), 0 }, transmitted), runtime_error);
+  EXPECT_TRUE(transmitted.empty());
+
+  EXPECT_STREQ("RTP", AvcCodec::packet_type_name(0));
+  EXPECT_STREQ("AnnexB", AvcCodec::packet_type_name(1));
+}
+
+TEST(TestSimulator, TestStatsAccountForEveryNalu)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                            "--offsets", "0:10:10", "--jobs", "2", "--stats", "bitstream_annexb_stats.json" };
+  Parameters p(cmdLine);
+  p.parse_options(13, cmdLine, 7);
+
+  Simulator s(p);
+  s.run_simulator();
+
+  ifstream ifs("bitstream_annexb_stats.json");
+  const string json = string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+  ifs.close();
+
+  // Every NALU read is either written or dropped by each of the two realizations
+  smatch match;
+  regex total("\"total\": \\{ \"read\": \\{ \"nalus\": ([0-9]+), \"bytes\": ([0-9]+) \\}, \"written\": \\{ \"nalus\": ([0-9]+), \"bytes\": ([0-9]+) \\}, "
+              "\"dropped\": \\{ \"nalus\": ([0-9]+), \"bytes\": ([0-9]+) \\} \\}");
+  ASSERT_TRUE(regex_search(json, match, total));
+  EXPECT_LT(0, stoi(match[1]));
+  EXPECT_EQ(2 * stoi(match[1]), stoi(match[3]) + stoi(match[5]));
+  EXPECT_EQ(2 * stoi(match[2]), stoi(match[4]) + stoi(match[6]));
+  EXPECT_LT(0, stoi(match[5]));
+
+  EXPECT_NE(string::npos, json.find("\"mode\": \"batch\""));
+  EXPECT_NE(string::npos, json.find("{ \"file\": \"../error_plr_3\", \"offset\": 0, \"modality\": 0"));
+  EXPECT_NE(string::npos, json.find("{ \"file\": \"../error_plr_3\", \"offset\": 10, \"modality\": 0"));
+  EXPECT_NE(string::npos, json.find("\"I\": { \"read\""));
+
+  for (const auto offset : { 0, 10 }) {
+    remove(Simulator::realization_file_name("bitstream_annexb_err.264", "../error_plr_3", offset).c_str());
+  }
+  remove("bitstream_annexb_stats.json");
+
+  // The statistics cannot share the standard output with the transmitted bitstream
+  const char* cmdLineStdout[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "-", "../error_plr_3", "1", "0", "0", "--stats", "-" };
+  Parameters q(cmdLineStdout);
+  EXPECT_THROW(q.parse_options(9, cmdLineStdout, 7), logic_error);
+}
+
+TEST(TestSimulator, TestBatchModeMatchesSingleRuns)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                            "--patterns", "../unit-tests/error_plr_0,../error_plr_3", "--offsets", "0:10:10" };
+  ifstream ifs;
+  const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+
+  Parameters p(cmdLine);
+  p.parse_options(11, cmdLine, 7);
+
+  EXPECT_EQ(vector<int>({ 0, 10 }), p.get_offsets());
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("../unit-tests/bitstream_annexb.264", ios::binary);
+  string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_annexb_err_error_plr_0_10.264", ios::binary);
+  string data_err_plr0 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_annexb_err_error_plr_3_10.264", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(md5(data_original) == md5(data_err_plr0));
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  for (const auto& pattern : { "error_plr_0", "error_plr_3" }) {
+    for (const auto& offset : { "0", "10" }) {
+      remove(("bitstream_annexb_err_" + string(pattern) + "_" + offset + ".264").c_str());
+    }
+  }
+  EXPECT_TRUE(Simulator::realization_file_name("out/str_err.264", "../patterns/plr_3", 7) == "out/str_err_plr_3_7.264");
+}
+
+TEST(TestSimulator, TestDuplicateRealizationsAreWrittenOnce)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                            "--patterns", "../unit-tests/error_plr_0,../error_plr_3", "--offsets", "0:10:10", "--dedupe", "link" };
+  ifstream ifs;
+  const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+
+  Parameters p(cmdLine);
+  p.parse_options(13, cmdLine, 7);
+
+  EXPECT_TRUE(p.get_dedupe_mode() == DedupeMode::LINK);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("../unit-tests/bitstream_annexb.264", ios::binary);
+  string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  // No loss hits the bitstream with error_plr_0, hence the offset 10 realization is a link to the offset 0 one
+  ifs.open("bitstream_annexb_err_error_plr_0_10.264", ios::binary);
+  string data_err_plr0 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_annexb_err_error_plr_3_10.264", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(md5(data_original) == md5(data_err_plr0));
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  ifs.open("bitstream_annexb_err.264.manifest");
+  vector<string> lines;
+  for (string line; getline(ifs, line);) {
+    lines.push_back(line);
+  }
+  ifs.close();
+
+  ASSERT_EQ(5u, lines.size());
+  EXPECT_EQ(0u, lines[2].find("bitstream_annexb_err_error_plr_0_10.264\tbitstream_annexb_err_error_plr_0_0.264\t"));
+  EXPECT_EQ(0u, lines[4].find("bitstream_annexb_err_error_plr_3_10.264\tbitstream_annexb_err_error_plr_3_10.264\t"));
+
+  // In manifest mode the duplicate is not written at all
+  cmdLine[12] = "manifest";
+  Parameters q(cmdLine);
+  q.parse_options(13, cmdLine, 7);
+  Simulator t(q);
+  t.run_simulator();
+
+  ifs.open("bitstream_annexb_err_error_plr_0_10.264", ios::binary);
+  EXPECT_FALSE(ifs.is_open());
+  ifs.open("bitstream_annexb_err_error_plr_0_0.264", ios::binary);
+  EXPECT_TRUE(ifs.is_open());
+  ifs.close();
+
+  for (const auto& pattern : { "error_plr_0", "error_plr_3" }) {
+    for (const auto& offset : { "0", "10" }) {
+      remove(("bitstream_annexb_err_" + string(pattern) + "_" + offset + ".264").c_str());
+    }
+  }
+  remove("bitstream_annexb_err.264.manifest");
+}
+
+TEST(TestSimulator, TestPatternsGivingTheSameNameAreRejected)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                            "--patterns", "../error_plr_3,./../error_plr_3", "--offsets", "10" };
+
+  Parameters p(cmdLine);
+  p.parse_options(11, cmdLine, 7);
+
+  Simulator s(p);
+
+  EXPECT_THROW(s.run_simulator(), logic_error);
+
+  ifstream ifs("bitstream_annexb_err_error_plr_3_10.264", ios::binary);
+  EXPECT_FALSE(ifs.is_open());
+}
+
+TEST(TestSimulator, TestDuplicateNamedAsItsFirstEqualIsKept)
+{
+  for (const auto& mode : { "manifest", "link" }) {
+    const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                              "--offsets", "10,10", "--dedupe", mode };
+    const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+
+    Parameters p(cmdLine);
+    p.parse_options(11, cmdLine, 7);
+
+    Simulator s(p);
+
+    s.run_simulator();
+
+    ifstream ifs("bitstream_annexb_err_error_plr_3_10.264", ios::binary);
+    EXPECT_TRUE(ifs.is_open()) << mode;
+    string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    ifs.close();
+
+    EXPECT_TRUE(expected_md5 == md5(data_err)) << mode;
+
+    remove("bitstream_annexb_err_error_plr_3_10.264");
+    remove("bitstream_annexb_err.264.manifest");
+  }
+}
+
+TEST(TestSimulator, TestCopiedRangesMatchTheWrittenPackets)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                            "--patterns", "../unit-tests/error_plr_0,../error_plr_3", "--offsets", "10", "--copy-ranges", "on" };
+  ifstream ifs;
+  const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+
+  Parameters p(cmdLine);
+  p.parse_options(13, cmdLine, 7);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("../unit-tests/bitstream_annexb.264", ios::binary);
+  string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_annexb_err_error_plr_0_10.264", ios::binary);
+  string data_err_plr0 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_annexb_err_error_plr_3_10.264", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(md5(data_original) == md5(data_err_plr0));
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  remove("bitstream_annexb_err_error_plr_0_10.264");
+  remove("bitstream_annexb_err_error_plr_3_10.264");
+
+  const char* pipelineCmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "0", "0",
+                                    "--copy-ranges", "on", "--pipeline", "on" };
+  Parameters q(pipelineCmdLine);
+  EXPECT_THROW(q.parse_options(11, pipelineCmdLine, 7), logic_error);
+}
+
+TEST(TestSimulator, TestIndexedRunsGiveTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-avc.exe", "../unit-tests/bitstream_annexb.264", "bitstream_annexb_err.264", "../error_plr_3", "1", "10", "0",
+                            "--index", "on" };
+  const string index_file_name = NaluIndex::file_name("../unit-tests/bitstream_annexb.264");
+  ifstream ifs;
+  const string expected_md5 = "520e6ce1387750e8f5f218af5865c69b";
+  NaluIndex index;
+  uint64_t size, hash;
+
+  remove(index_file_name.c_str());
+
+  Parameters p(cmdLine);
+  p.parse_options(9, cmdLine, 7);
+
+  // The first run builds the index, the second one reads the NAL units from it
+  for (int run = 0; run < 2; run++) {
+    Simulator s(p);
+
+    s.run_simulator();
+
+    ifs.open("bitstream_annexb_err.264", ios::binary);
+    string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    ifs.close();
+
+    EXPECT_TRUE(expected_md5 == md5(data_err)) << "run " << run;
+
+    remove("bitstream_annexb_err.264");
+  }
+
+  NaluIndex::hash_file("../unit-tests/bitstream_annexb.264", size, hash);
+  EXPECT_TRUE(index.load(index_file_name));
+  EXPECT_TRUE(index.matches(1, 1, size, hash));
+  EXPECT_FALSE(index.matches(1, 0, size, hash));
+  EXPECT_FALSE(index.matches(1, 1, size, hash ^ 1));
+
+  remove(index_file_name.c_str());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,185 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_ANNEXB_READER_
+#define H_ANNEXB_READER_
+
+#include <istream>
+#include <cstdint>
+#include <stdexcept>
+#include "block_reader.h"
+#include "start_code.h"
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Boundaries of one NAL unit found in an Annex B byte stream. The payload pointer refers to the
+ * reader's buffer and stays valid until the next NAL unit is requested.
+ *
+ * \author
+ * Matteo Naccari
+*/
+struct AnnexBUnit
+{
+  uint8_t* data = nullptr;      //! First byte of the NAL unit (i.e. the NAL unit header)
+  uint32_t len = 0;             //! Length of the NAL unit, start code and trailing zero bytes excluded
+  int startcodeprefix_len = 0;  //! 3 or 4 bytes
+  uint64_t offset = 0;          //! Offset of the NAL unit header in the byte stream
+};
+
+/*!
+ *
+ * \brief
+ * Class which splits an Annex B byte stream into NAL units. The stream is read in large blocks via a BlockReader
+ * and the NAL unit boundaries are found in memory, so no per byte reads or seeks are issued on the stream.
+ * The NAL units returned are the same as the ones obtained by the reference decoder's GetAnnexbNALU:
+ * leading_zero_8bits and trailing_zero_8bits are not part of the NAL unit and the start code length is
+ * reported so that the NAL unit can be written back unchanged.
+ *
+ * \author
+ * Matteo Naccari (adapted from the H.264/AVC decoder reference software)
+*/
+class AnnexBReader
+{
+  BlockReader m_input;
+  bool m_is_first_byte_stream_nalu;
+
+public:
+  AnnexBReader(size_t block_size = block_reader_block_size)
+    : m_input(block_size)
+    , m_is_first_byte_stream_nalu(true)
+  {}
+
+  void attach(istream& is)
+  {
+    m_input.attach(is);
+    m_is_first_byte_stream_nalu = true;
+  }
+
+  istream* stream() const { return m_input.stream(); }
+
+  /*!
+   *
+   * \brief
+   * Extracts the next NAL unit from the byte stream
+   *
+   * \param unit
+   * The boundaries of the NAL unit extracted
+   *
+   * \return
+   * Number of bytes consumed from the stream (leading zeros, start code, NAL unit and trailing zeros),
+   * 0 if there is nothing any more to read (EOF)
+   *
+   * \author
+   * Matteo Naccari (adapted from the H.264/AVC decoder reference software)
+  */
+  uint32_t next(AnnexBUnit& unit)
+  {
+    size_t pos = 0;
+
+    // Leading zeros and start code
+    while (true) {
+      while (pos < m_input.available() && m_input.data()[pos] == 0) {
+        pos++;
+      }
+      if (pos < m_input.available()) {
+        break;
+      }
+      if (m_input.refill() == 0) {
+        if (m_input.available() == 0) {
+          return 0;
+        }
+        throw logic_error("getpacket: can't read start code");
+      }
+    }
+
+    if (m_input.data()[pos] != 1 || pos < 2) {
+      throw logic_error("getpacket: no Start Code at the begin of the NALU");
+    }
+
+    // the 1st byte stream NAL unit can has leading_zero_8bits, but subsequent ones are not
+    // allowed to contain it since these zeros(if any) are considered trailing_zero_8bits
+    // of the previous byte stream NAL unit.
+    if (!m_is_first_byte_stream_nalu && pos > 3) {
+      throw logic_error("getpacket: The leading_zero_8bits syntax can only be present in the first byte stream NAL unit");
+    }
+    m_is_first_byte_stream_nalu = false;
+
+    unit.startcodeprefix_len = pos == 2 ? 3 : 4;
+
+    const size_t nalu_start = pos + 1;
+    size_t scan_from = nalu_start, nalu_end, next_nalu;
+
+    // Next start code (or end of stream)
+    while (true) {
+      const uint8_t* begin = m_input.data();
+      const uint8_t* end = begin + m_input.available();
+      const uint8_t* start_code = find_start_code(begin + scan_from, end);
+
+      if (start_code != end) {
+        nalu_end = start_code - begin;
+        // The zero byte of a four byte start code goes with the next NAL unit
+        next_nalu = nalu_end > nalu_start && begin[nalu_end - 1] == 0 ? nalu_end - 1 : nalu_end;
+        break;
+      }
+
+      // The last two bytes might be the beginning of a start code, scan them again after the refill
+      scan_from = m_input.available() > nalu_start + 2 ? m_input.available() - 2 : nalu_start;
+      if (m_input.refill() == 0) {
+        nalu_end = next_nalu = m_input.available();
+        break;
+      }
+    }
+
+    // trailing_zero_8bits
+    while (nalu_end > nalu_start && m_input.data()[nalu_end - 1] == 0) {
+      nalu_end--;
+    }
+
+    unit.data = m_input.data() + nalu_start;
+    unit.len = static_cast<uint32_t>(nalu_end - nalu_start);
+    unit.offset = m_input.position() + nalu_start;
+
+    m_input.consume(next_nalu);
+
+    return static_cast<uint32_t>(next_nalu);
+  }
+};
+
+#endif // !H_ANNEXB_READER_
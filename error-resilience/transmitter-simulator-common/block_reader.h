@@ -0,0 +1,158 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_BLOCK_READER_
+#define H_BLOCK_READER_
+
+#include <istream>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+//! Number of bytes requested from the input stream at every refill
+constexpr size_t block_reader_block_size = 1 << 22;
+
+/*!
+ *
+ * \brief
+ * Class modelling a block buffered reader for an input stream.
+ * The reader keeps a window of the stream in memory and refills it in large blocks, so that the parsers
+ * built on top of it can scan the data in place rather than pulling one byte at a time from the stream.
+ * The window grows when the caller needs more bytes than a block holds (e.g. for very large NAL units).
+ *
+ * \author
+ * Matteo Naccari
+*/
+class BlockReader
+{
+  istream* m_stream;
+  vector<uint8_t> m_buffer;
+  size_t m_block_size;
+  size_t m_begin;       //! Index of the first byte not yet consumed
+  size_t m_end;         //! Index past the last valid byte in the buffer
+  uint64_t m_position;  //! Stream offset associated with m_begin
+  bool m_eof;
+
+public:
+  BlockReader(size_t block_size = block_reader_block_size)
+    : m_stream(nullptr)
+    , m_block_size(block_size)
+    , m_begin(0)
+    , m_end(0)
+    , m_position(0)
+    , m_eof(true)
+  {}
+
+  //! Binds the reader to a new stream, discarding any data buffered from the previous one
+  void attach(istream& is)
+  {
+    m_stream = &is;
+    m_begin = m_end = 0;
+    m_position = 0;
+    m_eof = false;
+    if (m_buffer.size() < m_block_size) {
+      m_buffer.resize(m_block_size);
+    }
+  }
+
+  istream* stream() const { return m_stream; }
+
+  //! Pointer to the first byte not yet consumed, valid until the next call to refill()
+  const uint8_t* data() const { return m_buffer.data() + m_begin; }
+  uint8_t* data() { return m_buffer.data() + m_begin; }
+
+  //! Number of bytes buffered and not yet consumed
+  size_t available() const { return m_end - m_begin; }
+
+  //! Stream offset of the first byte not yet consumed
+  uint64_t position() const { return m_position; }
+
+  bool eof() const { return m_eof; }
+
+  void consume(size_t bytes)
+  {
+    m_begin += bytes;
+    m_position += bytes;
+  }
+
+  /*!
+   *
+   * \brief
+   * Reads one more block from the stream and appends it to the bytes not yet consumed.
+   * The unconsumed bytes are moved to the beginning of the buffer and the buffer is enlarged when
+   * there is not enough room for a whole block. Pointers returned by data() are invalidated.
+   *
+   * \return
+   * The number of bytes appended, zero when the end of the stream has been reached
+   *
+   * \author
+   * Matteo Naccari
+  */
+  size_t refill()
+  {
+    if (m_eof) {
+      return 0;
+    }
+
+    if (m_begin > 0) {
+      memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+      m_end -= m_begin;
+      m_begin = 0;
+    }
+
+    if (m_buffer.size() - m_end < m_block_size) {
+      m_buffer.resize(2 * m_buffer.size() > m_end + m_block_size ? 2 * m_buffer.size() : m_end + m_block_size);
+    }
+
+    m_stream->read(reinterpret_cast<char*>(m_buffer.data() + m_end), m_buffer.size() - m_end);
+    const size_t bytes_read = static_cast<size_t>(m_stream->gcount());
+
+    if (m_stream->bad()) {
+      throw runtime_error("Something went wrong when reading from the bitstream file");
+    }
+
+    m_end += bytes_read;
+    m_eof = bytes_read == 0;
+
+    return bytes_read;
+  }
+};
+
+#endif // !H_BLOCK_READER_
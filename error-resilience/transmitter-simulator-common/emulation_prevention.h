@@ -0,0 +1,433 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_EMULATION_PREVENTION_
+#define H_EMULATION_PREVENTION_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "intrinsics.h"
+
+/*
+ * Kernels converting the payload of a NAL unit between its EBSP and its RBSP, i.e. removing or inserting the
+ * emulation prevention bytes: a 0x03 follows every pair of zero bytes which would otherwise be followed by a
+ * byte in [0x00, 0x03]. A byte 0x03 is an emulation prevention byte if and only if the two bytes before it in
+ * the EBSP are zero, hence the SIMD kernels look for the triplets 0x00 0x00 0x03 in whole chunks and only
+ * the chunks containing some are compacted one byte at a time.
+ * The source and the destination buffers must not overlap.
+ */
+
+//! Size of the buffer needed to escape an RBSP of len bytes
+inline size_t max_ebsp_size(size_t len)
+{
+  return len + len / 2 + 1;
+}
+
+/*!
+ *
+ * \brief
+ * Copies [p, end) into dst but the emulation prevention bytes. The bytes before p, back to begin, are read to
+ * spot the emulation prevention bytes at the first two positions.
+ * Reference implementation which inspects one byte at a time, used for the tails of the buffers and on CPUs without SIMD
+ *
+ * \return
+ * Pointer past the last byte written in dst
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline uint8_t* strip_emulation_prevention_tail(const uint8_t* begin, const uint8_t* p, const uint8_t* end, uint8_t* dst)
+{
+  for (; p < end; p++) {
+    if (*p != 0x03 || p - begin < 2 || p[-1] != 0 || p[-2] != 0) {
+      *dst++ = *p;
+    }
+  }
+  return dst;
+}
+
+/*!
+ *
+ * \brief
+ * Copies [p, end) into dst and inserts the emulation prevention bytes.
+ * Reference implementation which inspects one byte at a time, used for the tails of the buffers and on CPUs without SIMD
+ *
+ * \param
+ * zero_bytes number of consecutive zero bytes written last in dst, updated on exit
+ *
+ * \return
+ * Pointer past the last byte written in dst
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline uint8_t* insert_emulation_prevention_tail(const uint8_t* p, const uint8_t* end, uint8_t* dst, uint32_t& zero_bytes)
+{
+  for (; p < end; p++) {
+    if (zero_bytes >= 2 && *p <= 0x03) {
+      *dst++ = 0x03;
+      zero_bytes = 0;
+    }
+    *dst++ = *p;
+    zero_bytes = *p == 0 ? zero_bytes + 1 : 0;
+  }
+  return dst;
+}
+
+//! Appends the final 0x03 to an EBSP whose RBSP ends with a zero byte (Clause 7.4.1 of the H.264/AVC and H.265/HEVC standards)
+inline uint8_t* terminate_ebsp(uint8_t* dst, uint32_t zero_bytes)
+{
+  if (zero_bytes > 0) {
+    *dst++ = 0x03;
+  }
+  return dst;
+}
+
+/*!
+ *
+ * \brief
+ * Removes the emulation prevention bytes from the EBSP in src, writing the RBSP in dst (room for len bytes),
+ * one byte at a time
+ *
+ * \return
+ * Size of the RBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline size_t strip_emulation_prevention_scalar(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  return strip_emulation_prevention_tail(src, src, src + len, dst) - dst;
+}
+
+/*!
+ *
+ * \brief
+ * Inserts the emulation prevention bytes in the RBSP in src, writing the EBSP in dst (room for max_ebsp_size(len)
+ * bytes), one byte at a time
+ *
+ * \return
+ * Size of the EBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline size_t insert_emulation_prevention_scalar(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  uint32_t zero_bytes = 0;
+  uint8_t* out = insert_emulation_prevention_tail(src, src + len, dst, zero_bytes);
+  return terminate_ebsp(out, zero_bytes) - dst;
+}
+
+/*!
+ *
+ * \brief
+ * Copies a chunk of n bytes starting at p into dst but the bytes flagged in mask (bit i for p[i])
+ *
+ * \return
+ * Pointer past the last byte written in dst
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline uint8_t* compact_chunk(const uint8_t* p, size_t n, uint64_t mask, uint8_t* dst)
+{
+  size_t from = 0;
+  while (mask) {
+    const size_t i = count_trailing_zeros64(mask);
+    memcpy(dst, p + from, i - from);
+    dst += i - from;
+    from = i + 1;
+    mask &= mask - 1;
+  }
+  memcpy(dst, p + from, n - from);
+  return dst + n - from;
+}
+
+//! Number of consecutive zero bytes at the end of the chunk ending at end (two at most are counted)
+inline uint32_t trailing_zero_bytes(const uint8_t* end)
+{
+  return end[-1] != 0 ? 0 : (end[-2] != 0 ? 1 : 2);
+}
+
+#if defined(SIMULATOR_SSE2)
+/*!
+ *
+ * \brief
+ * SSE2 kernel of strip_emulation_prevention_scalar: the 16 byte chunks without any 0x00 0x00 0x03 triplet are
+ * copied with one store
+ *
+ * \return
+ * Size of the RBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline size_t strip_emulation_prevention_sse2(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i three = _mm_set1_epi8(3);
+  const uint8_t* end = src + len;
+  const uint8_t* p = src + (len < 2 ? len : 2);
+  uint8_t* out = strip_emulation_prevention_tail(src, src, p, dst);
+
+  // Bit i of the mask flags p[i] when p[i - 2], p[i - 1], p[i] is a triplet 0x00 0x00 0x03
+  for (; end - p >= 16; p += 16) {
+    const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 2));
+    const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 1));
+    const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i triplets = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b2, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b0, three));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(triplets));
+
+    if (mask == 0) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), b0);
+      out += 16;
+    } else {
+      out = compact_chunk(p, 16, mask, out);
+    }
+  }
+
+  return strip_emulation_prevention_tail(src, p, end, out) - dst;
+}
+
+/*!
+ *
+ * \brief
+ * SSE2 kernel of insert_emulation_prevention_scalar: the 16 byte chunks where no byte in [0x00, 0x03] follows
+ * a pair of zero bytes are copied with one store
+ *
+ * \return
+ * Size of the EBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline size_t insert_emulation_prevention_sse2(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i three = _mm_set1_epi8(3);
+  const uint8_t* end = src + len;
+  const uint8_t* p = src + (len < 2 ? len : 2);
+  uint32_t zero_bytes = 0;
+  uint8_t* out = insert_emulation_prevention_tail(src, p, dst, zero_bytes);
+
+  for (; end - p >= 16; p += 16) {
+    const __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 2));
+    const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 1));
+    const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i small = _mm_cmpeq_epi8(_mm_max_epu8(b0, three), three);
+    const __m128i candidates = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b2, zero), _mm_cmpeq_epi8(b1, zero)), small);
+
+    if (_mm_movemask_epi8(candidates) == 0) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), b0);
+      out += 16;
+      zero_bytes = trailing_zero_bytes(p + 16);
+    } else {
+      out = insert_emulation_prevention_tail(p, p + 16, out, zero_bytes);
+    }
+  }
+
+  out = insert_emulation_prevention_tail(p, end, out, zero_bytes);
+  return terminate_ebsp(out, zero_bytes) - dst;
+}
+#endif
+
+#if defined(SIMULATOR_X86)
+//! Flags q[i] (bit i) when q[i - 2], q[i - 1], q[i] is a triplet 0x00 0x00 0x03, for 32 bytes
+SIMULATOR_TARGET_AVX2 inline uint32_t emulation_prevention_triplets_avx2(const uint8_t* q)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q - 2));
+  const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q - 1));
+  const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q));
+  const __m256i t = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b2, zero), _mm256_cmpeq_epi8(b1, zero)), _mm256_cmpeq_epi8(b0, _mm256_set1_epi8(3)));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(t));
+}
+
+//! Flags q[i] (bit i) when q[i] is in [0x00, 0x03] and follows a pair of zero bytes, for 32 bytes
+SIMULATOR_TARGET_AVX2 inline uint32_t emulation_prevention_candidates_avx2(const uint8_t* q)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i three = _mm256_set1_epi8(3);
+  const __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q - 2));
+  const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q - 1));
+  const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q));
+  const __m256i small = _mm256_cmpeq_epi8(_mm256_max_epu8(b0, three), three);
+  const __m256i t = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b2, zero), _mm256_cmpeq_epi8(b1, zero)), small);
+  return static_cast<uint32_t>(_mm256_movemask_epi8(t));
+}
+
+/*!
+ *
+ * \brief
+ * AVX2 kernel of strip_emulation_prevention_scalar, same as strip_emulation_prevention_sse2 on 64 byte chunks
+ *
+ * \return
+ * Size of the RBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+SIMULATOR_TARGET_AVX2 inline size_t strip_emulation_prevention_avx2(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  const uint8_t* end = src + len;
+  const uint8_t* p = src + (len < 2 ? len : 2);
+  uint8_t* out = strip_emulation_prevention_tail(src, src, p, dst);
+
+  for (; end - p >= 64; p += 64) {
+    const uint64_t mask = emulation_prevention_triplets_avx2(p) | (uint64_t(emulation_prevention_triplets_avx2(p + 32)) << 32);
+
+    if (mask == 0) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)));
+      out += 64;
+    } else {
+      out = compact_chunk(p, 64, mask, out);
+    }
+  }
+
+  return strip_emulation_prevention_tail(src, p, end, out) - dst;
+}
+
+/*!
+ *
+ * \brief
+ * AVX2 kernel of insert_emulation_prevention_scalar, same as insert_emulation_prevention_sse2 on 64 byte chunks
+ *
+ * \return
+ * Size of the EBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+SIMULATOR_TARGET_AVX2 inline size_t insert_emulation_prevention_avx2(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  const uint8_t* end = src + len;
+  const uint8_t* p = src + (len < 2 ? len : 2);
+  uint32_t zero_bytes = 0;
+  uint8_t* out = insert_emulation_prevention_tail(src, p, dst, zero_bytes);
+
+  for (; end - p >= 64; p += 64) {
+    if ((emulation_prevention_candidates_avx2(p) | emulation_prevention_candidates_avx2(p + 32)) == 0) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)));
+      out += 64;
+      zero_bytes = trailing_zero_bytes(p + 64);
+    } else {
+      out = insert_emulation_prevention_tail(p, p + 64, out, zero_bytes);
+    }
+  }
+
+  out = insert_emulation_prevention_tail(p, end, out, zero_bytes);
+  return terminate_ebsp(out, zero_bytes) - dst;
+}
+#endif
+
+typedef size_t (*EmulationPreventionKernel)(const uint8_t* src, size_t len, uint8_t* dst);
+
+/*!
+ *
+ * \brief
+ * Selects the fastest kernels supported by the CPU the program is running on (AVX2, SSE2 or scalar)
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline EmulationPreventionKernel select_strip_emulation_prevention()
+{
+#if defined(SIMULATOR_X86)
+  if (cpu_has_avx2()) {
+    return strip_emulation_prevention_avx2;
+  }
+#endif
+#if defined(SIMULATOR_SSE2)
+  return strip_emulation_prevention_sse2;
+#else
+  return strip_emulation_prevention_scalar;
+#endif
+}
+
+inline EmulationPreventionKernel select_insert_emulation_prevention()
+{
+#if defined(SIMULATOR_X86)
+  if (cpu_has_avx2()) {
+    return insert_emulation_prevention_avx2;
+  }
+#endif
+#if defined(SIMULATOR_SSE2)
+  return insert_emulation_prevention_sse2;
+#else
+  return insert_emulation_prevention_scalar;
+#endif
+}
+
+/*!
+ *
+ * \brief
+ * Converts the EBSP of a NAL unit in src into its RBSP in dst, which must have room for len bytes
+ *
+ * \return
+ * Size of the RBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline size_t strip_emulation_prevention(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  static const EmulationPreventionKernel kernel = select_strip_emulation_prevention();
+  return kernel(src, len, dst);
+}
+
+/*!
+ *
+ * \brief
+ * Converts the RBSP of a NAL unit in src into its EBSP in dst, which must have room for max_ebsp_size(len) bytes
+ *
+ * \return
+ * Size of the EBSP
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline size_t insert_emulation_prevention(const uint8_t* src, size_t len, uint8_t* dst)
+{
+  static const EmulationPreventionKernel kernel = select_insert_emulation_prevention();
+  return kernel(src, len, dst);
+}
+
+#endif // !H_EMULATION_PREVENTION_
@@ -0,0 +1,159 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_INTRINSICS_
+#define H_INTRINSICS_
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMULATOR_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMULATOR_SSE2 1
+#endif
+
+// Functions using instruction sets beyond the compiler's baseline are tagged so that they can be dispatched at run time
+#if defined(SIMULATOR_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMULATOR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMULATOR_TARGET_AVX2
+#endif
+
+/*!
+ *
+ * \brief
+ * Returns true if the CPU and the operating system support the AVX2 instruction set
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline bool cpu_has_avx2()
+{
+#if defined(SIMULATOR_X86) && (defined(__GNUC__) || defined(__clang__))
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+#elif defined(SIMULATOR_X86) && defined(_MSC_VER)
+  static const bool has_avx2 = []() {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+      return false;
+    }
+    __cpuid(info, 1);
+    const bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+  }();
+  return has_avx2;
+#else
+  return false;
+#endif
+}
+
+//! Index of the least significant bit set, x must not be zero
+inline uint32_t count_trailing_zeros(uint32_t x)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, x);
+  return index;
+#else
+  return __builtin_ctz(x);
+#endif
+}
+
+//! Index of the least significant bit set in a 64 bit word, x must not be zero
+inline uint32_t count_trailing_zeros64(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if (_BitScanForward(&index, static_cast<uint32_t>(x))) {
+    return index;
+  }
+  _BitScanForward(&index, static_cast<uint32_t>(x >> 32));
+  return index + 32;
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+//! Number of leading zero bits, x must not be zero
+inline uint32_t count_leading_zeros64(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanReverse64(&index, x);
+  return 63 - index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if (_BitScanReverse(&index, static_cast<uint32_t>(x >> 32))) {
+    return 31 - index;
+  }
+  _BitScanReverse(&index, static_cast<uint32_t>(x));
+  return 63 - index;
+#else
+  return __builtin_clzll(x);
+#endif
+}
+
+//! Loads eight bytes stored in big endian order (i.e. in bitstream order), whatever the alignment
+inline uint64_t load_big_endian64(const uint8_t* p)
+{
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return x;
+#elif defined(_MSC_VER)
+  return _byteswap_uint64(x);
+#else
+  return __builtin_bswap64(x);
+#endif
+}
+
+#endif // !H_INTRINSICS_
@@ -0,0 +1,484 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_IO_URING_WRITER_
+#define H_IO_URING_WRITER_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SIMULATOR_IO_URING 1
+#endif
+#endif
+
+#if defined(SIMULATOR_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+//! Default number of buffers of an IoUringWriter, i.e. the maximum number of writes in flight
+constexpr unsigned io_uring_writer_num_buffers = 16;
+
+#if defined(SIMULATOR_IO_URING)
+
+/*!
+ *
+ * \brief
+ * Class which writes many files through one Linux io_uring, set up with the raw system calls. The data are
+ * gathered in a pool of buffers registered with the kernel; a full buffer is queued as a write at the end of
+ * its file and the queued writes are handed over to the kernel in batches, when a buffer is needed and none
+ * is free. The writes of a file are not waited for when the file is closed, so a thread can go on with the
+ * next file while the previous ones are still being written. The first failure is reported by the following
+ * call to acquire_buffer() or drain().
+ * The object must be used by one thread at a time.
+ *
+ * \author
+ * Matteo Naccari
+*/
+class IoUringWriter
+{
+  struct File {
+    int fd;
+    uint64_t size;      //! Bytes queued for the file so far, i.e. the offset of its next write
+    unsigned pending;   //! Writes of the file not yet completed
+    bool closing;       //! The file is closed as soon as its pending writes are completed
+    string name;
+  };
+
+  struct Write {
+    int file;
+    uint64_t offset;
+    uint32_t len;
+    uint32_t done;
+  };
+
+  int m_ring_fd;
+  uint8_t* m_sq_ptr;
+  size_t m_sq_size;
+  uint8_t* m_cq_ptr;
+  size_t m_cq_size;
+  io_uring_sqe* m_sqes;
+  size_t m_sqes_size;
+  unsigned* m_sq_head;
+  unsigned* m_sq_tail;
+  unsigned* m_sq_array;
+  unsigned m_sq_mask;
+  unsigned* m_cq_head;
+  unsigned* m_cq_tail;
+  io_uring_cqe* m_cqes;
+  unsigned m_cq_mask;
+  unsigned m_to_submit;     //! Writes queued and not yet handed over to the kernel
+  unsigned m_in_flight;     //! Writes handed over to the kernel and not yet completed
+
+  vector<uint8_t> m_arena;  //! Memory of the buffers, registered with the kernel when allowed
+  size_t m_buffer_size;
+  bool m_registered;
+  vector<unsigned> m_free_buffers;
+  vector<Write> m_writes;   //! Write carried by each buffer
+  vector<File> m_files;
+  vector<int> m_free_files;
+  string m_error;           //! First failure, not yet reported
+
+  static int setup(unsigned entries, io_uring_params* params) { return int(syscall(__NR_io_uring_setup, entries, params)); }
+  static int enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+  {
+    return int(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+  }
+  static int register_buffers(int fd, const iovec* iov, unsigned num)
+  {
+    return int(syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, num));
+  }
+
+  void release()
+  {
+    if (m_sqes) {
+      munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ptr && m_cq_ptr != m_sq_ptr) {
+      munmap(m_cq_ptr, m_cq_size);
+    }
+    if (m_sq_ptr) {
+      munmap(m_sq_ptr, m_sq_size);
+    }
+    if (m_ring_fd >= 0) {
+      ::close(m_ring_fd);
+    }
+    for (auto& file : m_files) {
+      if (file.fd >= 0) {
+        ::close(file.fd);
+      }
+    }
+    m_sqes = nullptr;
+    m_cq_ptr = m_sq_ptr = nullptr;
+    m_ring_fd = -1;
+    m_files.clear();
+  }
+
+  void fail(const string& message)
+  {
+    if (m_error.empty()) {
+      m_error = message;
+    }
+  }
+
+  //! Queues the remaining bytes of the write carried by the given buffer
+  void queue_write(unsigned buffer)
+  {
+    const Write& w = m_writes[buffer];
+    const unsigned tail = *m_sq_tail;
+    const unsigned index = tail & m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+
+    // The submission queue has one entry per buffer, hence it cannot be full
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = m_registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = m_files[w.file].fd;
+    sqe->off = w.offset + w.done;
+    sqe->addr = reinterpret_cast<uint64_t>(m_arena.data() + buffer * m_buffer_size + w.done);
+    sqe->len = w.len - w.done;
+    sqe->buf_index = uint16_t(buffer);
+    sqe->user_data = buffer;
+
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    m_to_submit++;
+  }
+
+  //! Hands the queued writes over to the kernel and waits for the given number of completions
+  void submit(unsigned min_complete)
+  {
+    while (m_to_submit > 0 || min_complete > 0) {
+      const int ret = enter(m_ring_fd, m_to_submit, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw runtime_error("io_uring_enter failed: " + string(strerror(errno)));
+      }
+      m_to_submit -= unsigned(ret);
+      m_in_flight += unsigned(ret);
+      if (m_to_submit == 0) {
+        return;
+      }
+    }
+  }
+
+  void close_file(int f)
+  {
+    File& file = m_files[f];
+    if (::close(file.fd) != 0) {
+      fail("Cannot close " + file.name + ": " + string(strerror(errno)));
+    }
+    file.fd = -1;
+    file.closing = false;
+    m_free_files.push_back(f);
+  }
+
+  //! Processes the completed writes: short writes are queued again, the other ones give their buffer back
+  void reap()
+  {
+    unsigned head = *m_cq_head;
+    const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+      const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+      const unsigned buffer = unsigned(cqe.user_data);
+      const int res = cqe.res;
+      Write& w = m_writes[buffer];
+      File& file = m_files[w.file];
+      m_in_flight--;
+
+      if (res == -EINTR || res == -EAGAIN) {
+        queue_write(buffer);
+        continue;
+      }
+      if (res < 0) {
+        fail("Cannot write " + file.name + ": " + string(strerror(-res)));
+      } else if (res == 0) {
+        fail("Cannot write " + file.name + ": no data written");
+      } else {
+        w.done += uint32_t(res);
+        if (w.done < w.len) {
+          queue_write(buffer);
+          continue;
+        }
+      }
+
+      m_free_buffers.push_back(buffer);
+      if (--file.pending == 0 && file.closing) {
+        close_file(w.file);
+      }
+    }
+
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  void check()
+  {
+    if (!m_error.empty()) {
+      const string message = m_error;
+      m_error.clear();
+      throw runtime_error(message);
+    }
+  }
+
+public:
+  //! True if the running kernel lets this process set up an io_uring
+  static bool is_supported()
+  {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const int fd = setup(1, &params);
+    if (fd < 0) {
+      return false;
+    }
+    ::close(fd);
+    return true;
+  }
+
+  /*!
+   *
+   * \brief
+   * Sets up the ring and the pool of buffers. The buffers are registered with the kernel when the locked
+   * memory limit allows it, otherwise they are written as plain user memory
+   *
+   * \param
+   * buffer_size the size of each buffer, i.e. of the largest write
+   * num_buffers the number of buffers, i.e. of the writes in flight
+   *
+   * \author
+   * Matteo Naccari
+  */
+  IoUringWriter(size_t buffer_size, unsigned num_buffers = io_uring_writer_num_buffers)
+    : m_ring_fd(-1)
+    , m_sq_ptr(nullptr)
+    , m_sq_size(0)
+    , m_cq_ptr(nullptr)
+    , m_cq_size(0)
+    , m_sqes(nullptr)
+    , m_sqes_size(0)
+    , m_to_submit(0)
+    , m_in_flight(0)
+    , m_buffer_size(buffer_size)
+    , m_registered(false)
+  {
+    if (buffer_size == 0 || buffer_size > (1u << 30) || num_buffers == 0 || num_buffers > (1u << 15)) {
+      throw logic_error("IoUringWriter: wrong buffer configuration");
+    }
+
+    unsigned entries = 1;
+    while (entries < num_buffers) {
+      entries <<= 1;
+    }
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ring_fd = setup(entries, &params);
+    if (m_ring_fd < 0) {
+      throw runtime_error("Cannot set up the io_uring: " + string(strerror(errno)));
+    }
+
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      m_sq_size = m_cq_size = m_sq_size > m_cq_size ? m_sq_size : m_cq_size;
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    void* sq = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    m_sq_ptr = sq == MAP_FAILED ? nullptr : static_cast<uint8_t*>(sq);
+    void* cq = single_mmap ? sq : mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+    m_cq_ptr = cq == MAP_FAILED ? nullptr : static_cast<uint8_t*>(cq);
+    void* sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    m_sqes = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+    if (!m_sq_ptr || !m_cq_ptr || !m_sqes) {
+      const string message = strerror(errno);
+      release();
+      throw runtime_error("Cannot map the io_uring: " + message);
+    }
+
+    m_sq_head = reinterpret_cast<unsigned*>(m_sq_ptr + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(m_sq_ptr + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(m_sq_ptr + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(m_sq_ptr + params.sq_off.array);
+    m_cq_head = reinterpret_cast<unsigned*>(m_cq_ptr + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(m_cq_ptr + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(m_cq_ptr + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(m_cq_ptr + params.cq_off.cqes);
+
+    m_arena.resize(buffer_size * num_buffers);
+    m_writes.resize(num_buffers);
+    vector<iovec> iov(num_buffers);
+    for (unsigned b = 0; b < num_buffers; b++) {
+      iov[b].iov_base = m_arena.data() + b * buffer_size;
+      iov[b].iov_len = buffer_size;
+      m_free_buffers.push_back(num_buffers - 1 - b);
+    }
+    m_registered = register_buffers(m_ring_fd, iov.data(), num_buffers) == 0;
+  }
+
+  IoUringWriter(const IoUringWriter&) = delete;
+  IoUringWriter& operator=(const IoUringWriter&) = delete;
+
+  ~IoUringWriter()
+  {
+    try {
+      drain();
+    } catch (...) {
+      // Errors are reported by explicit calls to drain()
+    }
+    release();
+  }
+
+  size_t get_buffer_size() const { return m_buffer_size; }
+
+  //! True if the buffers are registered with the kernel, i.e. the writes do not map the user memory every time
+  bool has_registered_buffers() const { return m_registered; }
+
+  //! Creates (or truncates) the given file, returning the identifier used by the other methods
+  int open(const string& file_name)
+  {
+    const int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw runtime_error("Cannot open " + file_name + " transmitted bitstream, abort");
+    }
+
+    int f;
+    if (m_free_files.empty()) {
+      f = int(m_files.size());
+      m_files.push_back(File());
+    } else {
+      f = m_free_files.back();
+      m_free_files.pop_back();
+    }
+    m_files[f] = { fd, 0, 0, false, file_name };
+
+    return f;
+  }
+
+  //! Takes a free buffer, waiting for the completion of a write if needed
+  uint8_t* acquire_buffer(unsigned& buffer)
+  {
+    while (m_free_buffers.empty()) {
+      if (m_to_submit == 0 && m_in_flight == 0) {
+        throw logic_error("IoUringWriter: all the buffers are taken and none is being written");
+      }
+      submit(1);
+      reap();
+    }
+    check();
+
+    buffer = m_free_buffers.back();
+    m_free_buffers.pop_back();
+    return m_arena.data() + buffer * m_buffer_size;
+  }
+
+  //! Gives back a buffer which has not been written
+  void release_buffer(unsigned buffer) { m_free_buffers.push_back(buffer); }
+
+  //! Queues the write of the first len bytes of the buffer at the end of the file. The buffer is given back once written
+  void write(int file, unsigned buffer, size_t len)
+  {
+    if (len == 0) {
+      release_buffer(buffer);
+      return;
+    }
+
+    File& f = m_files[file];
+    m_writes[buffer] = { file, f.size, uint32_t(len), 0 };
+    f.size += len;
+    f.pending++;
+    queue_write(buffer);
+  }
+
+  //! Closes the file as soon as its writes are completed
+  void close(int file)
+  {
+    if (m_files[file].pending == 0) {
+      close_file(file);
+    } else {
+      m_files[file].closing = true;
+    }
+  }
+
+  //! Waits for all the writes to be completed and for all the closed files to be released
+  void drain()
+  {
+    while (m_to_submit > 0 || m_in_flight > 0) {
+      submit(1);
+      reap();
+    }
+    check();
+  }
+};
+
+#else
+
+//! Placeholder of the io_uring writer on the platforms which do not provide io_uring
+class IoUringWriter
+{
+public:
+  static bool is_supported() { return false; }
+
+  IoUringWriter(size_t, unsigned = io_uring_writer_num_buffers) { throw runtime_error("io_uring is not available on this platform"); }
+
+  size_t get_buffer_size() const { return 0; }
+  bool has_registered_buffers() const { return false; }
+  int open(const string&) { return -1; }
+  uint8_t* acquire_buffer(unsigned&) { return nullptr; }
+  void release_buffer(unsigned) {}
+  void write(int, unsigned, size_t) {}
+  void close(int) {}
+  void drain() {}
+};
+
+#endif
+
+#endif // !H_IO_URING_WRITER_
@@ -0,0 +1,297 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_LOSS_GENERATOR_
+#define H_LOSS_GENERATOR_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Counter-based pseudo random number generator: the draw at a given position is a keyed hash of the
+ * position itself, hence any draw can be computed without the ones preceding it and without any state
+ *
+ * \author
+ * Matteo Naccari
+*/
+class CounterRng
+{
+  static uint64_t mix(uint64_t x)
+  {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+  }
+
+public:
+  //! Key associated with a seed, so that sequences of consecutive seeds are not correlated
+  static uint64_t key(uint64_t seed) { return mix(seed + 0x9e3779b97f4a7c15ull); }
+
+  //! 64 bit draw at the given position of the sequence of the given key
+  static uint64_t at(uint64_t key, uint64_t counter) { return mix(mix(counter ^ key) + key); }
+};
+
+/*!
+ *
+ * \brief
+ * Class modelling a synthetic channel as a Markov chain whose states lose each packet with a given probability.
+ * The chain starts in state 0 and, for each packet, first decides whether the packet is lost according to the
+ * current state and then moves to the next state. Both decisions take a half of the draw of the CounterRng at
+ * the packet position. The model is built from a specification given in place of the loss pattern file:
+ * - bernoulli:plr=<%>[:seed=<n>] independent losses with the given packet loss rate
+ * - gilbert:plr=<%>:burst=<packets>[:good=<p>][:bad=<p>][:seed=<n>] two state Gilbert-Elliott model, whose
+ *   transitions are computed as the gilbert-model tool does. good and bad are the loss probabilities in the good
+ *   and bad states (0 and 1 by default, i.e. the Gilbert model, where plr is the actual packet loss rate)
+ * - markov:loss=<p0>/<p1>/...:p=<p00>/<p01>/.../<pNN>[:seed=<n>] general model with N states, loss gives the loss
+ *   probability of each state and p the transition probabilities, row by row
+ *
+ * \author
+ * Matteo Naccari
+*/
+class MarkovLossModel
+{
+  static constexpr double one = 4294967296.0;  //! Probabilities are compared with 32 bit draws
+
+  uint32_t m_num_states;
+  vector<uint64_t> m_loss;         //! Loss threshold of each state
+  vector<uint64_t> m_transitions;  //! Cumulative transition thresholds, row by row
+  uint64_t m_key;
+
+  static uint64_t threshold(double p) { return static_cast<uint64_t>(llround(p * one)); }
+
+  static vector<double> parse_values(const string& spec, const string& value)
+  {
+    vector<double> values;
+    size_t start = 0;
+
+    while (start <= value.size()) {
+      size_t end = value.find('/', start);
+      if (end == string::npos) {
+        end = value.size();
+      }
+      try {
+        size_t used;
+        values.push_back(stod(value.substr(start, end - start), &used));
+        if (used != end - start) {
+          throw invalid_argument(value);
+        }
+      }
+      catch (exception&) {
+        throw logic_error("Bad value " + value + " in loss generator " + spec);
+      }
+      start = end + 1;
+    }
+
+    return values;
+  }
+
+  static void check_probability(const string& spec, double p)
+  {
+    if (!(0.0 <= p && p <= 1.0)) {
+      throw logic_error("Probability " + to_string(p) + " out of [0, 1] in loss generator " + spec);
+    }
+  }
+
+  void set_model(const string& spec, const vector<double>& loss, const vector<double>& transitions)
+  {
+    m_num_states = static_cast<uint32_t>(loss.size());
+
+    if (transitions.size() != loss.size() * loss.size()) {
+      throw logic_error("Loss generator " + spec + " needs " + to_string(loss.size() * loss.size()) + " transition probabilities");
+    }
+
+    m_loss.clear();
+    for (const auto p : loss) {
+      check_probability(spec, p);
+      m_loss.push_back(threshold(p));
+    }
+
+    m_transitions.clear();
+    for (uint32_t s = 0; s < m_num_states; s++) {
+      double cumulative = 0.0;
+      for (uint32_t t = 0; t < m_num_states; t++) {
+        check_probability(spec, transitions[s * m_num_states + t]);
+        cumulative += transitions[s * m_num_states + t];
+        m_transitions.push_back(t + 1 == m_num_states ? threshold(1.0) : threshold(min(cumulative, 1.0)));
+      }
+      if (fabs(cumulative - 1.0) > 1e-6) {
+        throw logic_error("Transition probabilities of state " + to_string(s) + " do not sum to one in loss generator " + spec);
+      }
+    }
+  }
+
+public:
+  MarkovLossModel() : m_num_states(0), m_key(0) {}
+
+  //! True if the loss pattern file name is actually the specification of a loss generator
+  static bool is_spec(const string& name)
+  {
+    return name.compare(0, 10, "bernoulli:") == 0 || name.compare(0, 8, "gilbert:") == 0 || name.compare(0, 7, "markov:") == 0;
+  }
+
+  //! Name of the loss generator usable as part of a file name, e.g. gilbert_plr3_burst2_seed1
+  static string tag(const string& spec)
+  {
+    string name;
+    for (const auto c : spec) {
+      if (c == ':') {
+        name += '_';
+      } else if (c == '/') {
+        name += '-';
+      } else if (c != '=') {
+        name += c;
+      }
+    }
+    return name;
+  }
+
+  /*!
+   *
+   * \brief
+   * Builds the model from its specification
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void parse(const string& spec)
+  {
+    if (!is_spec(spec)) {
+      throw logic_error("Unknown loss generator " + spec);
+    }
+
+    const size_t colon = spec.find(':');
+    const string kind = spec.substr(0, colon);
+    double plr = -1.0, burst = -1.0, good = 0.0, bad = 1.0;
+    vector<double> loss, transitions;
+    uint64_t seed = 0;
+
+    size_t start = colon + 1;
+    while (start < spec.size()) {
+      size_t end = spec.find(':', start);
+      if (end == string::npos) {
+        end = spec.size();
+      }
+      const string field = spec.substr(start, end - start);
+      const size_t equal = field.find('=');
+      if (equal == string::npos) {
+        throw logic_error("Bad field " + field + " in loss generator " + spec + ", expected name=value");
+      }
+      const string name = field.substr(0, equal);
+      const string value = field.substr(equal + 1);
+
+      if (name == "seed") {
+        try {
+          seed = stoull(value);
+        }
+        catch (exception&) {
+          throw logic_error("Bad seed " + value + " in loss generator " + spec);
+        }
+      } else if (name == "plr" && kind != "markov") {
+        plr = parse_values(spec, value)[0] / 100.0;
+      } else if (name == "burst" && kind == "gilbert") {
+        burst = parse_values(spec, value)[0];
+      } else if (name == "good" && kind == "gilbert") {
+        good = parse_values(spec, value)[0];
+      } else if (name == "bad" && kind == "gilbert") {
+        bad = parse_values(spec, value)[0];
+      } else if (name == "loss" && kind == "markov") {
+        loss = parse_values(spec, value);
+      } else if (name == "p" && kind == "markov") {
+        transitions = parse_values(spec, value);
+      } else {
+        throw logic_error("Unknown field " + name + " in loss generator " + spec);
+      }
+      start = end + 1;
+    }
+
+    if (kind == "bernoulli") {
+      check_probability(spec, plr);
+      set_model(spec, { plr }, { 1.0 });
+    } else if (kind == "gilbert") {
+      check_probability(spec, plr);
+      if (!(burst >= 1.0) || plr >= 1.0) {
+        throw logic_error("Loss generator " + spec + " needs plr < 100 and burst >= 1");
+      }
+      // Same transitions as the gilbert-model tool: b = P(bad -> bad), g = P(good -> good)
+      const double b = 1.0 - 1.0 / burst;
+      const double g = 1.0 - ((1.0 - b) / (1.0 - plr)) * plr;
+      if (g < 0.0) {
+        throw logic_error("Loss generator " + spec + " has a burst length too short for its plr");
+      }
+      set_model(spec, { good, bad }, { g, 1.0 - g, 1.0 - b, b });
+    } else {
+      if (loss.empty()) {
+        throw logic_error("Loss generator " + spec + " needs the loss probabilities of its states");
+      }
+      set_model(spec, loss, transitions);
+    }
+
+    m_key = CounterRng::key(seed);
+  }
+
+  uint32_t get_num_states() const { return m_num_states; }
+
+  //! Draw associated with the packet at the given position
+  uint64_t draw(uint64_t position) const { return CounterRng::at(m_key, position); }
+
+  //! True if the packet associated with the draw is lost in the given state
+  bool is_lost(uint32_t state, uint64_t draw) const { return (draw & 0xffffffffull) < m_loss[state]; }
+
+  //! State following the given one according to the draw
+  uint32_t next_state(uint32_t state, uint64_t draw) const
+  {
+    const uint64_t u = draw >> 32;
+    const uint64_t* row = &m_transitions[state * m_num_states];
+    uint32_t next = 0;
+    while (u >= row[next]) {
+      next++;
+    }
+    return next;
+  }
+};
+
+#endif // !H_LOSS_GENERATOR_
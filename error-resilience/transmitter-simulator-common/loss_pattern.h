@@ -0,0 +1,376 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_LOSS_PATTERN_
+#define H_LOSS_PATTERN_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include "loss_generator.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Class modelling a loss pattern file, i.e. the sequence of packet losses ('1') and correct transmissions ('0')
+ * which the simulated channel reads in a circular fashion. Two formats are supported:
+ * - ASCII: a plain text file of '0' and '1' characters, as generated by the gilbert-model tool
+ * - packed: the "LOSSBIT1" magic, the number of cells as a 64 bit little endian integer and then one bit
+ *   per cell, the first cell being the least significant bit of the first byte. Packed files are written by
+ *   pack() or by the pattern-packer tool
+ * On POSIX systems the file is memory mapped and never copied, so that traces of hundreds of millions of packets
+ * cost neither the memory nor the time of reading them, whichever the number of channel realizations. On Windows
+ * the file is read once into memory instead, which costs its size but is still shared by all the realizations.
+ * For the ASCII format the cells and the period after which the position wraps are the ones found by the
+ * original implementation: the cells stop at the first new line and the period is the file size minus one.
+ * In place of a file name, the specification of a MarkovLossModel can be given (e.g. gilbert:plr=3:burst=2):
+ * the pattern is then generated on the fly by the cursors, it is endless and it is never stored.
+ * A pattern can also be given in memory as a string of '0' and '1' characters, e.g. by a library caller.
+ *
+ * \author
+ * Matteo Naccari
+*/
+class LossPattern
+{
+  const uint8_t* m_data;   //! Content of the loss pattern file
+  uint64_t m_size;         //! Size of the loss pattern file
+  const uint8_t* m_cells;  //! First cell of the loss pattern
+  uint64_t m_length;       //! Number of cells read in a circular fashion from the starting offset
+  uint64_t m_period;       //! Number of positions after which the channel goes back to the starting offset
+  bool m_packed;
+  bool m_generated;
+  MarkovLossModel m_model;
+  string m_text;           //! Cells given in memory by assign()
+#if defined(_WIN32)
+  vector<uint8_t> m_file;  //! Content of the loss pattern file, read in memory since it is not mapped on Windows
+#else
+  void* m_map;             //! Memory mapping of the loss pattern file
+#endif
+
+  static constexpr uint64_t packed_header_size = 16;
+
+  void release()
+  {
+#if !defined(_WIN32)
+    if (m_map != nullptr) {
+      munmap(m_map, m_size);
+    }
+    m_map = nullptr;
+#else
+    m_file.clear();
+#endif
+    m_text.clear();
+    m_data = m_cells = nullptr;
+    m_size = m_length = m_period = 0;
+    m_packed = m_generated = false;
+  }
+
+  void map_file(const string& file_name)
+  {
+#if defined(_WIN32)
+    const int fd = _open(file_name.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+#endif
+    if (fd < 0) {
+      throw runtime_error("Cannot open " + file_name + " loss pattern file, abort");
+    }
+
+#if defined(_WIN32)
+    m_file.clear();
+    uint8_t block[1 << 16];
+    int bytes_read;
+    while ((bytes_read = _read(fd, block, sizeof(block))) > 0) {
+      m_file.insert(m_file.end(), block, block + bytes_read);
+    }
+    _close(fd);
+    m_size = m_file.size();
+    m_data = m_file.data();
+#else
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw runtime_error("Cannot read " + file_name + " loss pattern file, abort");
+    }
+    m_size = static_cast<uint64_t>(st.st_size);
+    if (m_size > 0) {
+      m_map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        ::close(fd);
+        throw runtime_error("Cannot map " + file_name + " loss pattern file, abort");
+      }
+      m_data = static_cast<const uint8_t*>(m_map);
+    }
+    ::close(fd);
+#endif
+  }
+
+public:
+  LossPattern()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_cells(nullptr)
+    , m_length(0)
+    , m_period(0)
+    , m_packed(false)
+    , m_generated(false)
+#if !defined(_WIN32)
+    , m_map(nullptr)
+#endif
+  {}
+
+  explicit LossPattern(const string& file_name) : LossPattern() { open(file_name); }
+
+  LossPattern(const LossPattern&) = delete;
+  LossPattern& operator=(const LossPattern&) = delete;
+
+  ~LossPattern() { release(); }
+
+  //! Magic number at the beginning of the packed loss pattern files
+  static const char* magic() { return "LOSSBIT1"; }
+
+  /*!
+   *
+   * \brief
+   * Maps a loss pattern file in memory, the format being recognised from its first bytes,
+   * or builds the loss generator given by its specification
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void open(const string& file_name)
+  {
+    release();
+
+    if (MarkovLossModel::is_spec(file_name)) {
+      m_model.parse(file_name);
+      m_generated = true;
+      m_length = m_period = UINT64_MAX;
+      return;
+    }
+
+    map_file(file_name);
+
+    if (m_size >= packed_header_size && memcmp(m_data, magic(), 8) == 0) {
+      m_packed = true;
+      m_cells = m_data + packed_header_size;
+      memcpy(&m_length, m_data + 8, sizeof(m_length));
+      if ((m_size - packed_header_size) * 8 < m_length) {
+        release();
+        throw runtime_error("Truncated packed loss pattern file " + file_name + ", abort");
+      }
+      m_period = m_length;
+    } else {
+      // The cells end at the first new line (or nul) character
+      m_cells = m_data;
+      m_period = m_size > 0 ? m_size - 1 : 0;
+      while (m_length < m_period && m_cells[m_length] != '\n' && m_cells[m_length] != '\0') {
+        m_length++;
+      }
+    }
+
+    if (m_length == 0) {
+      release();
+      throw runtime_error("Empty loss pattern file " + file_name + ", abort");
+    }
+  }
+
+  //! Uses the given '0' and '1' characters as the loss pattern, read in a circular fashion over their whole length
+  void assign(const string& cells)
+  {
+    release();
+
+    if (cells.empty()) {
+      throw runtime_error("Empty loss pattern, abort");
+    }
+
+    m_text = cells;
+    m_data = m_cells = reinterpret_cast<const uint8_t*>(m_text.data());
+    m_size = m_length = m_period = m_text.size();
+  }
+
+  bool is_packed() const { return m_packed; }
+  bool is_generated() const { return m_generated; }
+  const MarkovLossModel& get_model() const { return m_model; }
+  uint64_t get_length() const { return m_length; }
+  uint64_t get_period() const { return m_period; }
+
+  //! Cell of the loss pattern as an ASCII character, i.e. '0', '1' or any other character found in an ASCII file
+  char cell(uint64_t index) const
+  {
+    if (m_packed) {
+      return '0' + ((m_cells[index >> 3] >> (index & 7)) & 1);
+    }
+    return static_cast<char>(m_cells[index]);
+  }
+
+  /*!
+   *
+   * \brief
+   * Converts an ASCII loss pattern file into the packed format
+   *
+   * \author
+   * Matteo Naccari
+  */
+  static void pack(const string& ascii_file_name, const string& packed_file_name)
+  {
+    LossPattern ascii(ascii_file_name);
+
+    if (ascii.is_packed() || ascii.is_generated()) {
+      throw runtime_error(ascii_file_name + " is already a packed loss pattern file");
+    }
+    if (ascii.get_length() != ascii.get_period()) {
+      throw runtime_error(ascii_file_name + " must contain a single line of '0' and '1' characters");
+    }
+
+    const uint64_t length = ascii.get_length();
+    vector<uint8_t> bits((length + 7) / 8, 0);
+    for (uint64_t i = 0; i < length; i++) {
+      const char c = ascii.cell(i);
+      if (c != '0' && c != '1') {
+        throw runtime_error("Wrong character used in the error pattern file " + ascii_file_name + ": " + c);
+      }
+      bits[i >> 3] |= uint8_t(c - '0') << (i & 7);
+    }
+
+    ofstream ofs(packed_file_name, ios::binary);
+    if (!ofs) {
+      throw runtime_error("Cannot open " + packed_file_name + " loss pattern file, abort");
+    }
+    ofs.write(magic(), 8);
+    ofs.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    ofs.write(reinterpret_cast<const char*>(bits.data()), bits.size());
+    if (!ofs) {
+      throw runtime_error("Cannot write " + packed_file_name + " loss pattern file, abort");
+    }
+  }
+};
+
+/*!
+ *
+ * \brief
+ * Class modelling the position of one channel realization in a loss pattern. The loss pattern is read in a
+ * circular fashion from the starting offset by a modular index, hence the pattern is never rotated nor copied
+ * and any number of cursors can share it. The cursor of a generated pattern keeps the state of the Markov chain
+ * and starts at the position given by the offset of the chain starting in state 0
+ *
+ * \author
+ * Matteo Naccari
+*/
+class LossPatternCursor
+{
+  const LossPattern* m_pattern;
+  uint64_t m_start;     //! Index of the cell at the starting offset
+  uint64_t m_index;     //! Index of the current cell
+  uint64_t m_position;  //! Number of cells read since the start (or the last wrap)
+  uint32_t m_state;     //! State of the Markov chain of a generated pattern
+  uint64_t m_wraps;     //! Number of times the pattern has been read again from the start
+
+public:
+  LossPatternCursor() : m_pattern(nullptr), m_start(0), m_index(0), m_position(0), m_state(0), m_wraps(0) {}
+
+  //! The offset is reduced as the original rotation of the pattern did, i.e. negative offsets are taken modulo 2^64
+  LossPatternCursor(const LossPattern& pattern, int offset)
+    : m_pattern(&pattern)
+    , m_start(static_cast<uint64_t>(static_cast<int64_t>(offset)) % pattern.get_length())
+    , m_index(m_start)
+    , m_position(0)
+    , m_state(0)
+    , m_wraps(0)
+  {
+    if (pattern.is_generated() && pattern.get_model().get_num_states() > 1) {
+      // The state at the offset depends on the whole chain before it, the draws do not
+      const MarkovLossModel& model = pattern.get_model();
+      for (uint64_t i = 0; i < m_start; i++) {
+        m_state = model.next_state(m_state, model.draw(i));
+      }
+    }
+  }
+
+  //! Current cell, positions beyond the cells of an ASCII file (i.e. after a new line) hold a nul character
+  char get() const
+  {
+    if (m_pattern->is_generated()) {
+      const MarkovLossModel& model = m_pattern->get_model();
+      return model.is_lost(m_state, model.draw(m_index)) ? '1' : '0';
+    }
+    return m_position < m_pattern->get_length() ? m_pattern->cell(m_index) : '\0';
+  }
+
+  void advance()
+  {
+    if (m_pattern->is_generated()) {
+      const MarkovLossModel& model = m_pattern->get_model();
+      m_state = model.next_state(m_state, model.draw(m_index++));
+      return;
+    }
+    if (++m_index == m_pattern->get_length()) {
+      m_index = 0;
+    }
+    if (++m_position >= m_pattern->get_period()) {
+      // Mimics a circular buffer
+      m_position = 0;
+      m_index = m_start;
+      m_wraps++;
+    }
+  }
+
+  uint64_t get_position() const { return m_position; }
+
+  //! Index of the current cell in the pattern, i.e. in the sequence drawn for a generated one
+  uint64_t get_index() const { return m_index; }
+
+  //! Number of times the cells of an ASCII pattern have been read again from the starting offset
+  uint64_t get_wraps() const { return m_wraps; }
+};
+
+#endif // !H_LOSS_PATTERN_
@@ -0,0 +1,102 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_MEMORY_STREAMS_
+#define H_MEMORY_STREAMS_
+
+#include <streambuf>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+//! Reads up to size bytes of a bitstream in data, returning the number of bytes read (0 at the end of the bitstream)
+typedef function<size_t(uint8_t* data, size_t size)> BitstreamReader;
+
+/*!
+ *
+ * \brief
+ * Stream buffer which reads a bitstream held in memory by the caller, so that the packets can be read from it
+ * as from a file. The bytes are neither copied nor modified
+ *
+ * \author
+ * Matteo Naccari
+*/
+class SpanStreamBuffer : public streambuf
+{
+public:
+  SpanStreamBuffer(const uint8_t* data, size_t size)
+  {
+    char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+    setg(begin, begin, begin + size);
+  }
+};
+
+/*!
+ *
+ * \brief
+ * Stream buffer which reads a bitstream through a callback of the caller, e.g. a decoder harness producing
+ * the bitstream in memory, one block at a time
+ *
+ * \author
+ * Matteo Naccari
+*/
+class ReaderStreamBuffer : public streambuf
+{
+  BitstreamReader m_reader;
+  vector<char> m_block;
+
+protected:
+  int_type underflow() override
+  {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+    const size_t bytes_read = m_reader(reinterpret_cast<uint8_t*>(m_block.data()), m_block.size());
+    if (bytes_read == 0) {
+      return traits_type::eof();
+    }
+    setg(m_block.data(), m_block.data(), m_block.data() + bytes_read);
+    return traits_type::to_int_type(*gptr());
+  }
+
+public:
+  ReaderStreamBuffer(const BitstreamReader& reader, size_t block_size = 1 << 16) : m_reader(reader), m_block(block_size) {}
+};
+
+#endif // !H_MEMORY_STREAMS_
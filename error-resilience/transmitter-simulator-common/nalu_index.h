@@ -0,0 +1,206 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_NALU_INDEX_
+#define H_NALU_INDEX_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "stream_hash.h"
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Entry of the NALU index: position and classification of one NAL unit of the indexed bitstream
+ *
+ * \author
+ * Matteo Naccari
+*/
+struct NaluIndexEntry
+{
+  uint64_t offset;              //! Offset of the NALU payload (i.e. its first header byte) in the bitstream file
+  uint32_t len;                 //! Length of the NALU payload
+  uint8_t startcodeprefix_len;  //! Length of the Annex B start code (unused for RTP)
+  uint8_t nal_unit_type;
+  uint8_t slice_type;           //! Slice type associated with the NALU by the parser
+  uint8_t priority;             //! nal_ref_idc for H.264/AVC, TemporalId for H.265/HEVC
+};
+
+static_assert(sizeof(NaluIndexEntry) == 16, "NALU index entries are stored as 16 bytes");
+
+/*!
+ *
+ * \brief
+ * Class modelling the NALU index of a bitstream, i.e. the sidecar file which records the position and the
+ * classification of every NAL unit. A simulation over an indexed bitstream needs neither the start code
+ * scanning nor the parsing of the slice headers. The size and the hash of the bitstream are stored with the
+ * entries, so that an index which does not belong to the bitstream anymore is detected and rebuilt.
+ *
+ * \author
+ * Matteo Naccari
+*/
+class NaluIndex
+{
+  struct Header {
+    char magic[8];
+    uint32_t codec;
+    uint32_t packet_type;
+    uint64_t source_size;
+    uint64_t source_hash;
+    uint64_t num_entries;
+  };
+
+  static const char* magic() { return "NALUIDX1"; }
+
+public:
+  uint32_t codec = 0;           //! Codec of the indexed bitstream (1 = H.264/AVC, 2 = H.265/HEVC)
+  uint32_t packet_type = 0;     //! Packetization of the indexed bitstream (0 = RTP, 1 = Annex B)
+  uint64_t source_size = 0;
+  uint64_t source_hash = 0;
+  vector<NaluIndexEntry> entries;
+
+  //! Name of the index file associated with a bitstream
+  static string file_name(const string& bitstream_file_name) { return bitstream_file_name + ".nalidx"; }
+
+  //! Size and hash of a whole file, read in blocks
+  static void hash_file(const string& file_name, uint64_t& size, uint64_t& hash)
+  {
+    ifstream ifs(file_name, ios::binary);
+    if (!ifs) {
+      throw runtime_error("Cannot open " + file_name + " to compute its hash");
+    }
+
+    vector<char> block(1 << 22);
+    StreamHash h;
+    size = 0;
+    while (ifs) {
+      ifs.read(block.data(), block.size());
+      const size_t bytes_read = static_cast<size_t>(ifs.gcount());
+      h.update(reinterpret_cast<const uint8_t*>(block.data()), bytes_read);
+      size += bytes_read;
+    }
+    hash = h.digest();
+  }
+
+  /*!
+   *
+   * \brief
+   * Writes the index in a file
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void save(const string& file_name) const
+  {
+    ofstream ofs(file_name, ios::binary);
+    if (!ofs) {
+      throw runtime_error("Cannot open " + file_name + " NALU index file");
+    }
+
+    Header header;
+    memcpy(header.magic, magic(), 8);
+    header.codec = codec;
+    header.packet_type = packet_type;
+    header.source_size = source_size;
+    header.source_hash = source_hash;
+    header.num_entries = entries.size();
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(NaluIndexEntry));
+
+    if (!ofs) {
+      throw runtime_error("Cannot write " + file_name + " NALU index file");
+    }
+  }
+
+  /*!
+   *
+   * \brief
+   * Reads the index from a file
+   *
+   * \return
+   * False if the file does not exist or it is not a valid index
+   *
+   * \author
+   * Matteo Naccari
+  */
+  bool load(const string& file_name)
+  {
+    ifstream ifs(file_name, ios::binary);
+    if (!ifs) {
+      return false;
+    }
+
+    Header header;
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, magic(), 8) != 0) {
+      return false;
+    }
+
+    ifs.seekg(0, ios::end);
+    const uint64_t entries_size = static_cast<uint64_t>(ifs.tellg()) - sizeof(header);
+    if (entries_size != header.num_entries * sizeof(NaluIndexEntry)) {
+      return false;
+    }
+    ifs.seekg(sizeof(header), ios::beg);
+
+    entries.resize(header.num_entries);
+    if (!ifs.read(reinterpret_cast<char*>(entries.data()), entries_size)) {
+      return false;
+    }
+
+    codec = header.codec;
+    packet_type = header.packet_type;
+    source_size = header.source_size;
+    source_hash = header.source_hash;
+
+    return true;
+  }
+
+  //! True if the index describes the given bitstream, as found with the given codec and packetization
+  bool matches(uint32_t bitstream_codec, uint32_t bitstream_packet_type, uint64_t bitstream_size, uint64_t bitstream_hash) const
+  {
+    return codec == bitstream_codec && packet_type == bitstream_packet_type && source_size == bitstream_size && source_hash == bitstream_hash;
+  }
+};
+
+#endif // !H_NALU_INDEX_
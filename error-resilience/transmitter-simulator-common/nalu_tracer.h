@@ -0,0 +1,432 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_NALU_TRACER_
+#define H_NALU_TRACER_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+
+#if defined(SIMULATOR_TRACING) && defined(__linux__)
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define SIMULATOR_PERF_COUNTERS 1
+#endif
+
+using namespace std;
+
+//! True when the tracing of the NAL unit hot path is compiled in, i.e. SIMULATOR_TRACING is defined
+#if defined(SIMULATOR_TRACING)
+constexpr bool tracing_compiled_in = true;
+#else
+constexpr bool tracing_compiled_in = false;
+#endif
+
+//! Operations traced on every NAL unit
+enum class TraceName : uint8_t
+{
+  GET_PACKET,
+  PARSE,
+  WRITE_PACKET
+};
+
+#if defined(SIMULATOR_TRACING)
+
+//! One traced operation, as stored in the ring buffer of its thread
+struct TraceEvent
+{
+  uint64_t start_ns;      //! Start time since the tracing has been enabled
+  uint32_t duration_ns;
+  uint32_t size;          //! Length of the NAL unit
+  uint32_t cycles;        //! Hardware counters over the operation, zero when not available
+  uint32_t instructions;
+  uint32_t cache_misses;
+  TraceName name;
+  uint8_t nalu_type;      //! NAL unit type, 0xff when unknown (e.g. at the end of the bitstream)
+  uint16_t reserved;
+};
+
+static_assert(sizeof(TraceEvent) == 32, "Trace events are stored as 32 bytes");
+
+/*!
+ *
+ * \brief
+ * Trace of one thread: a ring buffer of events, which keeps the most recent ones when it is full, and the
+ * hardware counters of the thread (cycles, instructions and cache misses) read through perf_event_open on Linux
+ *
+ * \author
+ * Matteo Naccari
+*/
+class ThreadTrace
+{
+  vector<TraceEvent> m_events;
+  uint64_t m_num_events;  //! Events recorded since the last reset, the ring buffer holds the last m_events.size() ones
+  unsigned m_id;
+  int m_perf_fd;          //! Leader of the counter group, negative if the counters are not available
+  vector<int> m_perf_fds; //! Counters opened, the leader first
+
+#if defined(SIMULATOR_PERF_COUNTERS)
+  static int open_counter(uint64_t config, int group_fd)
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd < 0 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return int(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+  }
+#endif
+
+public:
+  ThreadTrace(unsigned id, size_t capacity, bool use_counters)
+    : m_events(capacity > 0 ? capacity : 1)
+    , m_num_events(0)
+    , m_id(id)
+    , m_perf_fd(-1)
+  {
+#if defined(SIMULATOR_PERF_COUNTERS)
+    if (use_counters) {
+      for (const uint64_t config : { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES }) {
+        const int fd = open_counter(config, m_perf_fds.empty() ? -1 : m_perf_fds[0]);
+        if (fd < 0) {
+          // Counters are either all available or not used at all (e.g. no PMU or perf_event_paranoid too strict)
+          close_counters();
+          return;
+        }
+        m_perf_fds.push_back(fd);
+      }
+      m_perf_fd = m_perf_fds[0];
+      ioctl(m_perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    (void)use_counters;
+#endif
+  }
+
+  ~ThreadTrace() { close_counters(); }
+
+  ThreadTrace(const ThreadTrace&) = delete;
+  ThreadTrace& operator=(const ThreadTrace&) = delete;
+
+  void close_counters()
+  {
+#if defined(SIMULATOR_PERF_COUNTERS)
+    for (const int fd : m_perf_fds) {
+      close(fd);
+    }
+#endif
+    m_perf_fds.clear();
+    m_perf_fd = -1;
+  }
+
+  unsigned get_id() const { return m_id; }
+  bool has_counters() const { return m_perf_fd >= 0; }
+
+  //! Reads cycles, instructions and cache misses of the calling thread, which must be the one of the trace
+  void read_counters(uint64_t counters[3]) const
+  {
+    counters[0] = counters[1] = counters[2] = 0;
+#if defined(SIMULATOR_PERF_COUNTERS)
+    if (m_perf_fd >= 0) {
+      uint64_t values[4];
+      if (read(m_perf_fd, values, sizeof(values)) == ssize_t(sizeof(values)) && values[0] == 3) {
+        counters[0] = values[1];
+        counters[1] = values[2];
+        counters[2] = values[3];
+      }
+    }
+#endif
+  }
+
+  void record(const TraceEvent& event)
+  {
+    m_events[m_num_events % m_events.size()] = event;
+    m_num_events++;
+  }
+
+  void reset() { m_num_events = 0; }
+
+  uint64_t get_num_events() const { return m_num_events; }
+
+  //! Events still held by the ring buffer, oldest first
+  vector<TraceEvent> get_events() const
+  {
+    const uint64_t kept = m_num_events < m_events.size() ? m_num_events : m_events.size();
+    vector<TraceEvent> events;
+    events.reserve(size_t(kept));
+    for (uint64_t e = m_num_events - kept; e < m_num_events; e++) {
+      events.push_back(m_events[e % m_events.size()]);
+    }
+    return events;
+  }
+};
+
+/*!
+ *
+ * \brief
+ * Process wide tracer of the NAL unit hot path. Once enabled, every thread which runs a TraceScope gets its own
+ * trace, hence recording an event takes no lock. The traces are written in the Chrome trace event format
+ * (chrome://tracing, Perfetto), one complete event per operation with the NAL unit type, its size and the
+ * hardware counters as arguments
+ *
+ * \author
+ * Matteo Naccari
+*/
+class Tracer
+{
+  atomic<bool> m_enabled;
+  atomic<unsigned> m_generation;  //! Incremented by every enable, so that threads look their trace up again
+  size_t m_capacity;
+  bool m_use_counters;
+  chrono::steady_clock::time_point m_origin;
+  mutable mutex m_mutex;
+  vector<unique_ptr<ThreadTrace>> m_threads;
+
+  Tracer() : m_enabled(false), m_generation(0), m_capacity(0), m_use_counters(false) {}
+
+  static const char* name_text(TraceName name)
+  {
+    const char* names[] = { "get_packet", "parse", "write_packet" };
+    return names[int(name)];
+  }
+
+public:
+  //! Default number of events kept per thread
+  static constexpr size_t default_capacity = 1 << 18;
+
+  static Tracer& instance()
+  {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  //! Starts tracing afresh: the traces recorded so far are dropped
+  void enable(size_t capacity = default_capacity, bool use_counters = true)
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_threads.clear();
+    m_capacity = capacity;
+    m_use_counters = use_counters;
+    m_origin = chrono::steady_clock::now();
+    m_generation++;
+    m_enabled = true;
+  }
+
+  void disable() { m_enabled = false; }
+
+  bool is_enabled() const { return m_enabled.load(memory_order_relaxed); }
+
+  uint64_t now_ns() const
+  {
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_origin).count());
+  }
+
+  //! Trace of the calling thread, created on its first event
+  ThreadTrace& thread_trace()
+  {
+    thread_local ThreadTrace* trace = nullptr;
+    thread_local unsigned generation = 0;
+
+    if (!trace || generation != m_generation) {
+      lock_guard<mutex> lock(m_mutex);
+      m_threads.push_back(unique_ptr<ThreadTrace>(new ThreadTrace(unsigned(m_threads.size()), m_capacity, m_use_counters)));
+      trace = m_threads.back().get();
+      generation = m_generation;
+    }
+    return *trace;
+  }
+
+  //! Number of events recorded by all the threads, including the ones the ring buffers do not hold anymore
+  uint64_t get_num_events() const
+  {
+    lock_guard<mutex> lock(m_mutex);
+    uint64_t num_events = 0;
+    for (const auto& thread : m_threads) {
+      num_events += thread->get_num_events();
+    }
+    return num_events;
+  }
+
+  /*!
+   *
+   * \brief
+   * Writes the events held by the ring buffers in the Chrome trace event format. The threads must not be recording
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void write_chrome_trace(ostream& os) const
+  {
+    lock_guard<mutex> lock(m_mutex);
+    const char* separator = "\n";
+    char number[32];
+
+    os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    for (const auto& thread : m_threads) {
+      for (const auto& event : thread->get_events()) {
+        snprintf(number, sizeof(number), "%.3f", event.start_ns / 1e3);
+        os << separator << "{\"name\": \"" << name_text(event.name) << "\", \"cat\": \"nalu\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->get_id()
+           << ", \"ts\": " << number;
+        snprintf(number, sizeof(number), "%.3f", event.duration_ns / 1e3);
+        os << ", \"dur\": " << number << ", \"args\": {\"nal_unit_type\": " << int(event.nalu_type) << ", \"size\": " << event.size;
+        if (thread->has_counters()) {
+          os << ", \"cycles\": " << event.cycles << ", \"instructions\": " << event.instructions << ", \"cache_misses\": " << event.cache_misses;
+        }
+        os << "}}";
+        separator = ",\n";
+      }
+    }
+    os << "\n]}\n";
+  }
+};
+
+/*!
+ *
+ * \brief
+ * Traces one operation on a NAL unit, from its construction to its stop (or destruction), in the trace of the
+ * calling thread. The NAL unit can be given at any time before the stop, e.g. once it has been read
+ *
+ * \author
+ * Matteo Naccari
+*/
+class TraceScope
+{
+  ThreadTrace* m_trace;  //! Null when the tracing is disabled
+  TraceEvent m_event;
+  uint64_t m_counters[3];
+
+public:
+  explicit TraceScope(TraceName name)
+    : m_trace(nullptr)
+  {
+    Tracer& tracer = Tracer::instance();
+    if (tracer.is_enabled()) {
+      m_trace = &tracer.thread_trace();
+      m_event.name = name;
+      m_event.nalu_type = 0xff;
+      m_event.size = 0;
+      m_event.reserved = 0;
+      m_trace->read_counters(m_counters);
+      m_event.start_ns = tracer.now_ns();
+    }
+  }
+
+  TraceScope(TraceName name, int nalu_type, uint32_t size)
+    : TraceScope(name)
+  {
+    set_nalu(nalu_type, size);
+  }
+
+  ~TraceScope() { stop(); }
+
+  void set_nalu(int nalu_type, uint32_t size)
+  {
+    m_event.nalu_type = uint8_t(nalu_type);
+    m_event.size = size;
+  }
+
+  void stop()
+  {
+    if (m_trace) {
+      const uint64_t end = Tracer::instance().now_ns();
+      uint64_t counters[3];
+      m_trace->read_counters(counters);
+      const uint64_t duration = end - m_event.start_ns;
+      m_event.duration_ns = duration > UINT32_MAX ? UINT32_MAX : uint32_t(duration);
+      m_event.cycles = uint32_t(counters[0] - m_counters[0]);
+      m_event.instructions = uint32_t(counters[1] - m_counters[1]);
+      m_event.cache_misses = uint32_t(counters[2] - m_counters[2]);
+      m_trace->record(m_event);
+      m_trace = nullptr;
+    }
+  }
+};
+
+#else
+
+/*!
+ *
+ * \brief
+ * Tracer compiled out: nothing is recorded and the scopes are empty, hence the compiler removes them altogether
+ *
+ * \author
+ * Matteo Naccari
+*/
+class Tracer
+{
+public:
+  static constexpr size_t default_capacity = 0;
+
+  static Tracer& instance()
+  {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  void enable(size_t = default_capacity, bool = true) {}
+  void disable() {}
+  bool is_enabled() const { return false; }
+  uint64_t get_num_events() const { return 0; }
+  void write_chrome_trace(ostream&) const {}
+};
+
+class TraceScope
+{
+public:
+  explicit TraceScope(TraceName) {}
+  TraceScope(TraceName, int, uint32_t) {}
+  void set_nalu(int, uint32_t) {}
+  void stop() {}
+};
+
+#endif
+
+#endif // !H_NALU_TRACER_
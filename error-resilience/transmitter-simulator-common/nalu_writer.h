@@ -0,0 +1,448 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_NALU_WRITER_
+#define H_NALU_WRITER_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include "standard_streams.h"
+#include "io_uring_writer.h"
+#include "range_copier.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+using namespace std;
+
+//! Default number of bytes gathered in memory before the writer hands them over to the operating system
+constexpr size_t nalu_writer_flush_threshold = 1 << 20;
+
+//! Receives the transmitted bitstream in memory, one packet (i.e. the start code or the RTP dump header followed
+//! by the NALU) per call
+typedef function<void(const uint8_t* data, size_t len)> PacketSink;
+
+/*!
+ *
+ * \brief
+ * Class modelling a buffered writer for the transmitted bitstream.
+ * Each packet is given as a (small) header, i.e. the start code or the RTP dump header, and a payload.
+ * Packets are gathered into one memory buffer which is written when it holds flush_threshold bytes, when
+ * flush() is called or when the file is closed. A packet which does not fit in the buffer is written
+ * together with the bytes buffered so far by a single vectored write, so that large payloads are never copied.
+ * A writer opened on an IoUringWriter gathers the packets in the buffers of the ring instead, and queues every
+ * full buffer as an asynchronous write. Packets can also be given as byte ranges of a source file, which are
+ * coalesced while they follow each other in the source and copied by the kernel with a RangeCopier.
+ * A writer opened on a PacketSink hands every packet over to it as a contiguous block, rather than to a file.
+ *
+ * \author
+ * Matteo Naccari
+*/
+class NaluWriter
+{
+  int m_fd;
+  bool m_owns_fd;
+  vector<uint8_t> m_buffer;
+  size_t m_used;
+  size_t m_flush_threshold;
+  uint64_t m_bytes_written;
+  uint64_t m_num_writes;  //! Number of write system calls issued (or writes queued on the ring) so far
+  IoUringWriter* m_ring;  //! Ring the writes are queued on, null for the portable path
+  int m_ring_file;        //! Identifier of the file in m_ring
+  uint8_t* m_ring_data;   //! Buffer of m_ring being filled, null if none is taken
+  unsigned m_ring_buffer;
+  RangeCopier* m_source;  //! Copier of the source file the ranges are taken from, null if none is set
+  uint64_t m_range_offset;
+  uint64_t m_range_len;   //! Length of the range of the source file not copied yet
+  PacketSink m_sink;      //! Receiver of the packets written in memory, empty if the writer writes a file
+
+  struct Chunk {
+    const uint8_t* data;
+    size_t len;
+  };
+
+  /*!
+   *
+   * \brief
+   * Writes all the given chunks to the file, resuming after partial writes
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void write_chunks(Chunk* chunks, int num_chunks)
+  {
+    int first = 0;
+
+    while (first < num_chunks) {
+      if (chunks[first].len == 0) {
+        first++;
+        continue;
+      }
+
+#if defined(_WIN32)
+      const unsigned int request = chunks[first].len > (1u << 30) ? (1u << 30) : static_cast<unsigned int>(chunks[first].len);
+      const int64_t done = _write(m_fd, chunks[first].data, request);
+#else
+      iovec iov[4];
+      int num_iov = 0;
+      for (int i = first; i < num_chunks && num_iov < 4; i++) {
+        iov[num_iov].iov_base = const_cast<uint8_t*>(chunks[i].data);
+        iov[num_iov].iov_len = chunks[i].len;
+        num_iov++;
+      }
+      const int64_t done = writev(m_fd, iov, num_iov);
+#endif
+      m_num_writes++;
+
+      if (done < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw runtime_error("Cannot write the transmitted bitstream: " + string(strerror(errno)));
+      }
+
+      m_bytes_written += done;
+
+      size_t left = static_cast<size_t>(done);
+      while (first < num_chunks && left >= chunks[first].len) {
+        left -= chunks[first].len;
+        first++;
+      }
+      if (first < num_chunks) {
+        chunks[first].data += left;
+        chunks[first].len -= left;
+      }
+    }
+  }
+
+  void release()
+  {
+    if (m_owns_fd) {
+#if defined(_WIN32)
+      _close(m_fd);
+#else
+      ::close(m_fd);
+#endif
+    }
+    m_fd = -1;
+    m_owns_fd = false;
+    m_used = 0;
+    m_range_len = 0;
+  }
+
+  //! Copies the pending range of the source file
+  void flush_range()
+  {
+    if (m_range_len > 0) {
+      const uint64_t num_calls = m_source->get_num_calls();
+      const uint64_t len = m_range_len;
+      m_range_len = 0;
+      m_source->copy(m_fd, m_range_offset, len);
+      m_bytes_written += len;
+      m_num_writes += m_source->get_num_calls() - num_calls;
+    }
+  }
+
+  //! Copies the data in the buffers of the ring, queuing the ones which get full
+  void write_ring(const uint8_t* data, size_t len)
+  {
+    const size_t buffer_size = m_ring->get_buffer_size();
+
+    while (len > 0) {
+      if (!m_ring_data) {
+        m_ring_data = m_ring->acquire_buffer(m_ring_buffer);
+      }
+      const size_t bytes = len < buffer_size - m_used ? len : buffer_size - m_used;
+      memcpy(m_ring_data + m_used, data, bytes);
+      m_used += bytes;
+      data += bytes;
+      len -= bytes;
+      if (m_used == buffer_size) {
+        flush();
+      }
+    }
+  }
+
+public:
+  NaluWriter(size_t flush_threshold = nalu_writer_flush_threshold)
+    : m_fd(-1)
+    , m_owns_fd(false)
+    , m_used(0)
+    , m_flush_threshold(flush_threshold)
+    , m_bytes_written(0)
+    , m_num_writes(0)
+    , m_ring(nullptr)
+    , m_ring_file(-1)
+    , m_ring_data(nullptr)
+    , m_ring_buffer(0)
+    , m_source(nullptr)
+    , m_range_offset(0)
+    , m_range_len(0)
+  {}
+
+  NaluWriter(const NaluWriter&) = delete;
+  NaluWriter& operator=(const NaluWriter&) = delete;
+
+  ~NaluWriter()
+  {
+    try {
+      close();
+    } catch (...) {
+      // Errors are reported by explicit calls to close()
+    }
+  }
+
+  //! Creates (or truncates) the given file and binds the writer to it. The file name "-" binds the writer to the
+  //! standard output, which is never closed by the writer
+  void open(const string& file_name)
+  {
+    if (is_standard_stream(file_name)) {
+      attach(binary_stdout_fd());
+      return;
+    }
+
+    close();
+#if defined(_WIN32)
+    m_fd = _open(file_name.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (m_fd < 0) {
+      throw runtime_error("Cannot open " + file_name + " transmitted bitstream, abort");
+    }
+    m_owns_fd = true;
+  }
+
+  //! Creates (or truncates) the given file and binds the writer to it through the given ring, which must be
+  //! drained before the file is known to be written. The standard output is written with the portable path
+  void open(const string& file_name, IoUringWriter& ring)
+  {
+    if (is_standard_stream(file_name)) {
+      open(file_name);
+      return;
+    }
+
+    close();
+    m_ring_file = ring.open(file_name);
+    m_ring = &ring;
+  }
+
+  //! Binds the writer to the given sink, which receives every packet as soon as it is written
+  void open(const PacketSink& sink)
+  {
+    close();
+    m_sink = sink;
+  }
+
+  //! Binds the writer to a file descriptor opened by the caller, which stays in charge of closing it
+  void attach(int fd)
+  {
+    close();
+    m_fd = fd;
+    m_owns_fd = false;
+  }
+
+  bool is_open() const { return m_fd >= 0 || m_ring || m_sink; }
+
+  //! Sets the copier of the file the ranges given to copy() are taken from, which must outlive the writes
+  void set_source(RangeCopier* source) { m_source = source; }
+
+  void set_flush_threshold(size_t flush_threshold) { m_flush_threshold = flush_threshold; }
+  size_t get_flush_threshold() const { return m_flush_threshold; }
+
+  //! Bytes handed over to the operating system so far
+  uint64_t get_bytes_written() const { return m_bytes_written; }
+  uint64_t get_num_writes() const { return m_num_writes; }
+
+  /*!
+   *
+   * \brief
+   * Appends one packet, made of a header followed by a payload, to the output
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void write(const uint8_t* header, size_t header_len, const uint8_t* payload, size_t payload_len)
+  {
+    if (m_sink) {
+      if (m_buffer.size() < header_len + payload_len) {
+        m_buffer.resize(header_len + payload_len);
+      }
+      if (header_len > 0) {
+        memcpy(m_buffer.data(), header, header_len);
+      }
+      if (payload_len > 0) {
+        memcpy(m_buffer.data() + header_len, payload, payload_len);
+      }
+      m_sink(m_buffer.data(), header_len + payload_len);
+      m_bytes_written += header_len + payload_len;
+      return;
+    }
+
+    if (m_ring) {
+      write_ring(header, header_len);
+      write_ring(payload, payload_len);
+      return;
+    }
+
+    if (m_fd < 0) {
+      throw logic_error("NaluWriter: no file to write to");
+    }
+
+    flush_range();
+
+    if (m_used + header_len + payload_len <= m_flush_threshold) {
+      if (m_buffer.size() < m_flush_threshold) {
+        m_buffer.resize(m_flush_threshold);
+      }
+      if (header_len > 0) {
+        memcpy(m_buffer.data() + m_used, header, header_len);
+        m_used += header_len;
+      }
+      if (payload_len > 0) {
+        memcpy(m_buffer.data() + m_used, payload, payload_len);
+        m_used += payload_len;
+      }
+      if (m_used == m_flush_threshold) {
+        flush();
+      }
+      return;
+    }
+
+    Chunk chunks[3] = { { m_buffer.data(), m_used }, { header, header_len }, { payload, payload_len } };
+    m_used = 0;
+    write_chunks(chunks, 3);
+  }
+
+  void write(const uint8_t* data, size_t len) { write(data, len, nullptr, 0); }
+
+  /*!
+   *
+   * \brief
+   * Appends len bytes of the source file, starting at offset, to the output. A range which starts where the
+   * pending one ends extends it, so that the consecutive packets of the source are copied by a single request
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void copy(uint64_t offset, uint64_t len)
+  {
+    if (!m_source || m_ring || m_fd < 0) {
+      throw logic_error("NaluWriter: no source file or no file to copy to");
+    }
+
+    if (m_range_len > 0 && offset == m_range_offset + m_range_len) {
+      m_range_len += len;
+      return;
+    }
+
+    flush();
+    m_range_offset = offset;
+    m_range_len = len;
+  }
+
+  //! Writes the bytes buffered so far and copies the pending range of the source file
+  void flush()
+  {
+    if (m_ring) {
+      if (m_used > 0) {
+        m_ring->write(m_ring_file, m_ring_buffer, m_used);
+        m_bytes_written += m_used;
+        m_num_writes++;
+        m_ring_data = nullptr;
+        m_used = 0;
+      }
+      return;
+    }
+
+    if (m_used > 0) {
+      Chunk chunk = { m_buffer.data(), m_used };
+      m_used = 0;
+      write_chunks(&chunk, 1);
+    }
+    flush_range();
+  }
+
+  //! Flushes the buffered bytes and releases the file
+  void close()
+  {
+    if (m_sink) {
+      m_sink = nullptr;
+      return;
+    }
+
+    if (m_ring) {
+      IoUringWriter* ring = m_ring;
+      m_ring = nullptr;
+      if (m_used > 0) {
+        ring->write(m_ring_file, m_ring_buffer, m_used);
+        m_bytes_written += m_used;
+        m_num_writes++;
+      } else if (m_ring_data) {
+        ring->release_buffer(m_ring_buffer);
+      }
+      m_ring_data = nullptr;
+      m_used = 0;
+      ring->close(m_ring_file);
+      return;
+    }
+
+    if (m_fd < 0) {
+      return;
+    }
+    try {
+      flush();
+    } catch (...) {
+      release();
+      throw;
+    }
+    release();
+  }
+};
+
+#endif // !H_NALU_WRITER_
@@ -0,0 +1,450 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+#include "parameters_base.h"
+#include "nalu_writer.h"
+#include "nalu_tracer.h"
+#include <regex>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <set>
+#include <limits>
+
+/*!
+ *
+ * \brief
+ * Splits a comma separated list into its items
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+static vector<string> split_list(const string& value)
+{
+  vector<string> items;
+  size_t start = 0;
+
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    if (end == string::npos) {
+      end = value.size();
+    }
+    items.push_back(value.substr(start, end - start));
+    start = end + 1;
+  }
+
+  return items;
+}
+
+/*!
+ *
+ * \brief
+ * Drops the repeated items of a list, keeping the first occurrence of each one in its place
+ *
+ * \return
+ * True if any item has been dropped
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class T>
+static bool drop_repeated(vector<T>& items)
+{
+  vector<T> unique_items;
+  set<T> seen;
+
+  for (const auto& item : items) {
+    if (seen.insert(item).second) {
+      unique_items.push_back(item);
+    }
+  }
+
+  const bool dropped = unique_items.size() != items.size();
+  items.swap(unique_items);
+  return dropped;
+}
+
+/*!
+ *
+ * \brief
+ * Converts the value of an option into a non-negative integer, rejecting signs, spaces, any other character
+ * and the values larger than max_value
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+static unsigned long long to_non_negative(const string& name, const string& value, unsigned long long max_value)
+{
+  unsigned long long number = 0;
+
+  if (value.empty() || value.find_first_not_of("0123456789") != string::npos) {
+    throw logic_error("Option " + name + " requires a non-negative integer");
+  }
+  try {
+    number = stoull(value);
+  } catch (out_of_range&) {
+    throw logic_error("Option " + name + " requires a non-negative integer");
+  }
+  if (number > max_value) {
+    throw logic_error("Option " + name + " requires a non-negative integer up to " + to_string(max_value));
+  }
+  return number;
+}
+
+// Definition of the constant bound to references
+constexpr size_t ParametersBase::max_num_offsets;
+
+/*!
+ *
+ * \brief
+ * Constructor which sets the options to their default values
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+ParametersBase::ParametersBase()
+  : m_modality(0)
+  , m_offset(0)
+  , m_flush_size(nalu_writer_flush_threshold)
+  , m_jobs(1)
+  , m_use_index(false)
+  , m_use_pipeline(false)
+  , m_use_io_uring(false)
+  , m_use_copy_ranges(false)
+  , m_dedupe(DedupeMode::OFF)
+{
+}
+
+/*!
+ *
+ * \brief
+ * Reads the configuration file. The options are set as they are found, the mandatory parameters are left to the
+ * codec class, which knows their order
+ *
+ * \param
+ * file_name, name of the configuration file
+ *
+ * \return
+ * The valid lines which are not options, in the order they appear in the file
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+vector<string> ParametersBase::read_config_file(const char* file_name)
+{
+  string line;
+  vector<string> lines;
+  ifstream fin;
+  regex pattern_str("\\S+");
+
+  fin.open(file_name, ifstream::in);
+
+  if (!fin) {
+    throw runtime_error("Cannot open config file " + string(file_name) + " abort");
+  }
+
+  while (getline(fin, line, '\n')) {
+    if (valid_line(line) && is_option(line.c_str())) {
+      // Options can be given in any place of the file, one per line: --name value, everything after the # is ignored
+      line = line.substr(0, line.find('#'));
+      sregex_iterator token(line.begin(), line.end(), pattern_str);
+      const string name = (*token++)[0];
+      set_option(name, token != sregex_iterator() ? string((*token)[0]) : string());
+    } else if (valid_line(line)) {
+      lines.push_back(line);
+    }
+  }
+
+  return lines;
+}
+
+/*!
+ *
+ * \brief
+ * Extracts the value of a mandatory parameter from a line of the configuration file: the first word for
+ * the strings, the first integer for the numbers
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+string ParametersBase::config_string(const string& line)
+{
+  regex pattern_str("[^ ]+");
+  smatch match;
+
+  regex_search(line, match, pattern_str);
+  return match[0];
+}
+
+int ParametersBase::config_number(const string& line)
+{
+  regex pattern_nr("[+-]?[0-9]+");
+  smatch match;
+
+  regex_search(line, match, pattern_nr);
+  return stoi(match[0]);
+}
+
+/*!
+ *
+ * \brief
+ * Parses the options given on the command line after the mandatory parameters.
+ * Each option is a name starting with -- followed by its value
+ *
+ * \param
+ * argc, number of command line arguments
+ * argv, 2D array of char
+ * first, index of the first option in argv
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+void ParametersBase::parse_options(int argc, const char** argv, int first)
+{
+  for (int i = first; i < argc; i++) {
+    if (!is_option(argv[i])) {
+      throw logic_error("Unexpected command line argument: " + string(argv[i]));
+    }
+    const string name = argv[i];
+    const string value = i + 1 < argc && !is_option(argv[i + 1]) ? argv[++i] : "";
+    set_option(name, value);
+  }
+  check_parameters();
+}
+
+/*!
+ *
+ * \brief
+ * Sets the value of one option
+ *
+ * \param
+ * name, option name including the leading --
+ * value, option value (empty if none was given)
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+void ParametersBase::set_option(const string& name, const string& value)
+{
+  if (value.empty()) {
+    throw logic_error("Option " + name + " requires a value");
+  }
+
+  if (name == "--flush-size") {
+    m_flush_size = size_t(to_non_negative(name, value, numeric_limits<size_t>::max()));
+  } else if (name == "--offsets") {
+    // Comma separated list of offsets or ranges first:last[:step]
+    m_offsets.clear();
+    regex pattern_range("([+-]?[0-9]+)(:([+-]?[0-9]+)(:([0-9]+))?)?");
+    smatch match;
+    for (const auto& item : split_list(value)) {
+      if (!regex_match(item, match, pattern_range)) {
+        throw logic_error("Wrong offset list: " + value);
+      }
+      int first, last, step;
+      try {
+        first = stoi(match[1]);
+        last = match[3].matched ? stoi(match[3]) : first;
+        step = match[5].matched ? stoi(match[5]) : 1;
+      } catch (out_of_range&) {
+        throw logic_error("Offset out of range in the offset list: " + value);
+      }
+      if (step <= 0) {
+        throw logic_error("Wrong offset list: " + value);
+      }
+      // The number of offsets is computed in 64 bits, so that neither it nor the last offset can wrap around
+      const int64_t count = last < first ? 0 : (int64_t(last) - first) / step + 1;
+      if (int64_t(m_offsets.size()) + count > int64_t(max_num_offsets)) {
+        throw logic_error("The offset list " + value + " has more than " + to_string(max_num_offsets) + " offsets");
+      }
+      for (int64_t i = 0; i < count; i++) {
+        m_offsets.push_back(int(first + i * step));
+      }
+    }
+  } else if (name == "--patterns") {
+    // Comma separated list of loss pattern files
+    m_loss_pattern_files = split_list(value);
+  } else if (name == "--modalities") {
+    // Comma separated list of corruption modalities
+    m_modalities.clear();
+    for (const auto& item : split_list(value)) {
+      m_modalities.push_back(int(to_non_negative(name, item, numeric_limits<int>::max())));
+    }
+  } else if (name == "--jobs") {
+    m_jobs = unsigned(to_non_negative(name, value, numeric_limits<unsigned>::max()));
+  } else if (name == "--index") {
+    if (value != "on" && value != "off") {
+      throw logic_error("Option --index must be either on or off");
+    }
+    m_use_index = value == "on";
+  } else if (name == "--pipeline") {
+    if (value != "on" && value != "off") {
+      throw logic_error("Option --pipeline must be either on or off");
+    }
+    m_use_pipeline = value == "on";
+  } else if (name == "--io-uring") {
+    if (value != "on" && value != "off") {
+      throw logic_error("Option --io-uring must be either on or off");
+    }
+    m_use_io_uring = value == "on";
+  } else if (name == "--copy-ranges") {
+    if (value != "on" && value != "off") {
+      throw logic_error("Option --copy-ranges must be either on or off");
+    }
+    m_use_copy_ranges = value == "on";
+  } else if (name == "--stats") {
+    m_stats_file = value;
+  } else if (name == "--trace") {
+    m_trace_file = value;
+  } else if (name == "--dedupe") {
+    if (value != "off" && value != "link" && value != "manifest") {
+      throw logic_error("Option --dedupe must be one of off, link or manifest");
+    }
+    m_dedupe = value == "link" ? DedupeMode::LINK : value == "manifest" ? DedupeMode::MANIFEST : DedupeMode::OFF;
+  } else {
+    throw logic_error("Unknown option: " + name);
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Reads a valid line from the configuration file. A valid line is a text line
+ * that does not start with the following characters: #, carriage return, space or
+ * new line
+ *
+ * \param
+ * line a char array containing the current line read from the configuration file
+ *
+ * \return
+ * True if the current line is a valid line
+ * False otherwise
+ *
+ * \author
+ * Matteo Naccari
+*/
+
+bool ParametersBase::valid_line(const string& line)
+{
+  if (line.length() == 0 || line.at(0) == '\r' || line.at(0) == '#' || line.at(0) == ' ' || line.at(0) == '\n') {
+    return 0;
+  }
+  return 1;
+}
+
+/*!
+ *
+ * \brief
+ * Checks the compliance of the input parameters. A fault tolerant policy is adopted, i.e. only warnings are issued and the default values
+ * are set accordingly. Only the options which cannot work with the standard input or output are rejected
+ *
+ * \author
+ * Matteo Naccari
+*/
+void ParametersBase::check_parameters()
+{
+  for (auto& offset : m_offsets) {
+    if (offset < 0) {
+      cerr << "Warning! Offset = " << offset << " is not allowed, set it to zero\n";
+      offset = 0;
+    }
+  }
+  if (m_offset < 0) {
+    cerr << "Warning! Offset = " << m_offset << " is not allowed, set it to zero\n";
+    m_offset = 0;
+  }
+  for (auto& modality : m_modalities) {
+    if (!(0 <= modality && modality <= 2)) {
+      cerr << "Warning! Modality = " << modality << " is not allowed, set it to zero\n";
+      modality = 0;
+    }
+  }
+  if (!(0 <= m_modality && m_modality <= 2)) {
+    cerr << "Warning! Modality = " << m_modality << " is not allowed, set it to zero\n";
+    m_modality = 0;
+  }
+
+  // Each realization writes its own bitstream, hence a realization given twice would be written twice over the same file
+  const bool repeated_offsets = drop_repeated(m_offsets);
+  const bool repeated_patterns = drop_repeated(m_loss_pattern_files);
+  const bool repeated_modalities = drop_repeated(m_modalities);
+  if (repeated_offsets || repeated_patterns || repeated_modalities) {
+    cerr << "Warning! Repeated offsets, loss pattern files or modalities are simulated once\n";
+  }
+
+  // A bitstream read from a pipe can be neither hashed for the NALU index nor read again, and the standard output
+  // can carry the transmitted bitstream of a single realization only
+  if (is_standard_stream(m_bitstream_original) && m_use_index) {
+    throw logic_error("The NALU index cannot be used with a bitstream read from the standard input");
+  }
+  if (is_standard_stream(m_bitstream_transmitted) && is_batch()) {
+    throw logic_error("The batch mode cannot write the transmitted bitstreams to the standard output");
+  }
+
+  // The batch mode and the NALU index read the NAL units from memory, i.e. there is no bitstream to pipeline
+  if (m_use_pipeline && (is_batch() || m_use_index)) {
+    cerr << "Warning! Option --pipeline is only used by a single run without the NALU index, ignored\n";
+    m_use_pipeline = false;
+  }
+
+  // Byte ranges are copied from a file by the calling thread, straight to the transmitted bitstream
+  if (m_use_copy_ranges && is_standard_stream(m_bitstream_original)) {
+    throw logic_error("Byte ranges cannot be copied from a bitstream read from the standard input");
+  }
+  if (m_use_copy_ranges && (m_use_pipeline || m_use_io_uring)) {
+    throw logic_error("Option --copy-ranges cannot be combined with --pipeline or --io-uring");
+  }
+  if (is_standard_stream(m_stats_file) && is_standard_stream(m_bitstream_transmitted)) {
+    throw logic_error("The statistics and the transmitted bitstream cannot be both written to the standard output");
+  }
+  if (!m_trace_file.empty() && !tracing_compiled_in) {
+    throw logic_error("Option --trace requires the simulator to be built with SIMULATOR_TRACING");
+  }
+  if (m_dedupe != DedupeMode::OFF && !is_batch()) {
+    cerr << "Warning! Option --dedupe is only used in batch mode, ignored\n";
+    m_dedupe = DedupeMode::OFF;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+#ifndef H_PARAMETERS_BASE_
+#define H_PARAMETERS_BASE_
+
+#include <string>
+#include <cstddef>
+#include <vector>
+#include "realization_dedupe.h"
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Models the parameters related to the transmission conditions which are shared by the AVC and HEVC simulators:
+ * the bitstreams, the loss pattern, the starting offset, the corruption modality and all the options.
+ * Each simulator derives its own Parameters class, which only knows the layout of its command line and
+ * configuration file (e.g. whether a packet type is given) and the parameters specific to its codec
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+
+class ParametersBase
+{
+
+protected:
+  string m_bitstream_original, m_bitstream_transmitted, m_loss_pattern_file;
+  int m_modality, m_offset;
+  size_t m_flush_size;
+  vector<int> m_offsets;                //! Offsets of the batch mode realizations
+  vector<string> m_loss_pattern_files;  //! Loss pattern files of the batch mode realizations
+  vector<int> m_modalities;             //! Corruption modalities of the batch mode realizations
+  unsigned m_jobs;                      //! Number of realizations simulated in parallel
+  bool m_use_index;                     //! Whether the NALU index of the input bitstream is used
+  bool m_use_pipeline;                  //! Whether reading, parsing and writing overlap in a single run
+  bool m_use_io_uring;                  //! Whether the realizations are written through io_uring, where available
+  bool m_use_copy_ranges;               //! Whether the NAL units transmitted are copied from the input by the kernel
+  string m_stats_file;                  //! File the statistics of the run are written to as JSON, empty if not requested
+  string m_trace_file;                  //! File the trace of the NAL unit hot path is written to, empty if not requested
+  DedupeMode m_dedupe;                  //! How the realizations transmitting the same NAL units are written
+  bool valid_line(const string& line);
+  void set_option(const string& name, const string& value);
+  void check_parameters();
+
+  //! Sets the options to their default values, the mandatory parameters are set by the codec class
+  ParametersBase();
+  ~ParametersBase() {}
+
+  //! Reads the configuration file: the options are set as they are found (one per line, in any place) and the
+  //! other valid lines, which carry the mandatory parameters, are returned in order
+  vector<string> read_config_file(const char* file_name);
+
+  //! Value of a mandatory parameter given on a line of the configuration file, as a string or as a number
+  static string config_string(const string& line);
+  static int config_number(const string& line);
+
+public:
+  //! Largest number of offsets of the batch mode, which bounds the memory taken by the offset list
+  static constexpr size_t max_num_offsets = size_t(1) << 20;
+
+  //! Parses the options (i.e. --name value pairs) which follow the mandatory parameters on the command line
+  void parse_options(int argc, const char** argv, int first);
+
+  //! True if the command line argument is an option name
+  static bool is_option(const char* arg) { return arg[0] == '-' && arg[1] == '-'; }
+
+  const string& get_bitstream_original_filename() const { return m_bitstream_original; }
+  const string& get_bitstream_transmitted_filename() const { return m_bitstream_transmitted; }
+  const string& get_loss_pattern_filename() const { return m_loss_pattern_file; }
+  int get_modality() const { return m_modality; }
+  int get_offset() const { return m_offset; }
+  size_t get_flush_size() const { return m_flush_size; }
+
+  //! True when several realizations are requested, i.e. a list of offsets, loss pattern files or modalities has been given
+  bool is_batch() const { return !m_offsets.empty() || !m_loss_pattern_files.empty() || !m_modalities.empty(); }
+
+  //! Offsets to be simulated: the ones given with --offsets or the single offset of the mandatory parameters
+  vector<int> get_offsets() const { return m_offsets.empty() ? vector<int>(1, m_offset) : m_offsets; }
+
+  //! Loss pattern files to be simulated: the ones given with --patterns or the single file of the mandatory parameters
+  vector<string> get_loss_pattern_files() const { return m_loss_pattern_files.empty() ? vector<string>(1, m_loss_pattern_file) : m_loss_pattern_files; }
+
+  //! Corruption modalities to be simulated: the ones given with --modalities or the single modality of the mandatory parameters
+  vector<int> get_modalities() const { return m_modalities.empty() ? vector<int>(1, m_modality) : m_modalities; }
+  bool has_modality_list() const { return !m_modalities.empty(); }
+
+  //! Number of realizations simulated in parallel, zero meaning one per hardware thread
+  unsigned get_jobs() const { return m_jobs; }
+
+  //! True if the NALU index of the input bitstream has to be used (and built when missing or stale)
+  bool get_use_index() const { return m_use_index; }
+
+  //! True if a single run has to read, classify and write the NAL units in three concurrent stages
+  bool get_use_pipeline() const { return m_use_pipeline; }
+
+  //! True if the transmitted bitstreams of the realizations have to be written through io_uring, where available
+  bool get_use_io_uring() const { return m_use_io_uring; }
+
+  //! True if the Annex B NAL units transmitted have to be copied as byte ranges of the input bitstream
+  bool get_use_copy_ranges() const { return m_use_copy_ranges; }
+
+  //! Name of the file the statistics of the run are written to as JSON, empty if they are not requested
+  const string& get_stats_filename() const { return m_stats_file; }
+
+  //! Name of the file the trace of the NAL unit hot path is written to (Chrome trace format), empty if it is not requested
+  const string& get_trace_filename() const { return m_trace_file; }
+
+  //! How the batch mode writes the realizations which transmit the same NAL units as an earlier one
+  DedupeMode get_dedupe_mode() const { return m_dedupe; }
+};
+
+#endif // !H_PARAMETERS_BASE_
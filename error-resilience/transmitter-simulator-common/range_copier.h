@@ -0,0 +1,227 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_RANGE_COPIER_
+#define H_RANGE_COPIER_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Class which copies byte ranges of a source file at the current position of another file, without the data
+ * going through user space whenever the kernel can do it: copy_file_range is tried first, then sendfile
+ * (e.g. when the destination is a pipe or lives in another file system) and finally pread and write, which
+ * are the only method on the platforms lacking the two system calls. A method the kernel refuses for the
+ * given files is not tried again
+ *
+ * \author
+ * Matteo Naccari
+*/
+class RangeCopier
+{
+public:
+  enum class Method { COPY_FILE_RANGE, SENDFILE, READ_WRITE };
+
+private:
+  int m_fd;
+  Method m_method;
+  vector<uint8_t> m_buffer;  //! Bounce buffer of the READ_WRITE method
+  uint64_t m_num_calls;      //! Number of system calls issued to copy the data so far
+
+  //! Largest number of bytes requested to the kernel by one system call
+  static constexpr size_t max_request = size_t(1) << 30;
+
+  //! True if the error means that the method cannot be used with the given files, rather than a failure
+  static bool is_unsupported(int error)
+  {
+    return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP || error == EBADF;
+  }
+
+  //! Copies up to request bytes through the bounce buffer, returning the number of bytes copied or -1 on error
+  int64_t read_write(int out_fd, uint64_t offset, size_t request)
+  {
+    if (m_buffer.empty()) {
+      m_buffer.resize(size_t(1) << 20);
+    }
+    if (request > m_buffer.size()) {
+      request = m_buffer.size();
+    }
+
+#if defined(_WIN32)
+    m_num_calls++;
+    if (_lseeki64(m_fd, static_cast<int64_t>(offset), SEEK_SET) < 0) {
+      return -1;
+    }
+    m_num_calls++;
+    const int64_t bytes_read = _read(m_fd, m_buffer.data(), static_cast<unsigned int>(request));
+#else
+    m_num_calls++;
+    const int64_t bytes_read = pread(m_fd, m_buffer.data(), request, static_cast<off_t>(offset));
+#endif
+    if (bytes_read <= 0) {
+      return bytes_read;
+    }
+
+    size_t written = 0;
+    while (written < static_cast<size_t>(bytes_read)) {
+      m_num_calls++;
+#if defined(_WIN32)
+      const int64_t done = _write(out_fd, m_buffer.data() + written, static_cast<unsigned int>(bytes_read - written));
+#else
+      const int64_t done = ::write(out_fd, m_buffer.data() + written, bytes_read - written);
+#endif
+      if (done < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw runtime_error("Cannot write the transmitted bitstream: " + string(strerror(errno)));
+      }
+      written += static_cast<size_t>(done);
+    }
+
+    return bytes_read;
+  }
+
+public:
+  //! Opens the source file the ranges are copied from
+  explicit RangeCopier(const string& file_name)
+#if defined(__linux__)
+    : m_method(Method::COPY_FILE_RANGE)
+#else
+    : m_method(Method::READ_WRITE)
+#endif
+    , m_num_calls(0)
+  {
+#if defined(_WIN32)
+    m_fd = _open(file_name.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    m_fd = ::open(file_name.c_str(), O_RDONLY);
+#endif
+    if (m_fd < 0) {
+      throw runtime_error("Cannot open " + file_name + " to copy its bytes");
+    }
+  }
+
+  RangeCopier(const RangeCopier&) = delete;
+  RangeCopier& operator=(const RangeCopier&) = delete;
+
+  ~RangeCopier()
+  {
+#if defined(_WIN32)
+    _close(m_fd);
+#else
+    ::close(m_fd);
+#endif
+  }
+
+  //! Method the next range will be copied with
+  Method get_method() const { return m_method; }
+
+  //! Forces a method further down the list, e.g. to exercise the fallbacks
+  void set_method(Method method) { m_method = method; }
+
+  uint64_t get_num_calls() const { return m_num_calls; }
+
+  /*!
+   *
+   * \brief
+   * Copies len bytes starting at offset in the source file at the current position of out_fd, which is advanced
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void copy(int out_fd, uint64_t offset, uint64_t len)
+  {
+    while (len > 0) {
+      const size_t request = len < max_request ? static_cast<size_t>(len) : max_request;
+      int64_t done;
+
+#if defined(__linux__)
+      if (m_method == Method::COPY_FILE_RANGE) {
+        loff_t in_offset = static_cast<loff_t>(offset);
+        m_num_calls++;
+        done = copy_file_range(m_fd, &in_offset, out_fd, nullptr, request, 0);
+      } else if (m_method == Method::SENDFILE) {
+        off_t in_offset = static_cast<off_t>(offset);
+        m_num_calls++;
+        done = sendfile(out_fd, m_fd, &in_offset, request);
+      } else
+#endif
+      {
+        done = read_write(out_fd, offset, request);
+      }
+
+      if (done < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (m_method != Method::READ_WRITE && is_unsupported(errno)) {
+          m_method = m_method == Method::COPY_FILE_RANGE ? Method::SENDFILE : Method::READ_WRITE;
+          continue;
+        }
+        throw runtime_error("Cannot copy the bitstream bytes: " + string(strerror(errno)));
+      }
+      if (done == 0) {
+        throw runtime_error("Cannot copy the bitstream bytes: the source file is shorter than expected");
+      }
+
+      offset += static_cast<uint64_t>(done);
+      len -= static_cast<uint64_t>(done);
+    }
+  }
+};
+
+#endif // !H_RANGE_COPIER_
@@ -0,0 +1,149 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+#ifndef H_REALIZATION_DEDUPE_
+#define H_REALIZATION_DEDUPE_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstdio>
+#include "stream_hash.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+//! How the batch mode handles the realizations which transmit the same NAL units as an earlier one
+enum class DedupeMode {
+  OFF,      //! Every realization is written
+  LINK,     //! Duplicates are hard links to the first realization written
+  MANIFEST  //! Duplicates are not written, the manifest only tells which realization they equal
+};
+
+/*!
+ *
+ * \brief
+ * Class finding the batch mode realizations which write the same transmitted bitstream. Since the bitstream
+ * written is determined by which NAL units are transmitted, each realization is described by the bitmap of the
+ * NAL units it keeps. Bitmaps are grouped by their StreamHash fingerprint and compared in full, hence
+ * two realizations are never merged because of a hash collision
+ *
+ * \author
+ * Matteo Naccari
+*/
+class RealizationDedupe
+{
+public:
+  //! Bit n is set if the n-th NAL unit of the bitstream is transmitted
+  typedef vector<uint64_t> KeptSet;
+
+  static KeptSet make_kept_set(size_t num_nalus) { return KeptSet((num_nalus + 63) / 64, 0); }
+  static void keep(KeptSet& kept, size_t n) { kept[n >> 6] |= uint64_t(1) << (n & 63); }
+  static bool is_kept(const KeptSet& kept, size_t n) { return (kept[n >> 6] >> (n & 63)) & 1; }
+
+  static uint64_t fingerprint(const KeptSet& kept)
+  {
+    StreamHash h;
+    h.update(reinterpret_cast<const uint8_t*>(kept.data()), kept.size() * sizeof(uint64_t));
+    return h.digest();
+  }
+
+  /*!
+   *
+   * \brief
+   * Finds the first realization keeping the same NAL units as each realization
+   *
+   * \param
+   * kept_sets the NAL units kept by each realization
+   *
+   * \return
+   * For each realization, the index of the first one with the same kept set (the realization itself if none)
+   *
+   * \author
+   * Matteo Naccari
+  */
+  static vector<size_t> find_first_equal(const vector<KeptSet>& kept_sets)
+  {
+    vector<size_t> first(kept_sets.size());
+    unordered_multimap<uint64_t, size_t> distinct;
+
+    for (size_t r = 0; r < kept_sets.size(); r++) {
+      const uint64_t key = fingerprint(kept_sets[r]);
+      first[r] = r;
+      const auto range = distinct.equal_range(key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (kept_sets[it->second] == kept_sets[r]) {
+          first[r] = it->second;
+          break;
+        }
+      }
+      if (first[r] == r) {
+        distinct.emplace(key, r);
+      }
+    }
+
+    return first;
+  }
+
+  //! Makes link_name a hard link to target, replacing any file with that name. Returns false if the file system
+  //! cannot link the two files (e.g. they live on different devices)
+  static bool link_file(const string& target, const string& link_name)
+  {
+    remove(link_name.c_str());
+#if defined(_WIN32)
+    return CreateHardLinkA(link_name.c_str(), target.c_str(), nullptr) != 0;
+#else
+    return link(target.c_str(), link_name.c_str()) == 0;
+#endif
+  }
+
+  //! Name of the manifest listing the transmitted bitstream of every realization of the batch mode
+  static string manifest_file_name(const string& transmitted_file_name) { return transmitted_file_name + ".manifest"; }
+};
+
+#endif // !H_REALIZATION_DEDUPE_
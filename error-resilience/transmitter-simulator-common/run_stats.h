@@ -0,0 +1,407 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_RUN_STATS_
+#define H_RUN_STATS_
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <ostream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Class collecting the statistics of one run of the simulator: the NAL units and bytes read, written and dropped,
+ * broken down by NAL unit type, slice type and reference or non reference slices, the position reached in the loss
+ * patterns and the wall and CPU time spent in each stage of the simulation. The statistics of concurrent threads
+ * (e.g. the realizations of the batch mode) are collected separately and merged afterwards. Bytes are counted over
+ * the NAL units, i.e. start codes and RTP headers excluded.
+ * Stages are timed per NAL unit with the wall clock only, since reading the CPU clock of a thread is a system call.
+ * The CPU time of a thread is read once per CpuSpan and shared out among the stages run by the thread in the span,
+ * in proportion to their wall time
+ *
+ * \author
+ * Matteo Naccari
+*/
+class RunStats
+{
+
+public:
+  //! Stages of the simulation which are timed
+  enum Stage { SCAN, PARSE, DECIDE, WRITE, NUM_STAGES };
+
+  static constexpr size_t max_nalu_types = 64;
+  static constexpr size_t max_slice_types = 8;
+
+  //! Classification of a NAL unit: slice type and reference are negative for non VCL NAL units
+  struct NaluClass {
+    int nalu_type;
+    int slice_type;
+    int reference;
+  };
+
+  struct Count {
+    uint64_t nalus = 0;
+    uint64_t bytes = 0;
+
+    void add(uint64_t len) { nalus++; bytes += len; }
+    void add(const Count& c) { nalus += c.nalus; bytes += c.bytes; }
+  };
+
+  //! NAL units read from the input bitstream and, over all the realizations, written and dropped
+  struct Counts {
+    Count read, written, dropped;
+
+    void add(const Counts& c) { read.add(c.read); written.add(c.written); dropped.add(c.dropped); }
+    bool empty() const { return read.nalus == 0 && written.nalus == 0 && dropped.nalus == 0; }
+  };
+
+  //! Position reached in the loss pattern by one realization
+  struct LossPatternState {
+    string file_name;
+    int offset;
+    int modality;
+    uint64_t position;  //! Index of the next cell to be read
+    uint64_t wraps;     //! Number of times the pattern has been read again from the starting offset
+  };
+
+  struct StageTime {
+    uint64_t wall_ns = 0;
+    uint64_t cpu_ns = 0;
+  };
+
+private:
+  Counts m_total;
+  array<Counts, max_nalu_types> m_nalu_types;
+  array<Counts, max_slice_types> m_slice_types;
+  array<Counts, 2> m_reference;  //! Non reference and reference VCL NAL units
+  array<StageTime, NUM_STAGES> m_stages;
+  vector<LossPatternState> m_loss_patterns;
+
+  template <class Action>
+  void for_class(const NaluClass& c, const Action& action)
+  {
+    action(m_total);
+    if (0 <= c.nalu_type && c.nalu_type < int(max_nalu_types)) {
+      action(m_nalu_types[c.nalu_type]);
+    }
+    if (0 <= c.slice_type && c.slice_type < int(max_slice_types)) {
+      action(m_slice_types[c.slice_type]);
+    }
+    if (c.reference >= 0) {
+      action(m_reference[c.reference > 0]);
+    }
+  }
+
+  static void write_counts(ostream& os, const Counts& c)
+  {
+    os << "{ \"read\": { \"nalus\": " << c.read.nalus << ", \"bytes\": " << c.read.bytes << " }, "
+       << "\"written\": { \"nalus\": " << c.written.nalus << ", \"bytes\": " << c.written.bytes << " }, "
+       << "\"dropped\": { \"nalus\": " << c.dropped.nalus << ", \"bytes\": " << c.dropped.bytes << " } }";
+  }
+
+  static string seconds(uint64_t ns)
+  {
+    char text[32];
+    snprintf(text, sizeof(text), "%.6f", ns / 1e9);
+    return text;
+  }
+
+public:
+  //! Quotes a string as a JSON value
+  static string quote(const string& text)
+  {
+    string quoted = "\"";
+    for (const char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        quoted += escaped;
+      } else {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  }
+
+  //! Monotonic wall clock, in nanoseconds
+  static uint64_t wall_ns()
+  {
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  //! CPU time of the calling thread, in nanoseconds
+  static uint64_t cpu_ns()
+  {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    const uint64_t ticks = ((uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) + ((uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+    return ticks * 100;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+#endif
+  }
+
+  void count_read(const NaluClass& c, uint64_t len) { for_class(c, [&](Counts& counts) { counts.read.add(len); }); }
+
+  void count_transmission(const NaluClass& c, uint64_t len, bool written)
+  {
+    for_class(c, [&](Counts& counts) { (written ? counts.written : counts.dropped).add(len); });
+  }
+
+  void add_time(Stage stage, uint64_t wall, uint64_t cpu)
+  {
+    m_stages[stage].wall_ns += wall;
+    m_stages[stage].cpu_ns += cpu;
+  }
+
+  //! Wall time spent so far in each stage
+  array<uint64_t, NUM_STAGES> get_wall_times() const
+  {
+    array<uint64_t, NUM_STAGES> wall;
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      wall[s] = m_stages[s].wall_ns;
+    }
+    return wall;
+  }
+
+  //! Shares the CPU time out among the stages, in proportion to the wall time they took since the given one
+  void add_cpu_time(uint64_t cpu, const array<uint64_t, NUM_STAGES>& wall_before)
+  {
+    uint64_t wall = 0;
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      wall += m_stages[s].wall_ns - wall_before[s];
+    }
+    if (wall == 0) {
+      return;
+    }
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      m_stages[s].cpu_ns += uint64_t(double(cpu) * double(m_stages[s].wall_ns - wall_before[s]) / double(wall));
+    }
+  }
+
+  void add_loss_pattern(const LossPatternState& state) { m_loss_patterns.push_back(state); }
+
+  //! Adds the statistics of another run (e.g. a realization of the batch mode) to these ones
+  void merge(const RunStats& stats)
+  {
+    m_total.add(stats.m_total);
+    for (size_t t = 0; t < max_nalu_types; t++) {
+      m_nalu_types[t].add(stats.m_nalu_types[t]);
+    }
+    for (size_t t = 0; t < max_slice_types; t++) {
+      m_slice_types[t].add(stats.m_slice_types[t]);
+    }
+    m_reference[0].add(stats.m_reference[0]);
+    m_reference[1].add(stats.m_reference[1]);
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      add_time(Stage(s), stats.m_stages[s].wall_ns, stats.m_stages[s].cpu_ns);
+    }
+    m_loss_patterns.insert(m_loss_patterns.end(), stats.m_loss_patterns.begin(), stats.m_loss_patterns.end());
+  }
+
+  const Counts& get_total() const { return m_total; }
+  const Counts& get_nalu_type(int nalu_type) const { return m_nalu_types[nalu_type]; }
+  const Counts& get_slice_type(int slice_type) const { return m_slice_types[slice_type]; }
+  const Counts& get_reference(bool reference) const { return m_reference[reference]; }
+  const StageTime& get_stage(Stage stage) const { return m_stages[stage]; }
+  const vector<LossPatternState>& get_loss_patterns() const { return m_loss_patterns; }
+
+  /*!
+   *
+   * \brief
+   * Writes the statistics as a JSON object. The time of the stages is summed over the threads which run them,
+   * hence it can exceed the elapsed time when stages or realizations run in parallel
+   *
+   * \param
+   * os the stream the object is written to
+   * mode the simulation mode (e.g. single, pipeline or batch)
+   * wall_ns the elapsed time of the whole run
+   * slice_type_name the name of a slice type of the codec
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void write_json(ostream& os, const string& mode, uint64_t wall_ns, const function<string(int)>& slice_type_name) const
+  {
+    const char* stage_names[NUM_STAGES] = { "scan", "parse", "decide", "write" };
+
+    os << "{\n";
+    os << "  \"mode\": " << quote(mode) << ",\n";
+    os << "  \"wall_s\": " << seconds(wall_ns) << ",\n";
+    os << "  \"total\": ";
+    write_counts(os, m_total);
+    os << ",\n";
+
+    os << "  \"nal_unit_types\": {";
+    const char* separator = "\n";
+    for (size_t t = 0; t < max_nalu_types; t++) {
+      if (!m_nalu_types[t].empty()) {
+        os << separator << "    \"" << t << "\": ";
+        write_counts(os, m_nalu_types[t]);
+        separator = ",\n";
+      }
+    }
+    os << "\n  },\n";
+
+    os << "  \"slice_types\": {";
+    separator = "\n";
+    for (size_t t = 0; t < max_slice_types; t++) {
+      if (!m_slice_types[t].empty()) {
+        os << separator << "    " << quote(slice_type_name(int(t))) << ": ";
+        write_counts(os, m_slice_types[t]);
+        separator = ",\n";
+      }
+    }
+    os << "\n  },\n";
+
+    os << "  \"reference\": ";
+    write_counts(os, m_reference[1]);
+    os << ",\n  \"non_reference\": ";
+    write_counts(os, m_reference[0]);
+    os << ",\n";
+
+    os << "  \"loss_patterns\": [";
+    separator = "\n";
+    for (const auto& state : m_loss_patterns) {
+      os << separator << "    { \"file\": " << quote(state.file_name) << ", \"offset\": " << state.offset << ", \"modality\": " << state.modality
+         << ", \"position\": " << state.position << ", \"wraps\": " << state.wraps << " }";
+      separator = ",\n";
+    }
+    os << "\n  ],\n";
+
+    os << "  \"stages\": {";
+    separator = "\n";
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+      os << separator << "    \"" << stage_names[s] << "\": { \"wall_s\": " << seconds(m_stages[s].wall_ns) << ", \"cpu_s\": " << seconds(m_stages[s].cpu_ns) << " }";
+      separator = ",\n";
+    }
+    os << "\n  }\n";
+    os << "}\n";
+  }
+};
+
+/*!
+ *
+ * \brief
+ * Adds the wall time elapsed from its construction to its stop (or destruction) to one stage of the statistics.
+ * Nothing is measured when no statistics are collected, i.e. the statistics pointer is null
+ *
+ * \author
+ * Matteo Naccari
+*/
+class StageTimer
+{
+  RunStats* m_stats;
+  RunStats::Stage m_stage;
+  uint64_t m_wall;
+
+public:
+  StageTimer(RunStats* stats, RunStats::Stage stage)
+    : m_stats(stats)
+    , m_stage(stage)
+    , m_wall(stats ? RunStats::wall_ns() : 0)
+  {
+  }
+
+  ~StageTimer() { stop(); }
+
+  void stop()
+  {
+    if (m_stats) {
+      m_stats->add_time(m_stage, RunStats::wall_ns() - m_wall, 0);
+      m_stats = nullptr;
+    }
+  }
+};
+
+/*!
+ *
+ * \brief
+ * Measures the CPU time of the calling thread from its construction to its destruction and shares it out among
+ * the stages timed in the meantime. The statistics must not be updated by other threads during the span
+ *
+ * \author
+ * Matteo Naccari
+*/
+class CpuSpan
+{
+  RunStats* m_stats;
+  uint64_t m_cpu;
+  array<uint64_t, RunStats::NUM_STAGES> m_wall;
+
+public:
+  CpuSpan(RunStats* stats)
+    : m_stats(stats)
+    , m_cpu(0)
+  {
+    if (m_stats) {
+      m_cpu = RunStats::cpu_ns();
+      m_wall = m_stats->get_wall_times();
+    }
+  }
+
+  ~CpuSpan()
+  {
+    if (m_stats) {
+      m_stats->add_cpu_time(RunStats::cpu_ns() - m_cpu, m_wall);
+    }
+  }
+};
+
+#endif // !H_RUN_STATS_
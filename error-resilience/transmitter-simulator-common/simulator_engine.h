@@ -0,0 +1,1236 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_SIMULATOR_ENGINE_
+#define H_SIMULATOR_ENGINE_
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include "nalu_writer.h"
+#include "nalu_index.h"
+#include "loss_pattern.h"
+#include "spsc_ring.h"
+#include "io_uring_writer.h"
+#include "range_copier.h"
+#include "memory_streams.h"
+#include "worker_pool.h"
+#include "standard_streams.h"
+#include "run_stats.h"
+#include "nalu_tracer.h"
+#include "realization_dedupe.h"
+
+using namespace std;
+
+//! Carries a packet class as a value, so that the codec traits can hand the packetization chosen at run time
+//! over to a generic lambda which is then compiled for that very class
+template <class PacketT>
+struct PacketTag
+{
+  typedef PacketT type;
+};
+
+/*!
+ *
+ * \brief
+ * The simulation engine shared by the AVC and HEVC simulators, which models the bitstream transmission over an
+ * error prone channel. The engine is compiled for the codec traits given as template parameter, which provide:
+ *  - Parameters, Nalu, NaluType and SliceType: the parameters of the simulator and the codec syntax
+ *  - index_codec: the codec identifier stored in the NALU index
+ *  - has_packet_types: true if the bitstream can be given with more than one packetization
+ *  - packet_type_name(packet_type): the name of a packetization, as printed to the user
+ *  - with_packet_type(packet_type, action): calls action(PacketTag<P>()) with the packet class P of the packetization
+ *  - get_priority(nalu) and set_priority(nalu, priority): the NALU header field stored as priority in the NALU index
+ *  - is_reference(nalu) and slice_type_name(slice_type): the classification of the slices in the run statistics
+ * Every function which handles the NAL units is a template on the packet class (e.g. RTP or Annex B), hence the
+ * packetization is chosen once per run and the packets are never accessed through virtual functions
+ *
+ * \author
+ * Matteo Naccari
+*/
+template <class Codec>
+class SimulatorEngine
+{
+
+public:
+  typedef typename Codec::Parameters Parameters;
+  typedef typename Codec::Nalu Nalu;
+  typedef typename Codec::NaluType NaluType;
+  typedef typename Codec::SliceType SliceType;
+
+  //! State of the error prone channel during the transmission of one bitstream
+  struct Channel {
+    LossPatternCursor cursor; //! Position in the loss pattern, read in a circular fashion from the starting offset
+    int modality;             //! Corruption modality
+  };
+
+private:
+  //! NAL unit of the input bitstream, parsed and classified once for the batch mode
+  struct NaluRecord {
+    Nalu nalu;              //! NALU header, its payload points into m_nalu_data
+    size_t data_offset;     //! Offset in m_nalu_data of the NALU payload, preceded by the packet prefix
+    SliceType slice_type;   //! Slice type associated with the NALU by the parser
+    bool header_rewritten;  //! The first payload byte differs in the bitstream file, hence the NALU cannot be copied from it
+  };
+
+  //! NAL unit travelling through the stages of the pipelined single run, in a slot which is recycled
+  struct PipelineNalu {
+    Nalu nalu;              //! NALU header, its payload points into data
+    vector<uint8_t> data;   //! Payload of the NAL unit, preceded by the bytes needed to write the packet again
+    bool transmit;          //! Decision taken by the classifier stage
+  };
+
+  //! Number of NAL units in flight in the pipelined single run
+  static constexpr size_t pipeline_depth = 64;
+
+  //! Slot index which marks the end of the bitstream in the pipeline queues
+  static constexpr size_t pipeline_end = ~size_t(0);
+
+  //! One realization of the batch mode
+  struct Realization {
+    size_t pattern_idx;     //! Index of the loss pattern file
+    int offset;
+    int modality;
+    string file_name;       //! Transmitted bitstream
+  };
+
+  const Parameters& m_param;
+  ifstream m_fp_bitstream;     //! Original bitstream
+  istream* m_input;            //! Stream the packets are read from, i.e. m_fp_bitstream or the standard input
+  unique_ptr<RangeCopier> m_source; //! Source of the byte ranges copied to the received bitstream, if enabled (it outlives the writer)
+  NaluWriter m_tr_writer;      //! Received bitstream
+  LossPattern m_loss_pattern;  //! Loss pattern of the single run, shared with m_channel
+  Channel m_channel;
+
+  vector<NaluRecord> m_nalus;  //! NAL units of the input bitstream (batch mode only)
+  vector<uint8_t> m_nalu_data; //! Payloads of the NAL units of the input bitstream (batch mode only)
+  unique_ptr<RunStats> m_stats; //! Statistics of the run, if requested
+
+  void print_header();
+  void write_stats(uint64_t wall_ns) const;
+  static RunStats::NaluClass nalu_class(const Nalu& nalu, bool is_vcl, SliceType slice_type);
+  ostream& console() const;
+  static bool transmit_nalu(bool is_vcl, SliceType slice_type, Channel& channel);
+  template <class PacketT, class Emit>
+  static void transmit_bitstream(PacketT& packet, istream& bitstream, Channel& channel, RunStats* stats, const Emit& emit);
+  template <class PacketT>
+  void run();
+  template <class PacketT>
+  void run_pipeline();
+  template <class PacketT>
+  void parse_bitstream(PacketT& packet);
+  template <class PacketT>
+  bool load_index(PacketT& packet);
+  void save_index(NaluIndex& index) const;
+  vector<unique_ptr<IoUringWriter>> create_rings(unsigned num_workers) const;
+  template <class PacketT>
+  void decide_realization(Channel& channel, RealizationDedupe::KeptSet& kept, RunStats* stats) const;
+  template <class PacketT>
+  void write_realization(const RealizationDedupe::KeptSet& kept, const string& transmitted_file_name, IoUringWriter* ring, RunStats* stats) const;
+  template <class PacketT>
+  void write_realizations(const vector<Realization>& realizations, const vector<RealizationDedupe::KeptSet>& kept_sets,
+                          const vector<size_t>& written, vector<RunStats>& realization_stats) const;
+  void write_manifest(const vector<Realization>& realizations, const vector<string>& loss_pattern_files, const vector<size_t>& first_equal) const;
+
+public:
+  SimulatorEngine(const Parameters& p);  //! Constructor with configuration parameters
+  ~SimulatorEngine() {}
+  void run_simulator();    //! Method to simulate the bitstream transmission
+
+  //! Name of the transmitted bitstream of the realization with the given loss pattern file and offset (batch mode).
+  //! The corruption modality is appended when non negative
+  static string realization_file_name(const string& transmitted_file_name, const string& loss_pattern_file, int offset, int modality = -1);
+
+  //! Library interface: transmits the bitstream over the channel, with the given packetization (see the codec traits),
+  //! handing every packet transmitted over to the sink. Neither parameters nor files are involved
+  static void transmit(istream& bitstream, int packet_type, Channel channel, const PacketSink& sink);
+  static void transmit(const uint8_t* bitstream, size_t size, int packet_type, Channel channel, const PacketSink& sink);
+  static void transmit(const BitstreamReader& reader, int packet_type, Channel channel, const PacketSink& sink);
+
+  //! Library interface: transmits the bitstream held in memory over the channel, appending the transmitted one to the given buffer
+  static void transmit(const uint8_t* bitstream, size_t size, int packet_type, Channel channel, vector<uint8_t>& transmitted);
+};
+
+// Definitions of the constants bound to references, e.g. by the pipeline queues
+template <class Codec>
+constexpr size_t SimulatorEngine<Codec>::pipeline_depth;
+
+template <class Codec>
+constexpr size_t SimulatorEngine<Codec>::pipeline_end;
+
+/*!
+ *
+ * \brief
+ * The constructor for the simulation engine. It sets up all the transmission enviroment:
+ * bitstream being transmitted, received bitstream, error pattern file (the simulated error
+ * prone channel) and checks the packetization used
+ *
+ * \param
+ * p a reference to a parameters object which contains all the transmission parameters
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+SimulatorEngine<Codec>::SimulatorEngine(const Parameters& p)
+  : m_param(p)
+{
+  if (is_standard_stream(m_param.get_bitstream_original_filename())) {
+    m_input = &binary_stdin();
+  } else {
+    m_fp_bitstream.open(m_param.get_bitstream_original_filename(), ios::binary);
+    if (!m_fp_bitstream) {
+      throw runtime_error("Cannot open " + m_param.get_bitstream_original_filename() + " input bitstream, abort");
+    }
+    m_input = &m_fp_bitstream;
+  }
+
+  m_tr_writer.set_flush_threshold(m_param.get_flush_size());
+
+  if (!m_param.get_stats_filename().empty()) {
+    m_stats = make_unique<RunStats>();
+  }
+
+  // A wrong packet type is reported before any file is written
+  Codec::with_packet_type(m_param.get_packet_type(), [](auto) {});
+
+  if (!m_param.is_batch() && !m_param.get_use_index()) {
+    m_tr_writer.open(m_param.get_bitstream_transmitted_filename());
+    if (m_param.get_use_copy_ranges()) {
+      m_source = make_unique<RangeCopier>(m_param.get_bitstream_original_filename());
+      m_tr_writer.set_source(m_source.get());
+    }
+
+    m_loss_pattern.open(m_param.get_loss_pattern_filename());
+    m_channel.cursor = LossPatternCursor(m_loss_pattern, m_param.get_offset());
+    m_channel.modality = m_param.get_modality();
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Decides whether a NALU is transmitted or lost according to the loss pattern and the corruption modality.
+ * Only coded slices are subject to losses and the position in the loss pattern is advanced accordingly
+ *
+ * \param
+ * is_vcl true if the NALU contains coded slice data
+ * slice_type the type of the slice contained in the NALU
+ * channel the state of the channel, whose position in the loss pattern is updated
+ *
+ * \return
+ * True if the NALU has to be written in the received bitstream
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+inline bool SimulatorEngine<Codec>::transmit_nalu(bool is_vcl, SliceType slice_type, Channel& channel)
+{
+  const char cell = channel.cursor.get();
+  int writeable = 0;
+  bool transmit = false;
+
+  switch (channel.modality)
+  {
+  case 0:
+    // Normal corruption: do nothing
+    break;
+  case 1:
+    // Corrupt all slices but the intra ones: check whether the current slice is actually intra coded
+    if (slice_type == SliceType::I_SLICE) {
+      writeable = 1;
+    }
+    break;
+  case 2:
+    // Corrupts only intra coded slices: check whether the current slice is not intra coded
+    if (slice_type != SliceType::I_SLICE) {
+      writeable = 1;
+    }
+    break;
+  }
+
+  if (!is_vcl) {
+    transmit = true;
+  } else if (cell == '0') {
+    transmit = true;
+    channel.cursor.advance();
+  } else if (cell == '1') {
+    if (writeable) {
+      // Writes although the slice is ought to be discarded: this is because the modality chosen says to do so
+      transmit = true;
+    } else {
+      channel.cursor.advance();
+    }
+  } else {
+    cerr << "Wrong character used in the error pattern string: " << cell << '\n';
+  }
+
+  return transmit;
+}
+
+/*!
+ *
+ * \brief
+ * Classifies a NAL unit for the run statistics
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+RunStats::NaluClass SimulatorEngine<Codec>::nalu_class(const Nalu& nalu, bool is_vcl, SliceType slice_type)
+{
+  return { int(nalu.nal_unit_type), is_vcl ? int(slice_type) : -1, is_vcl ? int(Codec::is_reference(nalu)) : -1 };
+}
+
+/*!
+ *
+ * \brief
+ * Reads, parses and classifies every packet of the bitstream, handing the packets transmitted over the channel to emit
+ *
+ * \param
+ * packet the packet the bitstream is read with
+ * bitstream the bitstream being transmitted
+ * channel the state of the channel, advanced by the transmission
+ * stats the statistics of the run, null if they are not collected
+ * emit the action taken on every packet transmitted, e.g. its writing
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT, class Emit>
+void SimulatorEngine<Codec>::transmit_bitstream(PacketT& packet, istream& bitstream, Channel& channel, RunStats* stats, const Emit& emit)
+{
+  for (;;) {
+    StageTimer scan(stats, RunStats::SCAN);
+    TraceScope scan_trace(TraceName::GET_PACKET);
+    if (packet.get_packet(bitstream) <= 0) {
+      break;
+    }
+    scan_trace.set_nalu(int(packet.get_nalu().nal_unit_type), packet.get_nalu().len);
+    scan_trace.stop();
+    scan.stop();
+
+    StageTimer parse(stats, RunStats::PARSE);
+    TraceScope parse_trace(TraceName::PARSE, int(packet.get_nalu().nal_unit_type), packet.get_nalu().len);
+    packet.parse();
+    parse_trace.stop();
+    parse.stop();
+
+    StageTimer decide(stats, RunStats::DECIDE);
+    const bool transmit = transmit_nalu(packet.is_nalu_vcl(), packet.get_slice_type(), channel);
+    decide.stop();
+
+    if (stats) {
+      const RunStats::NaluClass c = nalu_class(packet.get_nalu(), packet.is_nalu_vcl(), packet.get_slice_type());
+      stats->count_read(c, packet.get_nalu().len);
+      stats->count_transmission(c, packet.get_nalu().len, transmit);
+    }
+
+    if (transmit) {
+      StageTimer write(stats, RunStats::WRITE);
+      TraceScope write_trace(TraceName::WRITE_PACKET, int(packet.get_nalu().nal_unit_type), packet.get_nalu().len);
+      emit(packet);
+    }
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Library interface to the simulator: transmits a bitstream over a channel with no parameters nor files involved,
+ * so that e.g. a decoder harness can receive the transmitted bitstream in memory
+ *
+ * \param
+ * bitstream the bitstream being transmitted
+ * packet_type the packetization of the bitstream, as numbered by the codec traits
+ * channel the loss pattern cursor at the starting offset and the corruption modality
+ * sink the receiver of the packets transmitted, one call per packet
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+void SimulatorEngine<Codec>::transmit(istream& bitstream, int packet_type, Channel channel, const PacketSink& sink)
+{
+  NaluWriter writer;
+  writer.open(sink);
+
+  Codec::with_packet_type(packet_type, [&](auto tag) {
+    typename decltype(tag)::type packet;
+    transmit_bitstream(packet, bitstream, channel, nullptr, [&](decltype(packet)& transmitted) { transmitted.write_packet(writer); });
+  });
+
+  writer.close();
+}
+
+template <class Codec>
+void SimulatorEngine<Codec>::transmit(const uint8_t* bitstream, size_t size, int packet_type, Channel channel, const PacketSink& sink)
+{
+  SpanStreamBuffer buffer(bitstream, size);
+  istream input(&buffer);
+  transmit(input, packet_type, channel, sink);
+}
+
+template <class Codec>
+void SimulatorEngine<Codec>::transmit(const BitstreamReader& reader, int packet_type, Channel channel, const PacketSink& sink)
+{
+  ReaderStreamBuffer buffer(reader);
+  istream input(&buffer);
+  transmit(input, packet_type, channel, sink);
+}
+
+template <class Codec>
+void SimulatorEngine<Codec>::transmit(const uint8_t* bitstream, size_t size, int packet_type, Channel channel, vector<uint8_t>& transmitted)
+{
+  transmit(bitstream, size, packet_type, channel, [&](const uint8_t* data, size_t len) {
+    transmitted.insert(transmitted.end(), data, data + len);
+  });
+}
+
+/*!
+ *
+ * \brief
+ * Simulates the transmission of one coded bitstream through an error prone channel.
+ * The packetization of the bitstream is chosen here, once, and the whole simulation runs
+ * with the packet class of that packetization
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+void SimulatorEngine<Codec>::run_simulator()
+{
+  const uint64_t start = RunStats::wall_ns();
+
+  print_header();
+
+  if (!m_param.get_trace_filename().empty()) {
+    Tracer::instance().enable();
+  }
+
+  Codec::with_packet_type(m_param.get_packet_type(), [&](auto tag) {
+    this->template run<typename decltype(tag)::type>();
+  });
+
+  if (m_stats) {
+    write_stats(RunStats::wall_ns() - start);
+  }
+
+  if (!m_param.get_trace_filename().empty()) {
+    Tracer::instance().disable();
+    ofstream ofs(m_param.get_trace_filename());
+    Tracer::instance().write_chrome_trace(ofs);
+    if (!ofs) {
+      throw runtime_error("Cannot write the trace to " + m_param.get_trace_filename());
+    }
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Simulates the transmission of one coded bitstream with the given packet class.
+ * The method reads every nalu which corresponds to a coded slice. For each nalu the
+ * method checks whether the current slice contains coded data rather than syntax
+ * parameters as for example PPS, SPS, etc.
+ * If the current slice contains coded data, then the method decodes the
+ * slice type in order to finalize the decision of transmitting or corrupting the data.
+ * In batch mode the bitstream is parsed once and one received bitstream is written for
+ * every combination of loss pattern file and offset
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+void SimulatorEngine<Codec>::run()
+{
+  PacketT packet;
+
+  if (m_param.is_batch() || m_param.get_use_index()) {
+    const vector<string> loss_pattern_files = m_param.get_loss_pattern_files();
+    vector<LossPattern> loss_patterns(loss_pattern_files.size());
+    vector<Realization> realizations;
+    map<string, size_t> realization_patterns;  //! Loss pattern file of each bitstream name of the batch mode
+
+    for (size_t p = 0; p < loss_pattern_files.size(); p++) {
+      loss_patterns[p].open(loss_pattern_files[p]);
+      for (const auto offset : m_param.get_offsets()) {
+        for (const auto modality : m_param.get_modalities()) {
+          if (!m_param.is_batch()) {
+            realizations.push_back({ p, offset, modality, m_param.get_bitstream_transmitted_filename() });
+            continue;
+          }
+          const string file_name = realization_file_name(m_param.get_bitstream_transmitted_filename(), loss_pattern_files[p], offset,
+                                                         m_param.has_modality_list() ? modality : -1);
+          // The names keep the last component of the loss pattern file only, which different files may share
+          const auto name = realization_patterns.emplace(file_name, p);
+          if (!name.second && name.first->second != p) {
+            throw logic_error("The loss pattern files " + loss_pattern_files[name.first->second] + " and " + loss_pattern_files[p] +
+                              " give the same transmitted bitstream name " + file_name);
+          }
+          realizations.push_back({ p, offset, modality, file_name });
+          console() << "Realization: " << loss_pattern_files[p] << " offset " << offset << " modality " << modality << " -> " << file_name << endl;
+        }
+      }
+    }
+
+    parse_bitstream(packet);
+
+    // Realizations only share the parsed bitstream, which is not modified anymore. Each one collects its own statistics.
+    // The NAL units transmitted by every realization are decided first, so that the realizations transmitting the
+    // same NAL units can be found before any bitstream is written
+    vector<RunStats> realization_stats(m_stats ? realizations.size() : 0);
+    vector<RealizationDedupe::KeptSet> kept_sets(realizations.size());
+    WorkerPool(m_param.get_jobs()).run(realizations.size(), [&](size_t r) {
+      const Realization& realization = realizations[r];
+      Channel channel = { LossPatternCursor(loss_patterns[realization.pattern_idx], realization.offset), realization.modality };
+      RunStats* stats = m_stats ? &realization_stats[r] : nullptr;
+      decide_realization<PacketT>(channel, kept_sets[r], stats);
+      if (stats) {
+        stats->add_loss_pattern({ loss_pattern_files[realization.pattern_idx], realization.offset, realization.modality,
+                                  channel.cursor.get_index(), channel.cursor.get_wraps() });
+      }
+    });
+
+    const DedupeMode dedupe = m_param.is_batch() ? m_param.get_dedupe_mode() : DedupeMode::OFF;
+    vector<size_t> first_equal(realizations.size());
+    if (dedupe == DedupeMode::OFF) {
+      for (size_t r = 0; r < realizations.size(); r++) {
+        first_equal[r] = r;
+      }
+    } else {
+      first_equal = RealizationDedupe::find_first_equal(kept_sets);
+    }
+
+    vector<size_t> written;
+    for (size_t r = 0; r < realizations.size(); r++) {
+      if (first_equal[r] == r) {
+        written.push_back(r);
+      }
+    }
+    write_realizations<PacketT>(realizations, kept_sets, written, realization_stats);
+
+    if (dedupe != DedupeMode::OFF) {
+      // Duplicates are linked to the bitstream written, or written as well when the file system cannot link them.
+      // In manifest mode any bitstream left by an earlier run under the name of a duplicate is removed. A duplicate
+      // named as the bitstream it equals is that very file, which is neither removed nor linked to itself
+      vector<size_t> not_linked;
+      for (size_t r = 0; r < realizations.size(); r++) {
+        if (first_equal[r] == r || realizations[r].file_name == realizations[first_equal[r]].file_name) {
+          continue;
+        }
+        if (dedupe == DedupeMode::MANIFEST) {
+          remove(realizations[r].file_name.c_str());
+        } else if (!RealizationDedupe::link_file(realizations[first_equal[r]].file_name, realizations[r].file_name)) {
+          not_linked.push_back(r);
+        }
+      }
+      if (!not_linked.empty()) {
+        cerr << "Warning! " << not_linked.size() << " duplicate realizations cannot be hard linked, they are written instead" << endl;
+        write_realizations<PacketT>(realizations, kept_sets, not_linked, realization_stats);
+      }
+
+      write_manifest(realizations, loss_pattern_files, first_equal);
+      console() << "Distinct transmitted bitstreams: " << written.size() << " out of " << realizations.size() << " realizations" << endl;
+    }
+
+    for (const auto& stats : realization_stats) {
+      m_stats->merge(stats);
+    }
+    return;
+  }
+
+  if (m_param.get_use_pipeline()) {
+    run_pipeline<PacketT>();
+  } else {
+    CpuSpan cpu(m_stats.get());
+    transmit_bitstream(packet, *m_input, m_channel, m_stats.get(), [&](PacketT& transmitted) {
+      if (m_source && !transmitted.is_header_rewritten()) {
+        transmitted.copy_packet(m_tr_writer);
+      } else {
+        transmitted.write_packet(m_tr_writer);
+      }
+    });
+
+    // Flush and close the transmitted file so any caller can take action on it
+    StageTimer write(m_stats.get(), RunStats::WRITE);
+    m_tr_writer.close();
+  }
+
+  if (m_stats) {
+    m_stats->add_loss_pattern({ m_param.get_loss_pattern_filename(), m_param.get_offset(), m_param.get_modality(),
+                                m_channel.cursor.get_index(), m_channel.cursor.get_wraps() });
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Simulates the transmission of one coded bitstream as run does, with the reading, the classification
+ * and the writing of the NAL units overlapped. The reader thread copies every NALU in a free slot of a pool,
+ * the calling thread parses it and decides whether it is transmitted and the writer thread writes it and hands
+ * the slot back to the reader. The stages pass the slot indexes to each other through single producer single
+ * consumer queues, hence at most pipeline_depth NAL units are kept in memory whatever the bitstream length
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+void SimulatorEngine<Codec>::run_pipeline()
+{
+  vector<PipelineNalu> slots(pipeline_depth);
+  SpscRing<size_t> free_slots(pipeline_depth), read_slots(pipeline_depth), classified_slots(pipeline_depth);
+  atomic<bool> failed(false);
+  exception_ptr error;
+  mutex error_mutex;
+
+  for (size_t s = 0; s < slots.size(); s++) {
+    free_slots.try_push(s);
+  }
+
+  // The first exception thrown by a stage stops all of them
+  auto run_stage = [&](const function<void()>& stage) {
+    try {
+      stage();
+    } catch (...) {
+      lock_guard<mutex> lock(error_mutex);
+      if (!error) {
+        error = current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  // Each stage collects its own statistics, merged once the threads are joined
+  RunStats reader_stats, writer_stats;
+  RunStats* read_stats = m_stats ? &reader_stats : nullptr;
+  RunStats* write_stats = m_stats ? &writer_stats : nullptr;
+
+  thread reader([&]() {
+    run_stage([&]() {
+      CpuSpan cpu(read_stats);
+      PacketT packet;
+      size_t s;
+      while (free_slots.pop(s, failed)) {
+        StageTimer scan(read_stats, RunStats::SCAN);
+        TraceScope scan_trace(TraceName::GET_PACKET);
+        if (packet.get_packet(*m_input) <= 0) {
+          scan_trace.stop();
+          scan.stop();
+          read_slots.push(pipeline_end, failed);
+          return;
+        }
+        scan_trace.set_nalu(int(packet.get_nalu().nal_unit_type), packet.get_nalu().len);
+        scan_trace.stop();
+        // The bytes preceding the payload (e.g. the RTP header) are copied as well, to write the packet again
+        const Nalu& nalu = packet.get_nalu();
+        const uint32_t prefix_len = packet.get_prefix_len();
+        PipelineNalu& slot = slots[s];
+        slot.data.assign(nalu.buf - prefix_len, nalu.buf + nalu.len);
+        slot.nalu = nalu;
+        slot.nalu.buf = slot.data.data() + prefix_len;
+        scan.stop();
+        read_slots.push(s, failed);
+      }
+    });
+  });
+
+  thread writer([&]() {
+    run_stage([&]() {
+      // A packet of its own so that the packetization state (e.g. the RTP sequence number) is the one of a single run
+      CpuSpan cpu(write_stats);
+      PacketT packet;
+      size_t s;
+      while (classified_slots.pop(s, failed) && s != pipeline_end) {
+        if (slots[s].transmit) {
+          StageTimer write(write_stats, RunStats::WRITE);
+          TraceScope write_trace(TraceName::WRITE_PACKET, int(slots[s].nalu.nal_unit_type), slots[s].nalu.len);
+          packet.set_nalu(slots[s].nalu);
+          packet.write_packet(m_tr_writer);
+        }
+        free_slots.push(s, failed);
+      }
+    });
+  });
+
+  run_stage([&]() {
+    CpuSpan cpu(m_stats.get());
+    PacketT packet;
+    size_t s;
+    while (read_slots.pop(s, failed)) {
+      if (s == pipeline_end) {
+        classified_slots.push(s, failed);
+        return;
+      }
+      PipelineNalu& slot = slots[s];
+      StageTimer parse(m_stats.get(), RunStats::PARSE);
+      TraceScope parse_trace(TraceName::PARSE, int(slot.nalu.nal_unit_type), slot.nalu.len);
+      packet.set_nalu(slot.nalu);
+      packet.parse();
+      parse_trace.stop();
+      parse.stop();
+      StageTimer decide(m_stats.get(), RunStats::DECIDE);
+      slot.transmit = transmit_nalu(packet.is_nalu_vcl(), packet.get_slice_type(), m_channel);
+      decide.stop();
+      if (m_stats) {
+        const RunStats::NaluClass c = nalu_class(slot.nalu, packet.is_nalu_vcl(), packet.get_slice_type());
+        m_stats->count_read(c, slot.nalu.len);
+        m_stats->count_transmission(c, slot.nalu.len, slot.transmit);
+      }
+      classified_slots.push(s, failed);
+    }
+  });
+
+  reader.join();
+  writer.join();
+
+  if (error) {
+    rethrow_exception(error);
+  }
+
+  if (m_stats) {
+    m_stats->merge(reader_stats);
+    m_stats->merge(writer_stats);
+  }
+
+  // Flush and close the transmitted file so any caller can take action on it
+  CpuSpan cpu(m_stats.get());
+  StageTimer write(m_stats.get(), RunStats::WRITE);
+  m_tr_writer.close();
+}
+
+/*!
+ *
+ * \brief
+ * Reads and classifies all the NAL units of the input bitstream, keeping their headers, slice types and
+ * payloads in memory so that any number of realizations can be simulated without parsing the bitstream again.
+ * With the NALU index enabled, the NAL units are taken from the index when it is up to date, otherwise the
+ * index is built while parsing and saved next to the bitstream for the following runs
+ *
+ * \param
+ * packet the packet the bitstream is read with
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+void SimulatorEngine<Codec>::parse_bitstream(PacketT& packet)
+{
+  m_nalus.clear();
+  m_nalu_data.clear();
+
+  CpuSpan cpu(m_stats.get());
+  StageTimer load(m_stats.get(), RunStats::SCAN);
+  const bool loaded = m_param.get_use_index() && load_index(packet);
+  load.stop();
+
+  if (!loaded) {
+    NaluIndex index;
+
+    for (;;) {
+      StageTimer scan(m_stats.get(), RunStats::SCAN);
+      TraceScope scan_trace(TraceName::GET_PACKET);
+      if (packet.get_packet(*m_input) <= 0) {
+        break;
+      }
+      scan_trace.set_nalu(int(packet.get_nalu().nal_unit_type), packet.get_nalu().len);
+      scan_trace.stop();
+      scan.stop();
+
+      StageTimer parse(m_stats.get(), RunStats::PARSE);
+      TraceScope parse_trace(TraceName::PARSE, int(packet.get_nalu().nal_unit_type), packet.get_nalu().len);
+      packet.parse();
+      parse_trace.stop();
+      parse.stop();
+
+      // The bytes preceding the payload (e.g. the RTP header) are kept as well, to write the packet again
+      const Nalu& nalu = packet.get_nalu();
+      const uint32_t prefix_len = packet.get_prefix_len();
+      m_nalu_data.insert(m_nalu_data.end(), nalu.buf - prefix_len, nalu.buf + nalu.len);
+      m_nalus.push_back({ nalu, m_nalu_data.size() - nalu.len, packet.get_slice_type(), false });
+
+      if (m_param.get_use_index()) {
+        index.entries.push_back({ nalu.offset, nalu.len, uint8_t(nalu.startcodeprefix_len), uint8_t(nalu.nal_unit_type),
+                                  uint8_t(packet.get_slice_type()), Codec::get_priority(nalu) });
+      }
+    }
+
+    if (m_param.get_use_index()) {
+      save_index(index);
+    }
+  }
+
+  // The payload buffer does not grow anymore: the NALU headers can now point into it.
+  // The NALU headers are written as the packets will do, so that the realizations only read the payloads
+  for (auto& record : m_nalus) {
+    record.nalu.buf = m_nalu_data.data() + record.data_offset;
+    packet.set_nalu(record.nalu);
+    record.header_rewritten = packet.is_header_rewritten();
+    packet.update_nalu_header();
+    if (m_stats) {
+      m_stats->count_read(nalu_class(record.nalu, packet.is_nalu_vcl(), record.slice_type), record.nalu.len);
+    }
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Loads the bitstream in memory and takes the position and the classification of its NAL units from
+ * the NALU index, so that neither the start codes have to be found nor the slice headers parsed
+ *
+ * \param
+ * packet a packet of the packetization of the bitstream
+ *
+ * \return
+ * False if the index is missing, stale or does not describe the bitstream
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+bool SimulatorEngine<Codec>::load_index(PacketT& packet)
+{
+  const string index_file_name = NaluIndex::file_name(m_param.get_bitstream_original_filename());
+  NaluIndex index;
+
+  if (!index.load(index_file_name)) {
+    return false;
+  }
+
+  m_fp_bitstream.seekg(0, ios::end);
+  m_nalu_data.resize(static_cast<size_t>(m_fp_bitstream.tellg()));
+  m_fp_bitstream.seekg(0, ios::beg);
+  m_fp_bitstream.read(reinterpret_cast<char*>(m_nalu_data.data()), m_nalu_data.size());
+
+  StreamHash hash;
+  hash.update(m_nalu_data.data(), m_nalu_data.size());
+
+  if (!m_fp_bitstream || !index.matches(Codec::index_codec, uint32_t(m_param.get_packet_type()), m_nalu_data.size(), hash.digest())) {
+    console() << "NALU index " << index_file_name << " is stale, it will be rebuilt" << endl;
+    m_nalu_data.clear();
+    m_fp_bitstream.clear();
+    m_fp_bitstream.seekg(0, ios::beg);
+    return false;
+  }
+
+  const uint32_t prefix_len = packet.get_prefix_len();
+
+  m_nalus.resize(index.entries.size());
+  for (size_t n = 0; n < index.entries.size(); n++) {
+    const NaluIndexEntry& entry = index.entries[n];
+    if (entry.offset < prefix_len || entry.offset + entry.len > m_nalu_data.size()) {
+      cerr << "NALU index " << index_file_name << " is not consistent with the bitstream, it will be rebuilt" << endl;
+      m_nalus.clear();
+      m_nalu_data.clear();
+      m_fp_bitstream.seekg(0, ios::beg);
+      return false;
+    }
+    NaluRecord& record = m_nalus[n];
+    record.nalu.startcodeprefix_len = entry.startcodeprefix_len;
+    record.nalu.len = entry.len;
+    record.nalu.nal_unit_type = NaluType(entry.nal_unit_type);
+    Codec::set_priority(record.nalu, entry.priority);
+    record.nalu.forbidden_bit = entry.len > 0 ? (m_nalu_data[entry.offset] >> 7) & 1 : 0;
+    record.nalu.offset = entry.offset;
+    record.data_offset = entry.offset;
+    record.slice_type = SliceType(entry.slice_type);
+  }
+
+  return true;
+}
+
+/*!
+ *
+ * \brief
+ * Saves the NALU index built while parsing the bitstream. A failure is only reported since the
+ * simulation does not need the index
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+void SimulatorEngine<Codec>::save_index(NaluIndex& index) const
+{
+  const string index_file_name = NaluIndex::file_name(m_param.get_bitstream_original_filename());
+
+  try {
+    index.codec = Codec::index_codec;
+    index.packet_type = uint32_t(m_param.get_packet_type());
+    NaluIndex::hash_file(m_param.get_bitstream_original_filename(), index.source_size, index.source_hash);
+    index.save(index_file_name);
+  }
+  catch (exception& e) {
+    cerr << "Warning! The NALU index has not been saved: " << e.what() << endl;
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Sets up one io_uring per worker of the batch mode when requested. When io_uring cannot be used, a warning is
+ * issued and no ring is returned, i.e. the realizations are written with the portable path
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+vector<unique_ptr<IoUringWriter>> SimulatorEngine<Codec>::create_rings(unsigned num_workers) const
+{
+  vector<unique_ptr<IoUringWriter>> rings;
+
+  if (!m_param.get_use_io_uring()) {
+    return rings;
+  }
+
+  if (!IoUringWriter::is_supported()) {
+    cerr << "Warning! io_uring is not available, the transmitted bitstreams are written with the portable path" << endl;
+    return rings;
+  }
+
+  try {
+    for (unsigned w = 0; w < num_workers; w++) {
+      rings.push_back(make_unique<IoUringWriter>(m_param.get_flush_size()));
+    }
+  } catch (exception& e) {
+    cerr << "Warning! " << e.what() << ", the transmitted bitstreams are written with the portable path" << endl;
+    rings.clear();
+  }
+
+  return rings;
+}
+
+/*!
+ *
+ * \brief
+ * Decides which NAL units of the bitstream parsed by parse_bitstream are transmitted by one realization.
+ * Realizations can be decided concurrently since each one uses its own channel
+ *
+ * \param
+ * channel the state of the channel used for the realization
+ * kept the NAL units transmitted, set by the call
+ * stats the statistics of the realization, null if they are not collected
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+void SimulatorEngine<Codec>::decide_realization(Channel& channel, RealizationDedupe::KeptSet& kept, RunStats* stats) const
+{
+  PacketT packet;
+  CpuSpan cpu(stats);
+
+  kept = RealizationDedupe::make_kept_set(m_nalus.size());
+  for (size_t n = 0; n < m_nalus.size(); n++) {
+    const NaluRecord& record = m_nalus[n];
+    StageTimer decide(stats, RunStats::DECIDE);
+    packet.set_nalu(record.nalu);
+    const bool is_vcl = packet.is_nalu_vcl();
+    const bool transmit = transmit_nalu(is_vcl, record.slice_type, channel);
+    decide.stop();
+
+    if (stats) {
+      stats->count_transmission(nalu_class(record.nalu, is_vcl, record.slice_type), record.nalu.len, transmit);
+    }
+
+    if (transmit) {
+      RealizationDedupe::keep(kept, n);
+    }
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Writes the transmitted bitstream of one realization, i.e. the NAL units of the bitstream parsed by parse_bitstream
+ * which have been kept by decide_realization.
+ * Realizations can be written concurrently since each one uses its own packet and writer.
+ * When byte ranges are copied, the unchanged NAL units are copied from the bitstream file rather than from memory,
+ * consecutive ones by a single request to the kernel
+ *
+ * \param
+ * kept the NAL units transmitted by the realization
+ * transmitted_file_name the name of the received bitstream being written
+ * ring the io_uring the transmitted bitstream is written through, null for the portable path
+ * stats the statistics of the realization, null if they are not collected
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+void SimulatorEngine<Codec>::write_realization(const RealizationDedupe::KeptSet& kept, const string& transmitted_file_name, IoUringWriter* ring,
+                                               RunStats* stats) const
+{
+  // A new packet so that the packetization state (e.g. the RTP sequence number) starts afresh
+  PacketT packet;
+  unique_ptr<RangeCopier> source;
+  NaluWriter writer(m_param.get_flush_size());
+
+  CpuSpan cpu(stats);
+
+  if (m_param.get_use_copy_ranges()) {
+    source = make_unique<RangeCopier>(m_param.get_bitstream_original_filename());
+    writer.set_source(source.get());
+  }
+
+  if (ring) {
+    writer.open(transmitted_file_name, *ring);
+  } else {
+    writer.open(transmitted_file_name);
+  }
+
+  for (size_t n = 0; n < m_nalus.size(); n++) {
+    if (!RealizationDedupe::is_kept(kept, n)) {
+      continue;
+    }
+
+    const NaluRecord& record = m_nalus[n];
+    StageTimer write(stats, RunStats::WRITE);
+    TraceScope write_trace(TraceName::WRITE_PACKET, int(record.nalu.nal_unit_type), record.nalu.len);
+    packet.set_nalu(record.nalu);
+    if (source && !record.header_rewritten) {
+      packet.copy_packet(writer);
+    } else {
+      packet.write_packet(writer);
+    }
+  }
+
+  StageTimer write(stats, RunStats::WRITE);
+  writer.close();
+}
+
+/*!
+ *
+ * \brief
+ * Writes the transmitted bitstreams of the given realizations, in parallel as set by the parameters
+ *
+ * \param
+ * realizations all the realizations of the run
+ * kept_sets the NAL units transmitted by each realization
+ * written the indices of the realizations to be written
+ * realization_stats the statistics of each realization, empty if they are not collected
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+template <class PacketT>
+void SimulatorEngine<Codec>::write_realizations(const vector<Realization>& realizations, const vector<RealizationDedupe::KeptSet>& kept_sets,
+                                                const vector<size_t>& written, vector<RunStats>& realization_stats) const
+{
+  WorkerPool pool(m_param.get_jobs());
+  vector<unique_ptr<IoUringWriter>> rings = create_rings(pool.get_num_workers(written.size()));
+  pool.run(written.size(), [&](size_t w, unsigned worker) {
+    const size_t r = written[w];
+    RunStats* stats = m_stats ? &realization_stats[r] : nullptr;
+    write_realization<PacketT>(kept_sets[r], realizations[r].file_name, rings.empty() ? nullptr : rings[worker].get(), stats);
+  });
+
+  // The writes still in flight have to be completed before the realizations are reported as written
+  CpuSpan cpu(m_stats.get());
+  for (auto& ring : rings) {
+    StageTimer write(m_stats.get(), RunStats::WRITE);
+    ring->drain();
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Writes the manifest of the batch mode, which tells for every realization the transmitted bitstream actually
+ * written with its NAL units, so that the bitstreams shared by several realizations can be decoded once.
+ * One tab separated line per realization: bitstream name, bitstream written, loss pattern, offset and modality
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+void SimulatorEngine<Codec>::write_manifest(const vector<Realization>& realizations, const vector<string>& loss_pattern_files,
+                                            const vector<size_t>& first_equal) const
+{
+  const string file_name = RealizationDedupe::manifest_file_name(m_param.get_bitstream_transmitted_filename());
+  ofstream ofs(file_name);
+
+  ofs << "# realization\twritten\tloss_pattern\toffset\tmodality\n";
+  for (size_t r = 0; r < realizations.size(); r++) {
+    const Realization& realization = realizations[r];
+    ofs << realization.file_name << '\t' << realizations[first_equal[r]].file_name << '\t' << loss_pattern_files[realization.pattern_idx]
+        << '\t' << realization.offset << '\t' << realization.modality << '\n';
+  }
+
+  if (!ofs) {
+    throw runtime_error("Cannot write the manifest of the realizations to " + file_name);
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Builds the name of the received bitstream of one batch mode realization by appending the
+ * name of the loss pattern file (or of the loss generator), the offset and optionally the corruption modality to the name of
+ * the received bitstream, e.g. container_err.264 becomes container_err_error_plr_3_10.264
+ * (container_err_error_plr_3_10_m1.264 when the modality is given)
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+string SimulatorEngine<Codec>::realization_file_name(const string& transmitted_file_name, const string& loss_pattern_file, int offset, int modality)
+{
+  const size_t slash = loss_pattern_file.find_last_of("/\\");
+  const string pattern_name = MarkovLossModel::is_spec(loss_pattern_file) ? MarkovLossModel::tag(loss_pattern_file)
+                              : slash == string::npos ? loss_pattern_file : loss_pattern_file.substr(slash + 1);
+
+  size_t dot = transmitted_file_name.find_last_of('.');
+  const size_t name_start = transmitted_file_name.find_last_of("/\\");
+  if (dot == string::npos || (name_start != string::npos && dot < name_start)) {
+    dot = transmitted_file_name.size();
+  }
+
+  const string modality_suffix = modality >= 0 ? "_m" + to_string(modality) : "";
+
+  return transmitted_file_name.substr(0, dot) + "_" + pattern_name + "_" + to_string(offset) + modality_suffix + transmitted_file_name.substr(dot);
+}
+
+/*!
+ *
+ * \brief
+ * Prints the operating settings of the simulator so the user can be sure the software has been provided with the right inputs
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+void SimulatorEngine<Codec>::print_header()
+{
+  const string corruption_modality_text[] = { "all", "all but intra", "intra only" };
+  console() << "Input bitstream: " << m_param.get_bitstream_original_filename() << endl;
+  console() << "Transmitted bitstream: " << m_param.get_bitstream_transmitted_filename() << endl;
+  console() << "Error pattern file: " << m_param.get_loss_pattern_filename() << endl;
+  if (Codec::has_packet_types) {
+    console() << "Packet type: " << Codec::packet_type_name(m_param.get_packet_type()) << endl;
+  }
+  console() << "Starting offset: " << m_param.get_offset() << endl;
+  console() << "Corruption modality: " << corruption_modality_text[m_param.get_modality()] << endl;
+  if (m_param.is_batch()) {
+    console() << "Realizations: " << m_param.get_loss_pattern_files().size() * m_param.get_offsets().size() * m_param.get_modalities().size() << endl;
+  }
+  console() << endl;
+}
+
+/*!
+ *
+ * \brief
+ * Writes the statistics of the run as JSON, to the standard output when requested so
+ *
+ * \param
+ * wall_ns the elapsed time of the whole run
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+void SimulatorEngine<Codec>::write_stats(uint64_t wall_ns) const
+{
+  const string mode = m_param.is_batch() ? "batch" : m_param.get_use_index() ? "index" : m_param.get_use_pipeline() ? "pipeline" : "single";
+  const auto slice_type_name = [](int slice_type) { return string(Codec::slice_type_name(slice_type)); };
+
+  if (is_standard_stream(m_param.get_stats_filename())) {
+    m_stats->write_json(cout, mode, wall_ns, slice_type_name);
+    return;
+  }
+
+  ofstream ofs(m_param.get_stats_filename());
+  m_stats->write_json(ofs, mode, wall_ns, slice_type_name);
+  if (!ofs) {
+    throw runtime_error("Cannot write the statistics to " + m_param.get_stats_filename());
+  }
+}
+
+/*!
+ *
+ * \brief
+ * Returns the stream of the messages for the user: the standard error when the transmitted bitstream or the
+ * statistics are written to the standard output, the standard output otherwise
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+template <class Codec>
+ostream& SimulatorEngine<Codec>::console() const
+{
+  return is_standard_stream(m_param.get_bitstream_transmitted_filename()) || is_standard_stream(m_param.get_stats_filename()) ? cerr : cout;
+}
+
+#endif
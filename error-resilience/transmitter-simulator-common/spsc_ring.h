@@ -0,0 +1,148 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_SPSC_RING_
+#define H_SPSC_RING_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Bounded lock-free queue connecting exactly one producer thread with exactly one consumer thread.
+ * The producer only writes the tail and the consumer only writes the head, each one keeping a copy of the
+ * other index so that the shared cache lines are touched only when the queue looks full or empty.
+ * A thread waiting on a full or empty queue yields, and gives up as soon as the given flag is raised,
+ * so that a failing stage of a pipeline cannot leave the other ones waiting forever
+ *
+ * \author
+ * Matteo Naccari
+*/
+template <typename T>
+class SpscRing
+{
+  vector<T> m_slots;
+  size_t m_mask;
+
+  alignas(64) atomic<size_t> m_head;  //! Index of the next item to pop, written by the consumer
+  size_t m_cached_tail;               //! Consumer's copy of m_tail
+
+  alignas(64) atomic<size_t> m_tail;  //! Index of the next item to push, written by the producer
+  size_t m_cached_head;               //! Producer's copy of m_head
+
+public:
+  //! Creates a queue holding at least the given number of items (the capacity is rounded up to a power of two)
+  explicit SpscRing(size_t capacity)
+    : m_head(0)
+    , m_cached_tail(0)
+    , m_tail(0)
+    , m_cached_head(0)
+  {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_slots.resize(size);
+    m_mask = size - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  size_t capacity() const { return m_slots.size(); }
+
+  //! Appends an item, called by the producer only. Returns false if the queue is full
+  bool try_push(const T& item)
+  {
+    const size_t tail = m_tail.load(memory_order_relaxed);
+    if (tail - m_cached_head == m_slots.size()) {
+      m_cached_head = m_head.load(memory_order_acquire);
+      if (tail - m_cached_head == m_slots.size()) {
+        return false;
+      }
+    }
+    m_slots[tail & m_mask] = item;
+    m_tail.store(tail + 1, memory_order_release);
+    return true;
+  }
+
+  //! Removes the oldest item, called by the consumer only. Returns false if the queue is empty
+  bool try_pop(T& item)
+  {
+    const size_t head = m_head.load(memory_order_relaxed);
+    if (head == m_cached_tail) {
+      m_cached_tail = m_tail.load(memory_order_acquire);
+      if (head == m_cached_tail) {
+        return false;
+      }
+    }
+    item = m_slots[head & m_mask];
+    m_head.store(head + 1, memory_order_release);
+    return true;
+  }
+
+  //! Waits until the item is appended. Returns false if the wait has been cancelled
+  bool push(const T& item, const atomic<bool>& cancel)
+  {
+    while (!try_push(item)) {
+      if (cancel.load(memory_order_relaxed)) {
+        return false;
+      }
+      this_thread::yield();
+    }
+    return true;
+  }
+
+  //! Waits until an item is removed. Returns false if the wait has been cancelled
+  bool pop(T& item, const atomic<bool>& cancel)
+  {
+    while (!try_pop(item)) {
+      if (cancel.load(memory_order_relaxed)) {
+        return false;
+      }
+      this_thread::yield();
+    }
+    return true;
+  }
+};
+
+#endif // !H_SPSC_RING_
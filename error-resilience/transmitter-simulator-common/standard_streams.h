@@ -0,0 +1,97 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_STANDARD_STREAMS_
+#define H_STANDARD_STREAMS_
+
+#include <string>
+#include <cstdio>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+using namespace std;
+
+//! File name standing for the standard input (input bitstream) or the standard output (transmitted bitstream)
+constexpr const char* standard_stream_name = "-";
+
+//! True if the file name stands for the standard input or output, so that the simulator can sit in a pipeline
+inline bool is_standard_stream(const string& file_name) { return file_name == standard_stream_name; }
+
+/*!
+ *
+ * \brief
+ * Returns the standard input, switched to binary mode where the operating system distinguishes it.
+ * The input bitstream is then only read forward, hence it can come from a pipe or a FIFO
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline istream& binary_stdin()
+{
+#if defined(_WIN32)
+  _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  return cin;
+}
+
+/*!
+ *
+ * \brief
+ * Returns the file descriptor of the standard output, switched to binary mode where the operating system
+ * distinguishes it. Any text already buffered in cout or stdout is written first, so that it does not end up
+ * in the middle of the transmitted bitstream
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline int binary_stdout_fd()
+{
+  cout.flush();
+  fflush(stdout);
+#if defined(_WIN32)
+  _setmode(_fileno(stdout), _O_BINARY);
+  return _fileno(stdout);
+#else
+  return fileno(stdout);
+#endif
+}
+
+#endif // !H_STANDARD_STREAMS_
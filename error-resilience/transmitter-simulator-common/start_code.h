@@ -0,0 +1,181 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_START_CODE_
+#define H_START_CODE_
+
+#include <cstdint>
+#include "intrinsics.h"
+
+/*!
+ *
+ * \brief
+ * Returns the position of the first three byte start code prefix (0x00 0x00 0x01) in [begin, end).
+ * Reference implementation which inspects one byte at a time, used for the tails of the buffers and on CPUs without SIMD
+ *
+ * \return
+ * Pointer to the first 0x00 of the start code or end if no start code has been found
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline const uint8_t* find_start_code_scalar(const uint8_t* begin, const uint8_t* end)
+{
+  for (const uint8_t* p = begin; p + 2 < end; p++) {
+    if (p[2] > 1) {
+      p += 2;
+    } else if (p[2] == 1 && p[1] == 0 && p[0] == 0) {
+      return p;
+    }
+  }
+  return end;
+}
+
+#if defined(SIMULATOR_SSE2)
+/*!
+ *
+ * \brief
+ * SSE2 start code scanner: it looks for pairs of zero bytes in 16 byte chunks and then confirms whether the pair is followed by 0x01
+ *
+ * \return
+ * Pointer to the first 0x00 of the start code or end if no start code has been found
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline const uint8_t* find_start_code_sse2(const uint8_t* begin, const uint8_t* end)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const uint8_t* p = begin;
+
+  // Both loads (p and p + 1) must be within the buffer
+  for (; end - p >= 17; p += 16) {
+    const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    uint32_t pairs = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)));
+
+    while (pairs) {
+      const uint32_t i = count_trailing_zeros(pairs);
+      if (p + i + 2 < end && p[i + 2] == 1) {
+        return p + i;
+      }
+      pairs &= pairs - 1;
+    }
+  }
+
+  return find_start_code_scalar(p, end);
+}
+#endif
+
+#if defined(SIMULATOR_X86)
+/*!
+ *
+ * \brief
+ * AVX2 start code scanner, same as find_start_code_sse2 on 32 byte chunks
+ *
+ * \return
+ * Pointer to the first 0x00 of the start code or end if no start code has been found
+ *
+ * \author
+ * Matteo Naccari
+*/
+SIMULATOR_TARGET_AVX2 inline const uint8_t* find_start_code_avx2(const uint8_t* begin, const uint8_t* end)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const uint8_t* p = begin;
+
+  for (; end - p >= 33; p += 32) {
+    const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+    uint32_t pairs = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero))));
+
+    while (pairs) {
+      const uint32_t i = count_trailing_zeros(pairs);
+      if (p + i + 2 < end && p[i + 2] == 1) {
+        return p + i;
+      }
+      pairs &= pairs - 1;
+    }
+  }
+
+  return find_start_code_scalar(p, end);
+}
+#endif
+
+typedef const uint8_t* (*StartCodeScanner)(const uint8_t* begin, const uint8_t* end);
+
+/*!
+ *
+ * \brief
+ * Selects the fastest start code scanner supported by the CPU the program is running on (AVX2, SSE2 or scalar)
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline StartCodeScanner select_start_code_scanner()
+{
+#if defined(SIMULATOR_X86)
+  if (cpu_has_avx2()) {
+    return find_start_code_avx2;
+  }
+#endif
+#if defined(SIMULATOR_SSE2)
+  return find_start_code_sse2;
+#else
+  return find_start_code_scalar;
+#endif
+}
+
+/*!
+ *
+ * \brief
+ * Returns the position of the first three byte start code prefix (0x00 0x00 0x01) in [begin, end).
+ * A four byte start code is found at its last three bytes, i.e. the caller checks the byte before for the extra zero.
+ *
+ * \return
+ * Pointer to the first 0x00 of the start code or end if no start code has been found
+ *
+ * \author
+ * Matteo Naccari
+*/
+inline const uint8_t* find_start_code(const uint8_t* begin, const uint8_t* end)
+{
+  static const StartCodeScanner scanner = select_start_code_scanner();
+  return scanner(begin, end);
+}
+
+#endif // !H_START_CODE_
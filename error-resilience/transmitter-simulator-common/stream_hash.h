@@ -0,0 +1,118 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_STREAM_HASH_
+#define H_STREAM_HASH_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/*!
+ *
+ * \brief
+ * Class computing a 64 bit hash of a byte sequence given in chunks of any size.
+ * Eight bytes are mixed at a time, so that hashing a whole bitstream costs much less than parsing it
+ *
+ * \author
+ * Matteo Naccari
+*/
+class StreamHash
+{
+  uint64_t m_hash;
+  uint64_t m_length;
+  uint8_t m_tail[8];
+  size_t m_tail_len;
+
+  static uint64_t mix(uint64_t h, uint64_t w)
+  {
+    w *= 0x87c37b91114253d5ull;
+    w = (w << 31) | (w >> 33);
+    w *= 0x4cf5ad432745937full;
+    h ^= w;
+    h = (h << 27) | (h >> 37);
+    return h * 5 + 0x52dce729;
+  }
+
+public:
+  StreamHash()
+    : m_hash(0x9e3779b97f4a7c15ull)
+    , m_length(0)
+    , m_tail_len(0)
+  {}
+
+  void update(const uint8_t* data, size_t len)
+  {
+    uint64_t w;
+
+    m_length += len;
+
+    if (m_tail_len > 0) {
+      while (m_tail_len < 8 && len > 0) {
+        m_tail[m_tail_len++] = *data++;
+        len--;
+      }
+      if (m_tail_len < 8) {
+        return;
+      }
+      memcpy(&w, m_tail, 8);
+      m_hash = mix(m_hash, w);
+      m_tail_len = 0;
+    }
+
+    for (; len >= 8; data += 8, len -= 8) {
+      memcpy(&w, data, 8);
+      m_hash = mix(m_hash, w);
+    }
+
+    memcpy(m_tail, data, len);
+    m_tail_len = len;
+  }
+
+  uint64_t digest() const
+  {
+    uint64_t w = 0;
+    memcpy(&w, m_tail, m_tail_len);
+    uint64_t h = mix(m_hash, w) ^ m_length;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+  }
+};
+
+#endif // !H_STREAM_HASH_
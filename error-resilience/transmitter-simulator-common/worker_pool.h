@@ -0,0 +1,146 @@
+/*  transmitter-simulator-common, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#ifndef H_WORKER_POOL_
+#define H_WORKER_POOL_
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <exception>
+
+using namespace std;
+
+/*!
+ *
+ * \brief
+ * Class modelling a pool of worker threads which run a number of independent tasks, identified by
+ * their index. Each worker picks the next task not yet started, so that tasks of different durations
+ * are balanced across the workers. The first exception thrown by a task stops the assignment of new
+ * tasks and is rethrown to the caller once all the workers have finished.
+ *
+ * \author
+ * Matteo Naccari
+*/
+class WorkerPool
+{
+  unsigned m_num_workers;
+
+public:
+  //! Creates a pool with the given number of workers, zero meaning one worker per hardware thread
+  WorkerPool(unsigned num_workers)
+    : m_num_workers(num_workers)
+  {
+    if (m_num_workers == 0) {
+      m_num_workers = thread::hardware_concurrency();
+    }
+    if (m_num_workers == 0) {
+      m_num_workers = 1;
+    }
+  }
+
+  unsigned get_num_workers() const { return m_num_workers; }
+
+  //! Runs task(0), ..., task(num_tasks - 1) and returns when all of them are completed
+  void run(size_t num_tasks, const function<void(size_t)>& task)
+  {
+    run(num_tasks, [&](size_t i, unsigned) { task(i); });
+  }
+
+  //! Number of workers which run the given number of tasks, i.e. the range of the worker index passed to the tasks
+  unsigned get_num_workers(size_t num_tasks) const
+  {
+    return num_tasks < m_num_workers ? (num_tasks > 0 ? unsigned(num_tasks) : 1) : m_num_workers;
+  }
+
+  /*!
+   *
+   * \brief
+   * Runs task(0, worker), ..., task(num_tasks - 1, worker) and returns when all of them are completed.
+   * The index of the worker running a task is passed along, so that tasks can use per worker resources
+   *
+   * \author
+   * Matteo Naccari
+  */
+  void run(size_t num_tasks, const function<void(size_t, unsigned)>& task)
+  {
+    const size_t num_threads = num_tasks < m_num_workers ? num_tasks : m_num_workers;
+
+    if (num_threads <= 1) {
+      for (size_t i = 0; i < num_tasks; i++) {
+        task(i, 0);
+      }
+      return;
+    }
+
+    atomic<size_t> next_task(0);
+    atomic<bool> failed(false);
+    exception_ptr error;
+    mutex error_mutex;
+
+    auto worker = [&](unsigned w) {
+      size_t i;
+      while (!failed && (i = next_task++) < num_tasks) {
+        try {
+          task(i, w);
+        } catch (...) {
+          lock_guard<mutex> lock(error_mutex);
+          if (!error) {
+            error = current_exception();
+          }
+          failed = true;
+        }
+      }
+    };
+
+    vector<thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+      threads.emplace_back(worker, unsigned(t));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    if (error) {
+      rethrow_exception(error);
+    }
+  }
+};
+
+#endif // !H_WORKER_POOL_
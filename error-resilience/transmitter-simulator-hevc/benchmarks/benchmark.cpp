@@ -0,0 +1,326 @@
+/*  transmitter-simulator-hevc, version 0.1
+ *  Copyright(c) 2021 Matteo Naccari
+ *  All Rights Reserved.
+ *
+ *  email: matteo.naccari@gmail.com | matteo.naccari@polimi.it | matteo.naccari@lx.it.pt
+ *
+ * The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the author may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+*/
+
+#include "benchmark/benchmark.h"
+#include "parameters.h"
+#include "packet.h"
+#include "reader.h"
+#include "syntax.h"
+#include "simulator.h"
+#include <string>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////
+// Input bitstreams: the bundled one and larger synthetic ones,
+// made of the bundled bitstream repeated several times
+//////////////////////////////////////////////////////////////////
+static const string bundled_bitstream = "../unit-tests/bitstream_test.265";
+static vector<string> synthetic_bitstreams;
+
+static string bitstream_file_name(int repetitions)
+{
+  if (repetitions == 1) {
+    return bundled_bitstream;
+  }
+
+  const string file_name = "bitstream_test_x" + to_string(repetitions) + ".265";
+  ifstream exists(file_name, ios::binary);
+  if (!exists) {
+    ifstream ifs(bundled_bitstream, ios::binary);
+    const string data = string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    ofstream ofs(file_name, ios::binary);
+    for (int i = 0; i < repetitions; i++) {
+      ofs << data;
+    }
+    synthetic_bitstreams.push_back(file_name);
+  }
+  return file_name;
+}
+
+static int64_t file_size(const string& file_name)
+{
+  ifstream ifs(file_name, ios::binary | ios::ate);
+  return static_cast<int64_t>(ifs.tellg());
+}
+
+//! Reports the throughput as bytes and NAL units per second
+static void set_throughput(benchmark::State& state, int64_t bytes, int64_t nalus)
+{
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["NALs"] = benchmark::Counter(static_cast<double>(state.iterations() * nalus), benchmark::Counter::kIsRate);
+}
+
+//! Codewords of small values, as the ones found in the parameter sets and in the slice headers
+static vector<uint8_t> ue_codewords(int num_codes)
+{
+  vector<uint8_t> buffer;
+  uint64_t bit_buffer = 0;
+  int num_bits = 0;
+  mt19937 rng(1979);
+  geometric_distribution<uint32_t> values(0.2);
+
+  auto put_bits = [&](uint32_t value, int bits) {
+    for (int b = bits - 1; b >= 0; b--) {
+      bit_buffer = (bit_buffer << 1) | ((value >> b) & 1);
+      if (++num_bits == 8) {
+        buffer.push_back(static_cast<uint8_t>(bit_buffer));
+        bit_buffer = 0;
+        num_bits = 0;
+      }
+    }
+  };
+  for (int i = 0; i < num_codes; i++) {
+    const uint32_t code = values(rng) + 1;
+    int len = 0;
+    while ((code >> (len + 1)) != 0) {
+      len++;
+    }
+    put_bits(0, len);
+    put_bits(code, len + 1);
+  }
+  put_bits(0, 7);
+  buffer.resize(buffer.size() + 8, 0);
+
+  return buffer;
+}
+
+//////////////////////////////////////////////////////////////////
+// Packet module benchmarks
+//////////////////////////////////////////////////////////////////
+static void BM_GetPacket(benchmark::State& state)
+{
+  const string file_name = bitstream_file_name(static_cast<int>(state.range(0)));
+  int64_t nalus = 0;
+
+  for (auto _ : state) {
+    ifstream ifs(file_name, ios::binary);
+    Packet packet;
+    nalus = 0;
+    while (packet.get_packet(ifs) > 0) {
+      nalus++;
+    }
+    benchmark::DoNotOptimize(packet.get_nalu_type());
+  }
+
+  set_throughput(state, file_size(file_name), nalus);
+}
+BENCHMARK(BM_GetPacket)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+static void BM_ParseNalus(benchmark::State& state)
+{
+  vector<vector<uint8_t>> payloads;
+  vector<NALU> nalus;
+  int64_t bytes = 0;
+
+  // The NAL units are read once, only the parsing of the parameter sets and of the slice types is measured
+  ifstream ifs(bundled_bitstream, ios::binary);
+  Packet reader;
+  while (reader.get_packet(ifs) > 0) {
+    NALU nalu;
+    nalu.startcodeprefix_len = reader.get_nalu().startcodeprefix_len;
+    nalu.len = reader.get_nalu().len;
+    nalu.nal_unit_type = reader.get_nalu().nal_unit_type;
+    payloads.emplace_back(reader.get_nalu().buf, reader.get_nalu().buf + nalu.len);
+    nalus.push_back(nalu);
+    bytes += nalu.len;
+  }
+  for (size_t n = 0; n < nalus.size(); n++) {
+    nalus[n].buf = payloads[n].data();
+  }
+
+  Packet packet;
+  for (auto _ : state) {
+    for (const auto& nalu : nalus) {
+      packet.set_nalu(nalu);
+      if (packet.is_nalu_sps()) {
+        packet.parse_sps();
+      }
+      if (packet.is_nalu_pps()) {
+        packet.parse_pps();
+      }
+      if (packet.is_nalu_slice()) {
+        packet.parse_slice_type();
+      }
+    }
+    benchmark::DoNotOptimize(packet.get_slice_type());
+  }
+
+  set_throughput(state, bytes, static_cast<int64_t>(nalus.size()));
+}
+BENCHMARK(BM_ParseNalus)->Unit(benchmark::kMicrosecond);
+
+static void BM_WritePacket(benchmark::State& state)
+{
+  const string file_name = bitstream_file_name(static_cast<int>(state.range(0)));
+  const string output_file_name = "benchmark_out.265";
+  vector<vector<uint8_t>> payloads;
+  vector<NALU> nalus;
+  int64_t bytes = 0;
+
+  // The NAL units are read once, only their writing is measured
+  ifstream ifs(file_name, ios::binary);
+  Packet reader;
+  while (reader.get_packet(ifs) > 0) {
+    NALU nalu;
+    nalu.startcodeprefix_len = reader.get_nalu().startcodeprefix_len;
+    nalu.len = reader.get_nalu().len;
+    nalu.forbidden_bit = reader.get_nalu().forbidden_bit;
+    nalu.nal_unit_type = reader.get_nalu().nal_unit_type;
+    payloads.emplace_back(reader.get_nalu().buf, reader.get_nalu().buf + nalu.len);
+    nalus.push_back(nalu);
+    bytes += nalu.startcodeprefix_len + nalu.len;
+  }
+  for (size_t n = 0; n < nalus.size(); n++) {
+    nalus[n].buf = payloads[n].data();
+  }
+
+  for (auto _ : state) {
+    NaluWriter writer;
+    Packet packet;
+    writer.open(output_file_name);
+    for (const auto& nalu : nalus) {
+      packet.set_nalu(nalu);
+      packet.write_packet(writer);
+    }
+    writer.close();
+  }
+
+  set_throughput(state, bytes, static_cast<int64_t>(nalus.size()));
+  remove(output_file_name.c_str());
+}
+BENCHMARK(BM_WritePacket)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+//////////////////////////////////////////////////////////////////
+// Syntax module benchmarks
+//////////////////////////////////////////////////////////////////
+static void BM_ReaderReadBits(benchmark::State& state)
+{
+  const int num_reads = 1 << 16;
+  vector<uint8_t> buffer(num_reads * 4 + 8);
+  vector<uint32_t> widths(num_reads);
+  mt19937 rng(1979);
+  int64_t bits = 0;
+
+  for (auto& byte : buffer) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  for (auto& width : widths) {
+    width = 1 + rng() % 32;
+    bits += width;
+  }
+
+  for (auto _ : state) {
+    Reader r(buffer.data(), buffer.size());
+    uint32_t sum = 0;
+    for (const auto width : widths) {
+      sum += r.read_bits(width);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetBytesProcessed(state.iterations() * bits / 8);
+  state.SetItemsProcessed(state.iterations() * num_reads);
+}
+BENCHMARK(BM_ReaderReadBits)->Unit(benchmark::kMicrosecond);
+
+static void BM_UeDecoding(benchmark::State& state)
+{
+  const int num_codes = 1 << 16;
+  const vector<uint8_t> buffer = ue_codewords(num_codes);
+
+  for (auto _ : state) {
+    Reader r(buffer.data(), buffer.size());
+    uint32_t sum = 0;
+    for (int i = 0; i < num_codes; i++) {
+      sum += ue(r);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(buffer.size()));
+  state.SetItemsProcessed(state.iterations() * num_codes);
+}
+BENCHMARK(BM_UeDecoding)->Unit(benchmark::kMicrosecond);
+
+//////////////////////////////////////////////////////////////////
+// Simulator module benchmarks
+//////////////////////////////////////////////////////////////////
+static void BM_RunSimulator(benchmark::State& state)
+{
+  const string file_name = bitstream_file_name(static_cast<int>(state.range(0)));
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", file_name.c_str(), "benchmark_err.265", "../error_plr_3", "10", "0" };
+  int64_t nalus = 0;
+
+  ifstream ifs(file_name, ios::binary);
+  Packet packet;
+  while (packet.get_packet(ifs) > 0) {
+    nalus++;
+  }
+
+  Parameters p(cmdLine);
+  streambuf* cout_buffer = cout.rdbuf(nullptr);
+  for (auto _ : state) {
+    Simulator s(p);
+    s.run_simulator();
+  }
+  cout.rdbuf(cout_buffer);
+
+  set_throughput(state, file_size(file_name), nalus);
+  remove("benchmark_err.265");
+}
+BENCHMARK(BM_RunSimulator)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv)
+{
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+
+  for (const auto& file_name : synthetic_bitstreams) {
+    remove(file_name.c_str());
+  }
+  return 0;
+}
@@ -39,93 +39,6 @@
 #include <cstring>
 #include <iostream>
 
-/*!
- *
- * \brief
- * Allocates the memory space for a given NALU
- *
- * \param
- * buffersize the maximum dimension for the NALU buffer
- *
- * \author
- * Matteo Naccari
- *
-*/
-void Packet::alloc_nalu(int buffersize)
-{
-  m_nalu.max_size = buffersize;
-  m_nalu.buf.resize(buffersize, 0);
-}
-
-/*!
- *
- * \brief
- *  Returns if new start code is found at byte aligned position buf.
- *  new-startcode is of form N 0x00 bytes, followed by a 0x01 byte.
- *
- *  \return
- *  1 if start-code is found or
- *  0, indicating that there is no start code
- *
- *  \param Buf
- *  pointer to byte-stream
- *
- *  \param zeros_in_startcode
- *  indicates number of 0x00 bytes in start-code.
- *
- *	\author
- *	Matteo Naccari (adapted from the H.264/AVC decoder reference software)
-*/
-int Packet::find_start_code(unsigned char* buf, int zeros_in_startcode) {
-  int info;
-  int i;
-
-  info = 1;
-  for (i = 0; i < zeros_in_startcode; i++) {
-    if (buf[i] != 0)
-      info = 0;
-  }
-
-  if (buf[i] != 1) {
-    info = 0;
-  }
-
-  return info;
-}
-
-/*!
- *
- * \brief
- * Converts the elementary byte stream payload to the raw byte stream payload formar where emulation prevention codes are not present
- *
- *	\author
- *	Matteo Naccari
-*/
-void Packet::convert_to_rbsp()
-{
-  m_nalu.buf_rbsp.clear();
-  m_nalu.buf_rbsp.resize(m_nalu.len);
-  copy(m_nalu.buf.begin(), m_nalu.buf.begin() + m_nalu.len, m_nalu.buf_rbsp.begin());
-
-  vector<uint8_t>::iterator read, write;
-  uint32_t zero_count = 0;
-
-  for (read = write = m_nalu.buf_rbsp.begin(); read != m_nalu.buf_rbsp.end(); read++, write++) {
-    if (zero_count == 2 && *read == 0x03) {
-      read++;
-      zero_count = 0;
-
-      if (read == m_nalu.buf_rbsp.end()) {
-        break;
-      }
-    }
-    zero_count = *read == 0x00 ? zero_count + 1 : 0;
-    *write = *read;
-  }
-
-  m_nalu.buf_rbsp.resize(write - m_nalu.buf_rbsp.begin());
-}
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Public members
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -143,7 +56,7 @@ void Packet::convert_to_rbsp()
 void Packet::parse_slice_type()
 {
   const int int_nalu_type = int(m_nalu.nal_unit_type);
-  Reader r(&m_nalu.buf_rbsp[2]);
+  Reader r = rbsp_reader();
 
   m_slice_type = parse_slice_header(r, int_nalu_type, m_pps_memory, m_sps_memory);
 }
@@ -152,7 +65,8 @@ void Packet::parse_slice_type()
  *
  * \brief
  * Parse the general picture parameter set RBSP as specified in Clause 7.3.2.3.1 of the H.265/HEVC standard.
- * The pps is then stored in the array of pps in case the stream is using multiple versions of it.
+ * The pps is then stored in the array of pps, indexed by its identifier, in case the stream is using multiple versions of it.
+ * A PPS identical to one already stored is not parsed again.
  *
  * \author
  * Matteo Naccari
@@ -160,9 +74,18 @@ void Packet::parse_slice_type()
 */
 void Packet::parse_pps()
 {
-  Reader r(&m_nalu.buf_rbsp[2]);
+  // A PPS repeated unchanged (e.g. before every IRAP picture) is already stored
+  const uint64_t hash = nalu_hash();
+  for (const auto& stored : m_pps_memory) {
+    if (stored.m_valid && stored.m_hash == hash) {
+      return;
+    }
+  }
+
+  Reader r = rbsp_reader();
 
   auto pps = parse_reduced_pps(r);
+  pps.m_hash = hash;
 
   m_pps_memory[pps.m_id] = pps;
 }
@@ -171,7 +94,8 @@ void Packet::parse_pps()
  *
  * \brief
  * Parse the general sequence parameter set RBSP as specified in Clause 7.3.2.2.1 of the H.265/HEVC standard.
- * The SPS is then stored in the array of sps in case the stream is using multiple versions of it.
+ * The SPS is then stored in the array of sps, indexed by its identifier, in case the stream is using multiple versions of it.
+ * An SPS identical to one already stored is not parsed again.
  *
  * \author
  * Matteo Naccari
@@ -179,13 +103,49 @@ void Packet::parse_pps()
 */
 void Packet::parse_sps()
 {
-  Reader r(&m_nalu.buf_rbsp[2]);
+  // An SPS repeated unchanged (e.g. before every IRAP picture) is already stored, with its derived values
+  const uint64_t hash = nalu_hash();
+  for (const auto& stored : m_sps_memory) {
+    if (stored.m_valid && stored.m_hash == hash) {
+      return;
+    }
+  }
+
+  Reader r = rbsp_reader();
 
   auto sps = parse_reduced_sps(r);
+  sps.m_hash = hash;
 
   m_sps_memory[sps.m_id] = sps;
 }
 
+/*!
+ *
+ * \brief
+ * Parses the parameter sets and the slice header of the NALU just read, as needed to know the slice type
+ *
+ * \author
+ * Matteo Naccari
+ *
+*/
+void Packet::parse()
+{
+  // Parse the general sequence parameter set whose information will be then need to decode the slice type
+  if (is_nalu_sps()) {
+    parse_sps();
+  }
+
+  // Parse the general picture parameter set whose information will be then needed to decode the slice type
+  if (is_nalu_pps()) {
+    parse_pps();
+  }
+
+  // Parse the slice type in case a special corruption modality is used
+  if (is_nalu_slice()) {
+    parse_slice_type();
+  }
+}
+
 /*!
  *
  * \brief
@@ -200,113 +160,39 @@ void Packet::parse_sps()
  *  \note Side-effect: Returns length of start-code in bytes.
  *
  * \note
- *   getpacket expects start codes at byte aligned positions in the file
+ *   getpacket expects start codes at byte aligned positions in the file.
+ *   The file is read in blocks by the AnnexBReader bound to it on the first call,
+ *   hence a packet must keep reading from the same stream until the end of it.
  *
  *	\author
  *	Matteo Naccari (adapted from the H.264/AVC decoder reference software)
  */
-int Packet::get_packet(ifstream& bits)
+int Packet::get_packet(istream& bits)
 {
-  int info2, info3;
-  uint32_t pos = 0;
-  int start_code_found, rewind;
-  vector<unsigned char> buf(m_nalu.max_size, 0);
-  int leading_zero_8bits_count = 0, trailing_zero_8bits = 0;
-
-  for (pos = 0; pos < m_nalu.max_size; pos++) {
-    bits.read(reinterpret_cast<char*>(&buf[pos]), 1);
-    if (bits.eof() || buf[pos] != 0) {
-      pos++;
-      break;
-    }
-  }
+  AnnexBUnit unit;
 
-  if (bits.eof()) {
-    if (pos == 0) {
-      return 0;
-    } else {
-      throw logic_error("getpacket: can't read start code");
-    }
+  if (m_reader.stream() != &bits) {
+    m_reader.attach(bits);
   }
 
-  if (buf[pos - 1] != 1) {
-    throw logic_error("getpacket: no Start Code at the begin of the NALU, return -1");
-  }
+  uint32_t bytes = m_reader.next(unit);
 
-  if (pos < 3) {
-    throw logic_error("getpacket: no Start Code at the begin of the NALU, return -1");
-  } else if (pos == 3) {
-    m_nalu.startcodeprefix_len = 3;
-    leading_zero_8bits_count = 0;
-  } else {
-    leading_zero_8bits_count = pos - 4;
-    m_nalu.startcodeprefix_len = 4;
+  if (bytes == 0) {
+    return 0;
   }
 
-  // the 1st byte stream NAL unit can has leading_zero_8bits, but subsequent ones are not
-  // allowed to contain it since these zeros(if any) are considered trailing_zero_8bits
-  // of the previous byte stream NAL unit.
-  if (!m_is_first_byte_stream_nalu && leading_zero_8bits_count > 0) {
-    throw logic_error("getpacket: The leading_zero_8bits syntax can only be present in the first byte stream NAL unit, return -1");
-  }
-  m_is_first_byte_stream_nalu = 0;
-
-  start_code_found = 0;
-  info2 = 0;
-  info3 = 0;
-
-  while (!start_code_found) {
-    if (bits.eof()) {
-      //Count the trailing_zero_8bits
-      while (buf[pos - 2 - trailing_zero_8bits] == 0) {
-        trailing_zero_8bits++;
-      }
-      m_nalu.len = (pos - 1) - m_nalu.startcodeprefix_len - leading_zero_8bits_count - trailing_zero_8bits;
-      memcpy(&m_nalu.buf[0], &buf[leading_zero_8bits_count + m_nalu.startcodeprefix_len], m_nalu.len);
-      m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
-      m_nalu.nal_unit_type = NaluType((m_nalu.buf[0]) >> 1);
-
-      return pos - 1;
-    }
-    bits.read(reinterpret_cast<char*>(&buf[pos++]), 1);
-    info3 = find_start_code(&buf[pos - 4], 3);
-    if (info3 != 1) {
-      info2 = find_start_code(&buf[pos - 3], 2);
-    }
-    start_code_found = (info2 == 1 || info3 == 1);
-  }
-
-  //Count the trailing_zero_8bits
-  if (info3 == 1) {	//if the detected start code is 00 00 01, trailing_zero_8bits is sure not to be present
-    while (buf[pos - 5 - trailing_zero_8bits] == 0) {
-      trailing_zero_8bits++;
-    }
-  }
-  // Here, we have found another start code (and read length of startcode bytes more than we should
-  // have.  Hence, go back in the file
-  rewind = 0;
-  if (info3 == 1) {
-    rewind = -4;
-  } else if (info2 == 1) {
-    rewind = -3;
-  } else {
-    // Should this be a game stopper?
-    cerr << " Panic: Error in next start code search \n";
-  }
+  m_nalu.startcodeprefix_len = unit.startcodeprefix_len;
+  m_nalu.len = unit.len;
+  m_nalu.buf = unit.data;
+  m_nalu.offset = unit.offset;
 
-  bits.seekg(rewind, ios::cur);
-  if (bits.fail() || bits.bad()) {
-    throw logic_error("Something went wrong when moving the file pointer by " + to_string(rewind) + " bytes in the bitstream file");
+  // An empty NALU keeps the header of the previous one
+  if (m_nalu.len > 0) {
+    m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
+    m_nalu.nal_unit_type = NaluType((m_nalu.buf[0]) >> 1);
   }
 
-  m_nalu.len = (pos + rewind) - m_nalu.startcodeprefix_len - leading_zero_8bits_count - trailing_zero_8bits;
-  memcpy(&m_nalu.buf[0], &buf[leading_zero_8bits_count + m_nalu.startcodeprefix_len], m_nalu.len);
-  m_nalu.forbidden_bit = (m_nalu.buf[0] >> 7) & 1;
-  m_nalu.nal_unit_type = NaluType((m_nalu.buf[0]) >> 1);
-
-  convert_to_rbsp();
-
-  return (pos + rewind);
+  return bytes;
 }
 
 /*!
@@ -320,10 +206,10 @@ int Packet::get_packet(ifstream& bits)
  *	\author
  *	Matteo Naccari (adapted from the H.264/AVC decoder reference software)
 */
-int Packet::write_packet(ofstream& ofs)
+int Packet::write_packet(NaluWriter& writer)
 {
+  static const uint8_t start_code[4] = { 0, 0, 0, 1 };
   int bits_written = 0;
-  unsigned char zero = 0, one = 1;
 
   if (m_nalu.forbidden_bit) {
     throw logic_error("Forbidden bit is not zero");
@@ -333,21 +219,38 @@ int Packet::write_packet(ofstream& ofs)
     throw logic_error("m_nalu.startcodeprefix_len == 3 || m_nalu.startcodeprefix_len == 4, violated");
   }
 
-  if (m_nalu.startcodeprefix_len > 3) {
-    ofs.write(reinterpret_cast<char*>(&zero), 1);
-    bits_written += 8;
-  }
-  ofs.write(reinterpret_cast<char*>(&zero), 1);
-  ofs.write(reinterpret_cast<char*>(&zero), 1);
-  ofs.write(reinterpret_cast<char*>(&one), 1);
-  bits_written += 24;
+  update_nalu_header();
+
+  // Start code and payload are gathered by the writer, which decides when they actually reach the file
+  writer.write(start_code + 4 - m_nalu.startcodeprefix_len, m_nalu.startcodeprefix_len, m_nalu.buf, m_nalu.len);
+  bits_written += (m_nalu.startcodeprefix_len + m_nalu.len) * 8;
+
+  return bits_written;
+}
 
-  m_nalu.buf[0] = (unsigned char)((m_nalu.forbidden_bit << 7) | (int(m_nalu.nal_unit_type)) << 1);
+/*!
+ *
+ *	\brief
+ *    Writes a NALU to the Annex B Byte Stream as the range of the bitstream file spanning its start code
+ *    and payload, which are written back unchanged by write_packet (see is_header_rewritten)
+ *
+ *	\return
+ *    number of bits written
+ *
+ *	\author
+ *	Matteo Naccari
+*/
+int Packet::copy_packet(NaluWriter& writer)
+{
+  if (m_nalu.forbidden_bit) {
+    throw logic_error("Forbidden bit is not zero");
+  }
 
-  ofs.write(reinterpret_cast<char*>(&m_nalu.buf[0]), m_nalu.len);
-  bits_written += m_nalu.len * 8;
+  if (!(m_nalu.startcodeprefix_len == 3 || m_nalu.startcodeprefix_len == 4)) {
+    throw logic_error("m_nalu.startcodeprefix_len == 3 || m_nalu.startcodeprefix_len == 4, violated");
+  }
 
-  ofs.flush();
+  writer.copy(m_nalu.offset - m_nalu.startcodeprefix_len, m_nalu.startcodeprefix_len + m_nalu.len);
 
-  return bits_written;
-}
\ No newline at end of file
+  return (m_nalu.startcodeprefix_len + m_nalu.len) * 8;
+}
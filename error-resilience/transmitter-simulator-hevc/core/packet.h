@@ -41,14 +41,15 @@
 #include <fstream>
 #include <vector>
 #include <cstdint>
-#include <map>
+#include <array>
 #include "reader.h"
 #include "syntax.h"
+#include "annexb_reader.h"
+#include "nalu_writer.h"
+#include "stream_hash.h"
 
 using namespace std;
 
-constexpr uint32_t nalu_max_size = 8000000;
-
 /*!
  *
  * \brief
@@ -60,27 +61,34 @@ constexpr uint32_t nalu_max_size = 8000000;
  * Matteo Naccari
 */
 class Packet {
-  int m_is_first_byte_stream_nalu;
+  AnnexBReader m_reader;
 
   NALU m_nalu;
-  map<uint32_t, ReducedPPS> m_pps_memory;
-  map<uint32_t, ReducedSPS> m_sps_memory;
+  array<ReducedPPS, max_num_pps> m_pps_memory;
+  array<ReducedSPS, max_num_sps> m_sps_memory;
 
   //! Type of the slice contained in the packet being transmitted
   SliceType m_slice_type = SliceType::INVALID_SLICE;
 
-  //! Allocates the memory space for a NALU
-  void alloc_nalu(int buffersize);
-
-  //! Finds the start code of an Annex B NALU
-  int find_start_code(unsigned char* Buf, int zeros_in_startcode);
-
-  void convert_to_rbsp();
+  //! Hash of the whole NALU, to recognise the parameter sets which are repeated unchanged
+  uint64_t nalu_hash() const
+  {
+    StreamHash h;
+    h.update(m_nalu.buf, m_nalu.len);
+    return h.digest();
+  }
+
+  //! Bit reader of the RBSP following the two bytes of the NALU header. The emulation prevention bytes are
+  //! stripped out by the reader, only as far as the parsing goes
+  Reader rbsp_reader() const
+  {
+    return m_nalu.len > 2 ? Reader(m_nalu.buf + 2, m_nalu.len - 2) : Reader(nullptr, 0);
+  }
 
 public:
 
-  //!	Packet constructor, just allocates memory for a coded packet (NALU)
-  Packet() { alloc_nalu(nalu_max_size); }
+  //!	Packet constructor, the NALU payload is a view on the data read by the AnnexB reader
+  Packet() {}
 
   //! Packet destructor
   ~Packet() {}
@@ -91,13 +99,45 @@ public:
   bool is_nalu_pps() { return m_nalu.is_pps(); }
   bool is_nalu_sps() { return m_nalu.is_sps(); }
   SliceType get_slice_type() { return m_slice_type; }
+  const ReducedSPS& get_sps(uint32_t id) const { return m_sps_memory[id]; }
+  const ReducedPPS& get_pps(uint32_t id) const { return m_pps_memory[id]; }
   void parse_slice_type();
   void parse_pps();
   void parse_sps();
 
-  int get_packet(ifstream& bits);
-  int write_packet(ofstream& ofs);
+  //! Parses the parameter sets and the slice header of the NALU just read, as needed to know the slice type
+  void parse();
+
+  int get_packet(istream& bits);
+  int write_packet(NaluWriter& writer);
+  int copy_packet(NaluWriter& writer);
   NaluType get_nalu_type() { return m_nalu.get_nalu_type(); }
+  const NALU& get_nalu() const { return m_nalu; }
+
+  //! Number of bytes preceding the NALU payload which are needed to write the packet again: none for Annex B
+  uint32_t get_prefix_len() const { return 0; }
+
+  //! Makes the packet carry a NALU read beforehand, e.g. from the parsed bitstream of the batch mode
+  void set_nalu(const NALU& nalu) { m_nalu = nalu; }
+
+  //! Writes the NALU header fields back into the first byte of the payload. The byte is only stored when
+  //! it changes, so that the payloads shared by concurrent realizations are just read
+  void update_nalu_header()
+  {
+    if (m_nalu.len > 0) {
+      const uint8_t header = nalu_header();
+      if (m_nalu.buf[0] != header) {
+        m_nalu.buf[0] = header;
+      }
+    }
+  }
+
+  //! First byte of the payload as written by the packet, built from the NALU header fields
+  uint8_t nalu_header() const { return (uint8_t)((m_nalu.forbidden_bit << 7) | (int(m_nalu.nal_unit_type)) << 1); }
+
+  //! True if update_nalu_header is going to change the first byte of the payload (i.e. the most significant
+  //! bit of nuh_layer_id is set), hence the packet written differs from the bytes read
+  bool is_header_rewritten() const { return m_nalu.len > 0 && m_nalu.buf[0] != nalu_header(); }
 };
 
 #endif
\ No newline at end of file
@@ -36,9 +36,7 @@
 */
 
 #include "parameters.h"
-#include <regex>
 #include <iostream>
-#include <fstream>
 
 /*!
  *
@@ -52,11 +50,12 @@
  * Matteo Naccari
  *
 */
-Parameters::Parameters(const char** argv) 
-  : m_bitstream_original(argv[1])
-  , m_bitstream_transmitted(argv[2])
-  , m_loss_pattern_file(argv[3])
+Parameters::Parameters(const char** argv)
 {
+  m_bitstream_original = argv[1];
+  m_bitstream_transmitted = argv[2];
+  m_loss_pattern_file = argv[3];
+
   m_offset = stoi(argv[4]);
 
   m_modality = stoi(argv[5]);
@@ -67,7 +66,8 @@ Parameters::Parameters(const char** argv)
 /*!
  *
  * \brief
- * Second constructor whereby the parameters are passed via a configuration file
+ * Second constructor whereby the parameters are passed via a configuration file, one per line in the order
+ * of the command line. Options can be given in any place of the file
  *
  * \param
  * argv, name of the configuration file
@@ -78,93 +78,28 @@ Parameters::Parameters(const char** argv)
 */
 Parameters::Parameters(const char* argv)
 {
-  string line;
-  int i = 0;
-  ifstream fin;
-  regex pattern_str("[^ ]+");
-  regex pattern_nr("[+-]?[0-9]+");
-  smatch match;
-
-  fin.open(argv, ifstream::in);
-
-  if (!fin) {
-    throw runtime_error("Cannot open config file " + string(argv) + " abort");
-  }
+  const vector<string> lines = read_config_file(argv);
 
-  while (getline(fin, line, '\n')) {
-    if (valid_line(line)) {
-      switch (i) {
+  for (size_t i = 0; i < lines.size(); i++) {
+    switch (i) {
       case 0:
-        regex_search(line, match, pattern_str);
-        m_bitstream_original = match[0];
+        m_bitstream_original = config_string(lines[i]);
         break;
       case 1:
-        regex_search(line, match, pattern_str);
-        m_bitstream_transmitted = match[0];
+        m_bitstream_transmitted = config_string(lines[i]);
         break;
       case 2:
-        regex_search(line, match, pattern_str);
-        m_loss_pattern_file = match[0];
+        m_loss_pattern_file = config_string(lines[i]);
         break;
       case 3:
-        regex_search(line, match, pattern_nr);
-        m_offset = stoi(match[0]);
+        m_offset = config_number(lines[i]);
         break;
       case 4:
-        regex_search(line, match, pattern_nr);
-        m_modality = stoi(match[0]);
+        m_modality = config_number(lines[i]);
         break;
       default:
-        cout << "Something wrong: (?)" << line << endl;
-      }
-      i++;
+        cerr << "Something wrong: (?)" << lines[i] << endl;
     }
   }
   check_parameters();
 }
-
-/*!
- *
- * \brief
- * Reads a valid line from the configuration file. A valid line is a text line
- * that does not start with the following characters: #, carriage return, space or
- * new line
- *
- * \param
- * line a char array containing the current line read from the configuration file
- *
- * \return
- * True if the current line is valid line
- * False otherwise
- *
- * \author
- * Matteo Naccari
-*/
-bool Parameters::valid_line(const string& line)
-{
-  if (line.length() == 0 || line.at(0) == '\r' || line.at(0) == '#' || line.at(0) == ' ' || line.at(0) == '\n') {
-    return 0;
-  }
-  return 1;
-}
-
-/*!
- *
- * \brief
- * Checks the compliance of the input parameters. A fault tolerant policy is adopted, i.e. only warnings are issued and the default values
- * are set accordingly
- *
- * \author
- * Matteo Naccari
-*/
-void Parameters::check_parameters()
-{
-  if (m_offset < 0) {
-    cerr << "Warning! Offset = " << m_offset << " is not allowed, set it to zero\n";
-    m_offset = 0;
-  }
-  if (!(0 <= m_modality && m_modality <= 2)) {
-    cerr << "Warning! Modality = " << m_modality << " is not allowed, set it to zero\n";
-    m_modality = 0;
-  }
-}
\ No newline at end of file
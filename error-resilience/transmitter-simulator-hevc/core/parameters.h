@@ -38,25 +38,21 @@
 #ifndef H_PARAMETERS_
 #define H_PARAMETERS_
 
-#include <string>
+#include "parameters_base.h"
 
 using namespace std;
 
 /*!
  *
  *	\brief
- *	Models the parameters related to the transmission conditions
+ *	Models the parameters related to the transmission conditions. The bitstream is always given in Annex B format,
+ *	hence neither the command line nor the configuration file give a packet type
  *
  *	\author
  *	Matteo Naccari
  *
 */
-class Parameters {
-private:
-  string m_bitstream_original, m_bitstream_transmitted, m_loss_pattern_file;
-  int m_modality, m_offset;
-  bool valid_line(const string& line);
-  void check_parameters();
+class Parameters : public ParametersBase {
 
 public:
   //! First constructor: the parameters are passed through command line
@@ -67,12 +63,8 @@ public:
 
   ~Parameters() {};
 
-  const string& get_bitstream_original_filename() const { return m_bitstream_original; }
-  const string& get_bitstream_transmitted_filename() const { return m_bitstream_transmitted; }
-  const string& get_loss_pattern_filename() const { return m_loss_pattern_file; }
-  int get_modality() const { return m_modality; }
-  int get_offset() const { return m_offset; }
+  //! Packetization of the bitstream, always Annex B (1) as numbered by the NALU index
+  int get_packet_type() const { return 1; }
 };
 
 #endif
-
@@ -39,74 +39,179 @@
 #define H_READER_
 
 #include <cstdint>
+#include <cstddef>
 #include <string>
+#include <stdexcept>
+#include "intrinsics.h"
 
 using namespace std;
 /*!
  *
  * \brief
- * Class modelling a bit reader from a memory buffer.
+ * Class modelling a bit reader over the EBSP of a NAL unit.
+ * The bits are served from a 64 bit cache, left aligned, which is refilled with up to eight bytes at a time.
+ * The emulation prevention bytes (i.e. 0x03 after two zero bytes) are dropped while the cache is refilled,
+ * so the RBSP is only extracted as far as it is read. The refill never reads beyond the end of the buffer:
+ * past the end the reader returns zero bits.
  *
  * \author
  * Matteo Naccari (adapted from the HEVC reference test Model (HM))
 */
 class Reader
 {
-  const uint8_t* m_buffer;
+  const uint8_t* m_buffer;     //! Next byte to be loaded in the cache
+  const uint8_t* m_end;
 
-  uint32_t m_buffer_idx;
+  uint64_t m_cache;            //! Bits to be read, starting from the most significant one
+  uint32_t m_cache_bits;       //! Number of valid bits in the cache
+  uint32_t m_zero_bytes;       //! Number of consecutive zero bytes loaded last, to spot emulation prevention bytes
+  uint32_t m_num_bits_read;
 
-  uint32_t m_num_held_bits;
-  uint8_t m_held_bits;
-  uint32_t  m_num_bits_read;
+  //! Flags the zero bytes of w: the most significant bit of each zero byte is set, all other bits are cleared
+  static uint64_t zero_bytes(uint64_t w)
+  {
+    const uint64_t low_bits = 0x7f7f7f7f7f7f7f7full;
+    return ~(((w & low_bits) + low_bits) | w | low_bits);
+  }
+
+  //! Loads whole bytes into the cache, at least 32 bits are available afterwards
+  void refill()
+  {
+    if (m_end - m_buffer >= 8) {
+      // Without two consecutive zero bytes there is no emulation prevention byte: a single load serves.
+      // The bits below the valid ones are loaded again by the next refill, with the same value
+      const uint64_t w = load_big_endian64(m_buffer);
+      const uint64_t zeros = zero_bytes(w);
+      if ((zeros & (zeros << 8)) == 0 && m_zero_bytes + (zeros >> 63) < 2) {
+        m_cache |= w >> m_cache_bits;
+        const uint32_t bytes = (64 - m_cache_bits) >> 3;
+        m_buffer += bytes;
+        m_cache_bits += bytes << 3;
+        m_zero_bytes = static_cast<uint32_t>(zeros >> (71 - 8 * bytes)) & 1;
+        return;
+      }
+    }
+
+    while (m_cache_bits <= 56 && m_buffer < m_end) {
+      const uint8_t b = *m_buffer++;
+      if (m_zero_bytes >= 2 && b == 0x03) {
+        m_zero_bytes = 0;
+        continue;
+      }
+      m_cache |= uint64_t(b) << (56 - m_cache_bits);
+      m_cache_bits += 8;
+      m_zero_bytes = b == 0 ? m_zero_bytes + 1 : 0;
+    }
+    if (m_buffer == m_end) {
+      // End of the buffer: the cache is padded with zeros
+      m_cache_bits = 64;
+    }
+  }
 
 public:
-  Reader(const uint8_t* b)
+  Reader(const uint8_t* b, size_t size)
     : m_buffer(b)
-    , m_buffer_idx(0)
-    , m_num_held_bits(0)
-    , m_held_bits(0)
+    , m_end(b + size)
+    , m_cache(0)
+    , m_cache_bits(0)
+    , m_zero_bytes(0)
     , m_num_bits_read(0)
   {}
 
+  uint32_t get_num_bits_read() const { return m_num_bits_read; }
+
+  //! Returns the next bits_to_read bits without consuming them, bits_to_read must be in [1, 32]
+  uint32_t peek_bits(uint32_t bits_to_read)
+  {
+    if (m_cache_bits < bits_to_read) {
+      refill();
+    }
+    return static_cast<uint32_t>(m_cache >> (64 - bits_to_read));
+  }
+
+  //! Consumes bits_to_skip bits, any number of bits can be skipped
+  void skip_bits(uint32_t bits_to_skip)
+  {
+    m_num_bits_read += bits_to_skip;
+    while (bits_to_skip > 32) {
+      if (m_cache_bits < 32) {
+        refill();
+      }
+      m_cache <<= 32;
+      m_cache_bits -= 32;
+      bits_to_skip -= 32;
+    }
+    if (bits_to_skip > 0) {
+      if (m_cache_bits < bits_to_skip) {
+        refill();
+      }
+      m_cache <<= bits_to_skip;
+      m_cache_bits -= bits_to_skip;
+    }
+  }
+
   uint32_t read_bits(uint32_t bits_to_read)
   {
     if (bits_to_read > 32) {
       throw logic_error("Cannot read: " + to_string(bits_to_read) + " bits in one go");
     }
+    if (bits_to_read == 0) {
+      return 0;
+    }
 
-    m_num_bits_read += bits_to_read;
-
-    uint32_t retval = 0;
-    if (bits_to_read <= m_num_held_bits) {
-      retval = m_held_bits >> (m_num_held_bits - bits_to_read);
-      retval &= ~(0xff << bits_to_read);
-      m_num_held_bits -= bits_to_read;
-      return retval;
+    if (m_cache_bits < bits_to_read) {
+      refill();
     }
 
-    bits_to_read -= m_num_held_bits;
-    retval = m_held_bits & ~(0xff << m_num_held_bits);
-    retval <<= bits_to_read;
+    const uint32_t retval = static_cast<uint32_t>(m_cache >> (64 - bits_to_read));
+    m_cache <<= bits_to_read;
+    m_cache_bits -= bits_to_read;
+    m_num_bits_read += bits_to_read;
 
-    uint32_t aligned_word = 0;
-    uint32_t num_bytes_to_load = (bits_to_read - 1) >> 3;
+    return retval;
+  }
 
-    switch (num_bytes_to_load) {
-      case 3: aligned_word = m_buffer[m_buffer_idx++] << 24;
-      case 2: aligned_word |= m_buffer[m_buffer_idx++] << 16;
-      case 1: aligned_word |= m_buffer[m_buffer_idx++] << 8;
-      case 0: aligned_word |= m_buffer[m_buffer_idx++];
+  /*!
+   *
+   * \brief
+   * Reads an Exponential-Golomb codeword with unsigned direct mapping, i.e. ue(v).
+   * Codewords up to 31 bits are decoded with a single count of the leading zeros of the cache
+   *
+   * \author
+   * Matteo Naccari
+  */
+  uint32_t read_ue()
+  {
+    if (m_cache_bits < 32) {
+      refill();
     }
 
-    uint32_t next_num_held_bits = (32 - bits_to_read) % 8;
+    const uint32_t leading_zeros = m_cache != 0 ? count_leading_zeros64(m_cache) : 64;
 
-    retval |= aligned_word >> next_num_held_bits;
+    if (leading_zeros < 16) {
+      const uint32_t len = 2 * leading_zeros + 1;
+      const uint32_t value = static_cast<uint32_t>(m_cache >> (64 - len)) - 1;
+      m_cache <<= len;
+      m_cache_bits -= len;
+      m_num_bits_read += len;
+      return value;
+    }
 
-    m_num_held_bits = next_num_held_bits;
-    m_held_bits = aligned_word;
+    // Long codewords: the prefix is skipped first, then the suffix is read
+    uint32_t prefix_length = 0;
+    while (read_bits(1) == 0) {
+      if (++prefix_length > 31) {
+        throw logic_error("Exp-Golomb codeword longer than 32 bits");
+      }
+    }
+    return read_bits(prefix_length) + ((1u << prefix_length) - 1);
+  }
 
-    return retval;
+  //! Reads an Exponential-Golomb codeword with signed mapping, i.e. se(v)
+  int32_t read_se()
+  {
+    const uint32_t code = read_ue();
+    return code & 1 ? static_cast<int32_t>((code >> 1) + 1) : -static_cast<int32_t>(code >> 1);
   }
 };
 #endif // !H_READER_
@@ -38,37 +38,92 @@
 #ifndef H_SIMULATOR_
 #define H_SIMULATOR_
 
-#include <fstream>
+#include <vector>
 #include "packet.h"
 #include "parameters.h"
+#include "simulator_engine.h"
 
 using namespace std;
 
 /*!
  *
  * \brief
- * The simulator class which models the bitstream transmission over an error prone channel
+ * Codec traits of H.265/HEVC for the simulation engine: the bitstream is made of Annex B NAL units only
+ * and the priority of a NALU is its TemporalId
  *
  * \author
  * Matteo Naccari
 */
-class Simulator {
+struct HevcCodec
+{
+  typedef ::Parameters Parameters;
+  typedef NALU Nalu;
+  typedef ::NaluType NaluType;
+  typedef ::SliceType SliceType;
+
+  static constexpr uint32_t index_codec = 2;
+  static constexpr bool has_packet_types = false;
+
+  //! Annex B, the only packetization
+  static constexpr int packet_type = 1;
+
+  static const char* packet_type_name(int) { return "AnnexB"; }
+
+  template <class Action>
+  static void with_packet_type(int, const Action& action) { action(PacketTag<Packet>()); }
+
+  static uint8_t get_priority(const NALU& nalu) { return nalu.len > 1 ? (nalu.buf[1] & 7) - 1 : 0; }
 
-private:
-  Packet m_packet;
-  const Parameters& m_param;
-  ifstream m_fp_bitstream;     //! Original bitstream
-  ofstream m_fp_tr_bitstream;  //! Transmitted (corrupted) bitstream
-  string m_loss_pattern;
-  int m_numchar;
+  //! The TemporalId is read from the payload, which is never modified
+  static void set_priority(NALU&, uint8_t) {}
 
-  void print_header();
+  //! Sub-layer non reference pictures have an even NAL unit type up to RSV_VCL_N14
+  static bool is_reference(const NALU& nalu) { return int(nalu.nal_unit_type) > 14 || int(nalu.nal_unit_type) % 2 == 1; }
+
+  static const char* slice_type_name(int slice_type)
+  {
+    const char* names[] = { "B", "P", "I" };
+    return 0 <= slice_type && slice_type < 3 ? names[slice_type] : "invalid";
+  }
+};
+
+// The engine is compiled once, in simulator.cpp
+extern template class SimulatorEngine<HevcCodec>;
+
+/*!
+ *
+ * \brief
+ * The simulator class which models the bitstream transmission over an error prone channel
+ *
+ * \author
+ * Matteo Naccari
+*/
+class Simulator : public SimulatorEngine<HevcCodec> {
 
 public:
-  Simulator(const Parameters& p);  //! Constructor with configuration parameters
-  ~Simulator() {}
-  void run_simulator();   //! Method to simulate the bitstream transmission
+  Simulator(const Parameters& p) : SimulatorEngine<HevcCodec>(p) {}  //! Constructor with configuration parameters
+
+  //! Library interface: transmits the bitstream over the channel, handing every packet transmitted over to the sink.
+  //! Neither parameters nor files are involved
+  using SimulatorEngine<HevcCodec>::transmit;
+  static void transmit(istream& bitstream, Channel channel, const PacketSink& sink)
+  {
+    transmit(bitstream, HevcCodec::packet_type, channel, sink);
+  }
+  static void transmit(const uint8_t* bitstream, size_t size, Channel channel, const PacketSink& sink)
+  {
+    transmit(bitstream, size, HevcCodec::packet_type, channel, sink);
+  }
+  static void transmit(const BitstreamReader& reader, Channel channel, const PacketSink& sink)
+  {
+    transmit(reader, HevcCodec::packet_type, channel, sink);
+  }
+
+  //! Library interface: transmits the bitstream held in memory over the channel, appending the transmitted one to the given buffer
+  static void transmit(const uint8_t* bitstream, size_t size, Channel channel, vector<uint8_t>& transmitted)
+  {
+    transmit(bitstream, size, HevcCodec::packet_type, channel, transmitted);
+  }
 };
 
 #endif
-
@@ -41,7 +41,6 @@
 #include <cstdint>
 #include <vector>
 #include <string>
-#include <map>
 #include <array>
 #include "reader.h"
 
@@ -167,11 +166,10 @@ struct NALU
 {
   int startcodeprefix_len = 0; //! 4 for parameter sets and first slice in picture, 3 for everything else (suggested)
   unsigned len = 0;            //! Length of the NAL unit (Excluding the start code, which does not belong to the NALU)
-  unsigned max_size = 0;       //! Nal Unit Buffer size
   int forbidden_bit = 0;       //! Should be always FALSE
-  vector<uint8_t> buf;         //! Contains the first byte followed by the EBSP
-  vector<uint8_t> buf_rbsp;    //! Payload with emulation prevention codes stripped out
+  uint8_t* buf = nullptr;      //! Contains the first byte followed by the EBSP (view on the buffer of the AnnexB reader)
   NaluType nal_unit_type = NaluType::NAL_UNIT_INVALID;  //! NALU_TYPE
+  uint64_t offset = 0;         //! Offset of the first byte in the bitstream file
 
   bool is_slice()
   {
@@ -204,6 +202,10 @@ struct NALU
   NaluType get_nalu_type() { return nal_unit_type; }
 };
 
+//! Number of sequence and picture parameter sets which can be stored (Clause 7.4.3.2 and 7.4.3.3 of the H.265/HEVC standard)
+constexpr uint32_t max_num_sps = 16;
+constexpr uint32_t max_num_pps = 64;
+
 /*!
  *
  * \brief
@@ -214,6 +216,8 @@ struct NALU
 */
 struct ReducedPPS
 {
+  bool m_valid = false;  //! True once the PPS has been parsed
+  uint64_t m_hash = 0;   //! Hash of the NAL unit the PPS has been parsed from
   uint32_t m_id = 0;
   uint32_t m_sps_id = 0;
   bool m_dependent_slice_segments_enabled_flag = false;
@@ -230,6 +234,8 @@ struct ReducedPPS
 */
 struct ReducedSPS
 {
+  bool m_valid = false;  //! True once the SPS has been parsed
+  uint64_t m_hash = 0;   //! Hash of the NAL unit the SPS has been parsed from
   uint32_t m_id = 0;
   uint32_t m_pic_width_in_luma_samples = 0;
   uint32_t m_pic_height_in_luma_samples = 0;
@@ -237,6 +243,8 @@ struct ReducedSPS
   uint32_t m_log2_diff_max_min_luma_coding_block_size = 0;
   uint32_t m_cu_height = 0;
   uint32_t m_cu_width = 0;
+  uint32_t m_num_ctus = 0;                     //! Number of CTUs in a picture
+  uint32_t m_slice_segment_address_bits = 0;   //! Length of slice_segment_address, i.e. Ceil(Log2(m_num_ctus))
 };
 
 /*!
@@ -259,7 +267,7 @@ struct ReducedSPS
  *  \author
  *  Matteo Naccari
 */
-inline uint32_t u(Reader& reader, int bits, const string& description = "")
+inline uint32_t u(Reader& reader, int bits, const char* /*description*/ = "")
 {
   return reader.read_bits(bits);
 }
@@ -280,22 +288,31 @@ inline uint32_t u(Reader& reader, int bits, const string& description = "")
  *
  *  \return the slice type casted to the SliceType enumeration
 */
-inline uint32_t ue(Reader& reader, const string& description = "")
+inline uint32_t ue(Reader& reader, const char* /*description*/ = "")
 {
-  uint32_t value = 0;
-  auto code = reader.read_bits(1);
-
-  if (code == 0) {
-    uint32_t prefix_length = 1;
-    while (reader.read_bits(1) == 0) {
-      prefix_length++;
-    }
-
-    value = reader.read_bits(prefix_length);
-    value += (1 << prefix_length) - 1;
-  }
+  return reader.read_ue();
+}
 
-  return value;
+/*!
+ *
+ *  \brief
+ *  Performs the Exponential-Golomb decoding with signed mapping
+ *
+ *  \param reader
+ *  Bit reader
+ *
+ *  \param description
+ *  Description of the syntax element associated with the reading (for code readability purposes)
+ *
+ *  \return
+ *  The signed integer decoded according to the Exponential Golomb decoding
+ *
+ *  \author
+ *  Matteo Naccari
+*/
+inline int32_t se(Reader& reader, const char* /*description*/ = "")
+{
+  return reader.read_se();
 }
 
 /*!
@@ -323,7 +340,7 @@ inline uint32_t ue(Reader& reader, const string& description = "")
  * Matteo Naccari
  *
 */
-inline SliceType parse_slice_header(Reader& r, const int int_nalu_type, const map<uint32_t, ReducedPPS>& pps_memory, const map<uint32_t, ReducedSPS>& sps_memory)
+inline SliceType parse_slice_header(Reader& r, const int int_nalu_type, const array<ReducedPPS, max_num_pps>& pps_memory, const array<ReducedSPS, max_num_sps>& sps_memory)
 {
   uint32_t value;
   bool dependent_slice_segment_flag = false;
@@ -335,21 +352,19 @@ inline SliceType parse_slice_header(Reader& r, const int int_nalu_type, const ma
     value = u(r, 1, "no_output_of_prior_pics_flag");
   }
   value = ue(r, "slice_pic_parameter_set_id");
-  const auto& pps = pps_memory.find(value)->second;
+  if (value >= max_num_pps || !pps_memory[value].m_valid || !sps_memory[pps_memory[value].m_sps_id].m_valid) {
+    // The parameter sets of the slice have not been received
+    return slice_type;
+  }
+  const auto& pps = pps_memory[value];
 
   if (!first_slice_segment_in_pic_flag) {
     if (pps.m_dependent_slice_segments_enabled_flag) {
       dependent_slice_segment_flag = u(r, 1, "dependent_slice_segment_flag");
     }
 
-    const auto& sps = sps_memory.find(pps.m_sps_id)->second;
-    int32_t total_ctus = ((sps.m_pic_width_in_luma_samples + sps.m_cu_width - 1) / sps.m_cu_width) * ((sps.m_pic_height_in_luma_samples + sps.m_cu_height - 1) / sps.m_cu_height);
-    int32_t bits_seg_address = 0;
-    while (total_ctus > (1 << bits_seg_address)) {
-      bits_seg_address++;
-    }
-
-    value = u(r, bits_seg_address, "slice_segment_address");
+    const auto& sps = sps_memory[pps.m_sps_id];
+    value = u(r, sps.m_slice_segment_address_bits, "slice_segment_address");
   }
 
   if (!dependent_slice_segment_flag) {
@@ -382,10 +397,17 @@ inline ReducedPPS parse_reduced_pps(Reader& r)
 {
   ReducedPPS pps;
   pps.m_id = ue(r, "pps_pic_parameter_set_id");
+  if (pps.m_id >= max_num_pps) {
+    throw logic_error("Invalid pps_pic_parameter_set_id: " + to_string(pps.m_id));
+  }
   pps.m_sps_id = ue(r, "pps_seq_parameter_set_id");
+  if (pps.m_sps_id >= max_num_sps) {
+    throw logic_error("Invalid pps_seq_parameter_set_id: " + to_string(pps.m_sps_id) + " in PPS " + to_string(pps.m_id));
+  }
   pps.m_dependent_slice_segments_enabled_flag = u(r, 1, "dependent_slice_segments_enabled_flag");
   auto value = u(r, 1, "output_flag_present_flag");
   pps.m_num_extra_slice_header_bits = u(r, 3, "num_extra_slice_header_bits");
+  pps.m_valid = true;
 
   return pps;
 }
@@ -411,8 +433,10 @@ inline void profile_tier(Reader& r)
   value = u(r, 1, "tier_flag");
   auto profile = Profile(u(r, 5, "profile_idc"));
 
+  // The 32 flags are read in one go, the first one being the most significant bit
+  const uint32_t compatibility_flags = u(r, 32, "profile_compatibility_flag[0..31]");
   for (uint32_t j = 0; j < 32; j++) {
-    profile_compatibility_flag[j] = bool(u(r, 1, "profile_compatibility_flag[j]"));
+    profile_compatibility_flag[j] = bool((compatibility_flags >> (31 - j)) & 1);
   }
 
   value = u(r, 1, "progressive_source_flag");
@@ -433,22 +457,16 @@ inline void profile_tier(Reader& r)
     value = u(r, 1, "one_picture_only_constraint_flag");
     value = u(r, 1, "lower_bit_rate_constraint_flag");
 
-    value = u(r, 16, "reserved_zero_34bits[0..15]");
-    value = u(r, 16, "reserved_zero_34bits[16..31]");
-    value = u(r, 2, "reserved_zero_34bits[32..33]");
+    r.skip_bits(34); // reserved_zero_34bits
   }
   else {
     if (profile == Profile::MAIN10 || profile_compatibility_flag[int(Profile::MAIN10)]) {
       value = u(r, 7,"reserved_zero_7bits");
       value = u(r, 1, "one_picture_only_constraint_flag");
-      value = u(r, 16, "reserved_zero_35bits[0..15]");
-      value = u(r, 16, "reserved_zero_35bits[16..31]");
-      value = u(r, 3, "reserved_zero_35bits[32..34]");
+      r.skip_bits(35); // reserved_zero_35bits
     }
     else {
-      value = u(r, 16, "reserved_zero_43bits[0..15]");
-      value = u(r, 16, "reserved_zero_43bits[16..31]");
-      value = u(r, 11, "reserved_zero_43bits[32..42]");
+      r.skip_bits(43); // reserved_zero_43bits
     }
   }
 
@@ -541,6 +559,9 @@ inline ReducedSPS parse_reduced_sps(Reader& r)
 
   profile_tier_level(r, true, max_sub_layers_m1);
   sps.m_id = ue(r, "sps_seq_parameter_set_id");
+  if (sps.m_id >= max_num_sps) {
+    throw logic_error("Invalid sps_seq_parameter_set_id: " + to_string(sps.m_id));
+  }
 
   ChromaFormat chf = ChromaFormat(ue(r, "chroma_format_idc"));
 
@@ -577,6 +598,13 @@ inline ReducedSPS parse_reduced_sps(Reader& r)
   sps.m_cu_width = 1 << log2MaxCuSize;
   sps.m_cu_height = 1 << log2MaxCuSize;
 
+  // Values derived once per SPS, rather than for every slice referring to it
+  sps.m_num_ctus = ((sps.m_pic_width_in_luma_samples + sps.m_cu_width - 1) / sps.m_cu_width) * ((sps.m_pic_height_in_luma_samples + sps.m_cu_height - 1) / sps.m_cu_height);
+  while (sps.m_num_ctus > (1u << sps.m_slice_segment_address_bits)) {
+    sps.m_slice_segment_address_bits++;
+  }
+  sps.m_valid = true;
+
   return sps;
 }
 
@@ -57,8 +57,28 @@ void inline_help()
 {
   cout << endl << endl << "\tTransmitter Simulator for the H.265/HEVC standard. Version " << VERSION << "\n\n";
   cout << "\tCopyright Matteo Naccari" << endl << endl;
-  cout << "\tUsage (1): transmitter-simulator-hevc <in_bitstream> <out_bitstream> <loss_pattern_file> <offset> <modality>\n\n";
-  cout << "\tUsage (2): transmitter-simulator-hevc <configuration_file>\n\n";
+  cout << "\tUsage (1): transmitter-simulator-hevc <in_bitstream> <out_bitstream> <loss_pattern_file> <offset> <modality> [options]\n\n";
+  cout << "\tUsage (2): transmitter-simulator-hevc <configuration_file> [options]\n\n";
+  cout << "\tOptions:\n";
+  cout << "\t  --flush-size <bytes>  amount of transmitted data buffered before each write to disk (default 1048576)\n";
+  cout << "\t  --offsets <list>      batch mode: comma separated offsets or ranges first:last[:step], e.g. 0:490:10\n";
+  cout << "\t  --patterns <list>     batch mode: comma separated loss pattern files\n";
+  cout << "\t  --modalities <list>   batch mode: comma separated corruption modalities, appended to the output names as _m<modality>\n";
+  cout << "\t  --jobs <n>            batch mode: number of realizations simulated in parallel, 0 for one per hardware thread (default 1)\n";
+  cout << "\t  --index <on|off>      reads the NAL units from the <bitstream>.nalidx index, built on the first run (default off)\n";
+  cout << "\t  --pipeline <on|off>   single run: reads, classifies and writes the NAL units in three concurrent threads (default off)\n";
+  cout << "\t  --io-uring <on|off>   batch mode: writes the realizations through io_uring on Linux, the portable path elsewhere (default off)\n";
+  cout << "\t  --copy-ranges <on|off> copies the Annex B NAL units transmitted from the input with copy_file_range on Linux (default off)\n";
+  cout << "\t  --stats <file> writes the NAL units read, written and dropped, the loss pattern positions and the time of each stage as JSON (- for the standard output)\n";
+  cout << "\t  --trace <file> writes the time and the hardware counters of every NAL unit operation in the Chrome trace format (builds with SIMULATOR_TRACING only)\n";
+  cout << "\t  --dedupe <off|link|manifest> batch mode: writes once the realizations transmitting the same NAL units, the others become hard links (link) or are not written (manifest), all listed in <out_bitstream>.manifest (default off)\n";
+  cout << "\tThe loss pattern file can be replaced by a loss generator, for example:\n";
+  cout << "\t  bernoulli:plr=3:seed=1                          independent losses with 3% packet loss rate\n";
+  cout << "\t  gilbert:plr=3:burst=2[:good=0][:bad=1]:seed=1   Gilbert-Elliott channel (loss probabilities in the good and bad states)\n";
+  cout << "\t  markov:loss=0/1:p=0.98/0.02/0.3/0.7:seed=1      Markov channel (loss probability of each state and transition matrix by rows)\n";
+  cout << "\tA bitstream named - is read from the standard input or written to the standard output, for example:\n";
+  cout << "\t  encoder | transmitter-simulator-hevc - - error_plr_3 0 0 | decoder\n";
+  cout << "\tIn batch mode the bitstream is parsed once and each realization is written to <out_bitstream>_<pattern>_<offset>\n\n";
   cout << "See the configuration file for further information on parameters.\n\n";
 }
 
@@ -71,6 +91,8 @@ void inline_help()
  *      occurred whilst the character '1' means that a channel error
  *      occurred. A burst of channel errors is defined as a contiguous sequence of 2
  *      or more characters '1'.
+ *      The same pattern can be given in the packed format (one bit per packet)
+ *      written by the pattern-packer tool, which is memory mapped rather than read.
  *
  *  \author
  *  Matteo Naccari
@@ -82,10 +104,12 @@ int main(int argc, char** argv)
   unique_ptr<Simulator> sim;
 
   try {
-    if (argc == 2) {
+    if (argc == 2 || (argc > 2 && Parameters::is_option(argv[2]))) {
       p = make_unique<Parameters>((const char*)(argv[1]));
-    } else if (argc == 6) {
+      p->parse_options(argc, (const char**)(argv), 2);
+    } else if (argc >= 6) {
       p = make_unique<Parameters>((const char**)(argv));
+      p->parse_options(argc, (const char**)(argv), 6);
     } else {
       inline_help();
       return EXIT_SUCCESS;
@@ -93,7 +117,7 @@ int main(int argc, char** argv)
 
     sim = make_unique<Simulator>(*p);
     sim->run_simulator();
-  } catch (exception e) {
+  } catch (exception& e) {
     cerr << "Something went wrong: " << e.what() << endl;
     return EXIT_FAILURE;
   }
@@ -40,12 +40,24 @@
 #include "packet.h"
 #include "simulator.h"
 #include "md5.h"
+#include "reader.h"
+#include "syntax.h"
+#include "nalu_index.h"
+#include "loss_pattern.h"
+#include "nalu_tracer.h"
 #include <string>
 #include <fstream>
 #include <vector>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <random>
+#include <algorithm>
+#include <streambuf>
+#include <regex>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -88,6 +100,146 @@ TEST(TestParameter, TestParametersInitialisationFromFile)
   EXPECT_EQ(0, p.get_offset());
 }
 
+TEST(TestParameter, TestParametersOptionsFromFile)
+{
+  const string parameter_file_name = "config_options.txt";
+
+  ofstream ofs(parameter_file_name.c_str());
+  ofs << "# Options can be given anywhere in the file\n";
+  ofs << "str.265\n--flush-size 65536\nstr_err.265\nerror_plr_3\n0\n0\n";
+  ofs << "--offsets 0:20:10\t# batch mode: offsets of the realizations\n";
+  ofs << "--index on\t\t# reads the NAL units from the <bitstream>.nalidx index, built on the first run\n";
+  ofs.close();
+
+  Parameters p(parameter_file_name.c_str());
+
+  remove(parameter_file_name.c_str());
+
+  EXPECT_TRUE("str_err.265" == p.get_bitstream_transmitted_filename());
+  EXPECT_EQ(65536, p.get_flush_size());
+  EXPECT_EQ(vector<int>({ 0, 10, 20 }), p.get_offsets());
+  EXPECT_TRUE(p.get_use_index());
+}
+
+TEST(TestParameter, TestStandardStreamsRejectIndexAndBatch)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "-", "-", "error_plr_3", "0", "0", "--index", "on", "--offsets", "0:10" };
+
+  Parameters from_stdin(cmdLine);
+  EXPECT_THROW(from_stdin.parse_options(8, cmdLine, 6), logic_error);
+
+  Parameters to_stdout(cmdLine);
+  EXPECT_THROW(to_stdout.parse_options(10, cmdLine, 8), logic_error);
+
+  Parameters piped(cmdLine);
+  EXPECT_TRUE("-" == piped.get_bitstream_original_filename());
+  EXPECT_TRUE("-" == piped.get_bitstream_transmitted_filename());
+}
+
+//////////////////////////////////////////////////////////////////
+// Bit reader module tests
+//////////////////////////////////////////////////////////////////
+
+//! Inserts the emulation prevention bytes in a RBSP, as an encoder does
+static vector<uint8_t> to_ebsp(const vector<uint8_t>& rbsp)
+{
+  vector<uint8_t> ebsp;
+  int zero_bytes = 0;
+
+  for (const auto byte : rbsp) {
+    if (zero_bytes == 2 && byte <= 0x03) {
+      ebsp.push_back(0x03);
+      zero_bytes = 0;
+    }
+    ebsp.push_back(byte);
+    zero_bytes = byte == 0 ? zero_bytes + 1 : 0;
+  }
+
+  return ebsp;
+}
+
+TEST(TestReader, TestReadBitsMatchesBitByBitReading)
+{
+  vector<uint8_t> buffer(1000);
+  mt19937 rng(2021);
+  for (auto& byte : buffer) {
+    // Plenty of zero bytes, for the emulation prevention bytes to be stripped out by the reader
+    byte = rng() % 4 == 0 ? static_cast<uint8_t>(rng() % 4) : static_cast<uint8_t>(rng());
+  }
+
+  const vector<uint8_t> ebsp = to_ebsp(buffer);
+  Reader r(ebsp.data(), ebsp.size());
+  size_t position = 0;
+
+  while (position + 64 < buffer.size() * 8) {
+    const uint32_t bits = rng() % 33;
+    uint32_t expected = 0;
+    for (uint32_t b = 0; b < bits; b++, position++) {
+      expected = (expected << 1) | ((buffer[position >> 3] >> (7 - (position & 7))) & 1);
+    }
+    if (bits > 0 && rng() % 4 == 0) {
+      EXPECT_EQ(expected, r.peek_bits(bits));
+    }
+    ASSERT_EQ(expected, r.read_bits(bits)) << position;
+  }
+
+  // Beyond the end of the buffer the reader gives zero bits
+  r.skip_bits(static_cast<uint32_t>(buffer.size() * 8 - position));
+  EXPECT_EQ(0u, r.read_bits(32));
+  EXPECT_EQ(buffer.size() * 8 + 32, r.get_num_bits_read());
+}
+
+TEST(TestReader, TestExpGolombDecoding)
+{
+  vector<uint8_t> buffer;
+  vector<uint32_t> values;
+  uint64_t bit_buffer = 0;
+  int num_bits = 0;
+  mt19937 rng(1979);
+
+  auto put_bits = [&](uint32_t value, int bits) {
+    for (int b = bits - 1; b >= 0; b--) {
+      bit_buffer = (bit_buffer << 1) | ((value >> b) & 1);
+      if (++num_bits == 8) {
+        buffer.push_back(static_cast<uint8_t>(bit_buffer));
+        bit_buffer = 0;
+        num_bits = 0;
+      }
+    }
+  };
+
+  // Short and long codewords, up to the longest one of 32 bits prefix excluded
+  for (int i = 0; i < 2000; i++) {
+    const uint32_t value = i % 100 == 0 ? 0xfffffffeu - i : rng() >> (rng() % 32);
+    const uint64_t code = uint64_t(value) + 1;
+    int len = 0;
+    while ((code >> (len + 1)) != 0) {
+      len++;
+    }
+    put_bits(0, len);
+    put_bits(1, 1);
+    put_bits(static_cast<uint32_t>(code), len);
+    values.push_back(value);
+  }
+  put_bits(0, 7);
+
+  const vector<uint8_t> ebsp = to_ebsp(buffer);
+  Reader r(ebsp.data(), ebsp.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    if (i % 2) {
+      const int32_t expected = values[i] & 1 ? int32_t((values[i] >> 1) + 1) : -int32_t(values[i] >> 1);
+      ASSERT_EQ(expected, se(r)) << i;
+    } else {
+      ASSERT_EQ(values[i], ue(r)) << i;
+    }
+  }
+
+  // A run of zeros longer than any codeword
+  const vector<uint8_t> zeros(16, 0);
+  Reader z(zeros.data(), zeros.size());
+  EXPECT_THROW(ue(z), logic_error);
+}
+
 //////////////////////////////////////////////////////////////////
 // AnnexB packet module tests
 //////////////////////////////////////////////////////////////////
@@ -234,6 +386,52 @@ TEST(TestPacketAnnexB, TestPacketIsSliceI)
 }
 
 
+TEST(TestPacketAnnexB, TestRepeatedParameterSetsAreKept)
+{
+  const string sps_pps_file_name = "../unit-tests/sps_pps.bin";
+  Packet p;
+
+  // The second SPS and PPS are identical to the first ones
+  ifstream ifs_sps_pps[2];
+  for (auto& ifs : ifs_sps_pps) {
+    ifs.open(sps_pps_file_name.c_str(), ios::binary);
+    p.get_packet(ifs);
+    p.parse_sps();
+    p.get_packet(ifs);
+    p.parse_pps();
+  }
+
+  const ReducedPPS& pps = p.get_pps(0);
+  const ReducedSPS& sps = p.get_sps(pps.m_sps_id);
+  EXPECT_TRUE(pps.m_valid);
+  EXPECT_TRUE(sps.m_valid);
+
+  // Derived values, computed once when the SPS is parsed
+  const uint32_t width_in_ctus = (sps.m_pic_width_in_luma_samples + sps.m_cu_width - 1) / sps.m_cu_width;
+  const uint32_t height_in_ctus = (sps.m_pic_height_in_luma_samples + sps.m_cu_height - 1) / sps.m_cu_height;
+  EXPECT_EQ(width_in_ctus * height_in_ctus, sps.m_num_ctus);
+  EXPECT_EQ(uint32_t(ceil(log2(double(sps.m_num_ctus)))), sps.m_slice_segment_address_bits);
+}
+
+TEST(TestPacketAnnexB, TestSliceWithoutParameterSetsIsInvalid)
+{
+  const string nalu_file_name = "nalu_stream.bin";
+  vector<uint8_t> slice_i_stream = { 0, 0, 0, 1, int(NaluType::NAL_UNIT_CODED_SLICE_IDR_W_RADL) << 1, 1, 175, 0, 0, 0, 1 };
+
+  ofstream ofs(nalu_file_name.c_str(), ios::binary);
+  ofs.write(reinterpret_cast<char*>(&slice_i_stream[0]), slice_i_stream.size());
+  ofs.close();
+
+  ifstream ifs(nalu_file_name.c_str(), ios::binary);
+  Packet p;
+  p.get_packet(ifs);
+  p.parse_slice_type();
+  ifs.close();
+  remove(nalu_file_name.c_str());
+
+  EXPECT_EQ(SliceType::INVALID_SLICE, p.get_slice_type());
+}
+
 TEST(TestPacketAnnexB, TestPacketIsSliceP)
 {
   const string sps_pps_file_name = "../unit-tests/sps_pps.bin";
@@ -409,6 +607,536 @@ TEST(TestSimulator, TestPlr10GivesTheExpectMD5)
   remove("bitstream_test_err.265");
 }
 
+TEST(TestSimulator, TestPipelinedRunGivesTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "10", "0",
+                            "--pipeline", "on" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  Parameters p(cmdLine);
+  p.parse_options(8, cmdLine, 6);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  remove("bitstream_test_err.265");
+}
+
+TEST(TestSimulator, TestCopiedRangesGiveTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "10", "0",
+                            "--copy-ranges", "on" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  Parameters p(cmdLine);
+  p.parse_options(8, cmdLine, 6);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  remove("bitstream_test_err.265");
+}
+
+TEST(TestSimulator, TestLibraryInterfaceReadsThroughCallback)
+{
+  ifstream ifs("../unit-tests/bitstream_test.265", ios::binary);
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  // The bitstream is handed over in small blocks, as a producer would do
+  BitstreamReader reader = [&](uint8_t* data, size_t size) {
+    ifs.read(reinterpret_cast<char*>(data), min(size, size_t(1000)));
+    return static_cast<size_t>(ifs.gcount());
+  };
+
+  LossPattern loss_pattern("../error_plr_10");
+  string data_err;
+  Simulator::transmit(reader, { LossPatternCursor(loss_pattern, 10), 0 }, [&](const uint8_t* data, size_t len) {
+    data_err.append(reinterpret_cast<const char*>(data), len);
+  });
+
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+}
+
+TEST(TestSimulator, TestStatsLeaveTheTransmittedBitstreamUnchanged)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "10", "0",
+                            "--pipeline", "on", "--stats", "bitstream_test_stats.json" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  Parameters p(cmdLine);
+  p.parse_options(10, cmdLine, 6);
+
+  Simulator s(p);
+  s.run_simulator();
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  const string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  ifs.open("bitstream_test_stats.json");
+  const string json = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  // The NAL units written are the ones of the transmitted bitstream, each one preceded by its start code
+  smatch match;
+  regex total("\"total\": \\{ \"read\": \\{ \"nalus\": ([0-9]+), \"bytes\": ([0-9]+) \\}, \"written\": \\{ \"nalus\": ([0-9]+), \"bytes\": ([0-9]+) \\}, "
+              "\"dropped\": \\{ \"nalus\": ([0-9]+), \"bytes\": ([0-9]+) \\} \\}");
+  ASSERT_TRUE(regex_search(json, match, total));
+  EXPECT_EQ(stoi(match[1]), stoi(match[3]) + stoi(match[5]));
+  EXPECT_LT(0, stoi(match[5]));
+  EXPECT_LE(stoul(match[4]) + 3 * stoul(match[3]), data_err.size());
+  EXPECT_GE(stoul(match[4]) + 4 * stoul(match[3]), data_err.size());
+
+  EXPECT_NE(string::npos, json.find("\"mode\": \"pipeline\""));
+  EXPECT_NE(string::npos, json.find("{ \"file\": \"../error_plr_10\", \"offset\": 10, \"modality\": 0"));
+  EXPECT_NE(string::npos, json.find("\"33\": { \"read\""));
+
+  remove("bitstream_test_err.265");
+  remove("bitstream_test_stats.json");
+}
+
+TEST(TestSimulator, TestTraceCoversEveryNalu)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "10", "0",
+                            "--trace", "bitstream_test_trace.json" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  Parameters p(cmdLine);
+  if (!tracing_compiled_in) {
+    EXPECT_THROW(p.parse_options(8, cmdLine, 6), logic_error);
+    return;
+  }
+  p.parse_options(8, cmdLine, 6);
+
+  Simulator s(p);
+  s.run_simulator();
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  const string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  ifs.open("bitstream_test_trace.json");
+  const string trace = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  // Every NAL unit is read and parsed, then written unless it is lost
+  auto count = [&](const string& text) {
+    size_t n = 0;
+    for (size_t pos = trace.find(text); pos != string::npos; pos = trace.find(text, pos + 1)) {
+      n++;
+    }
+    return n;
+  };
+  const size_t num_read = count("\"name\": \"get_packet\"");
+  EXPECT_LT(1u, num_read);
+  EXPECT_EQ(num_read - 1, count("\"name\": \"parse\""));
+  EXPECT_GT(num_read - 1, count("\"name\": \"write_packet\""));
+  EXPECT_LT(0u, count("\"name\": \"write_packet\""));
+  EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\": \"ns\", \"traceEvents\": ["));
+
+  remove("bitstream_test_err.265");
+  remove("bitstream_test_trace.json");
+}
+
+TEST(TestSimulator, TestPackedPlr10GivesTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "error_plr_10.bin", "10", "0" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  LossPattern::pack("../error_plr_10", "error_plr_10.bin");
+
+  Parameters p(cmdLine);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  remove("bitstream_test_err.265");
+  remove("error_plr_10.bin");
+}
+
+//! Stream buffer handing its data over in small chunks and unable to seek, as the one of a pipe
+class PipeBuffer : public streambuf
+{
+  string m_data;
+  size_t m_next;
+  size_t m_chunk;
+
+protected:
+  int_type underflow() override
+  {
+    if (m_next >= m_data.size()) {
+      return traits_type::eof();
+    }
+    const size_t len = min(m_chunk, m_data.size() - m_next);
+    setg(&m_data[m_next], &m_data[m_next], &m_data[m_next] + len);
+    m_next += len;
+    return traits_type::to_int_type(*gptr());
+  }
+
+public:
+  PipeBuffer(const string& data, size_t chunk) : m_data(data), m_next(0), m_chunk(chunk) {}
+};
+
+TEST(TestSimulator, TestPipedRunGivesTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "-", "-", "../error_plr_10", "10", "0" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  ifs.open("../unit-tests/bitstream_test.265", ios::binary);
+  PipeBuffer pipe(string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()), 1000);
+  ifs.close();
+
+  // The standard input reads from the pipe and the standard output goes to a file for the duration of the run
+  fflush(stdout);
+  const int saved_stdout = dup(STDOUT_FILENO);
+  const int fd = open("bitstream_test_err.265", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  dup2(fd, STDOUT_FILENO);
+  close(fd);
+  streambuf* saved_stdin = cin.rdbuf(&pipe);
+
+  {
+    Parameters p(cmdLine);
+    Simulator s(p);
+    s.run_simulator();
+  }
+
+  cin.rdbuf(saved_stdin);
+  cin.clear();
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  remove("bitstream_test_err.265");
+}
+
+TEST(TestSimulator, TestGeneratedChannelLossesAreReproducible)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_3", "0", "0",
+                            "--patterns", "bernoulli:plr=0,bernoulli:plr=100,bernoulli:plr=30:seed=5", "--offsets", "0" };
+  ifstream ifs;
+
+  Parameters p(cmdLine);
+  p.parse_options(10, cmdLine, 6);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("../unit-tests/bitstream_test.265", ios::binary);
+  string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_test_err_bernoulli_plr0_0.265", ios::binary);
+  string data_err_plr0 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_test_err_bernoulli_plr100_0.265", ios::binary);
+  string data_err_plr100 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_test_err_bernoulli_plr30_seed5_0.265", ios::binary);
+  string data_err_plr30 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  // Only the non VCL NAL units survive a channel losing every packet
+  EXPECT_TRUE(md5(data_original) == md5(data_err_plr0));
+  EXPECT_LT(data_err_plr100.size(), data_err_plr30.size());
+  EXPECT_LT(data_err_plr30.size(), data_original.size());
+
+  {
+    const char* singleCmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "bernoulli:plr=30:seed=5", "0", "0" };
+    Parameters single_p(singleCmdLine);
+    Simulator single_s(single_p);
+    single_s.run_simulator();
+  }
+
+  ifs.open("bitstream_test_err.265", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(md5(data_err_plr30) == md5(data_err));
+
+  remove("bitstream_test_err.265");
+  for (const auto& pattern : { "bernoulli_plr0", "bernoulli_plr100", "bernoulli_plr30_seed5" }) {
+    remove(("bitstream_test_err_" + string(pattern) + "_0.265").c_str());
+  }
+}
+
+TEST(TestSimulator, TestBatchModeMatchesSingleRuns)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_3", "0", "0",
+                            "--patterns", "../unit-tests/error_plr_0,../error_plr_10", "--offsets", "0:10:10" };
+  ifstream ifs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  Parameters p(cmdLine);
+  p.parse_options(10, cmdLine, 6);
+
+  EXPECT_EQ(vector<int>({ 0, 10 }), p.get_offsets());
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  ifs.open("../unit-tests/bitstream_test.265", ios::binary);
+  string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_test_err_error_plr_0_10.265", ios::binary);
+  string data_err_plr0 = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ifs.open("bitstream_test_err_error_plr_10_10.265", ios::binary);
+  string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  EXPECT_TRUE(md5(data_original) == md5(data_err_plr0));
+  EXPECT_TRUE(expected_md5 == md5(data_err));
+
+  for (const auto& pattern : { "error_plr_0", "error_plr_10" }) {
+    for (const auto& offset : { "0", "10" }) {
+      remove(("bitstream_test_err_" + string(pattern) + "_" + offset + ".265").c_str());
+    }
+  }
+  EXPECT_TRUE(Simulator::realization_file_name("out/str_err.265", "../patterns/plr_3", 7) == "out/str_err_plr_3_7.265");
+}
+
+TEST(TestSimulator, TestParallelRealizationsMatchSingleRuns)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "0", "0",
+                            "--offsets", "0:20:5", "--modalities", "0,1,2", "--jobs", "4" };
+  const vector<int> offsets = { 0, 5, 10, 15, 20 };
+  ifstream ifs;
+
+  Parameters p(cmdLine);
+  p.parse_options(12, cmdLine, 6);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  for (const auto offset : offsets) {
+    for (int modality = 0; modality <= 2; modality++) {
+      const string offset_str = to_string(offset);
+      const string modality_str = to_string(modality);
+      const char* singleCmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_single_err.265", "../error_plr_10",
+                                      offset_str.c_str(), modality_str.c_str() };
+      Parameters single_p(singleCmdLine);
+      Simulator single_s(single_p);
+      single_s.run_simulator();
+
+      const string file_name = Simulator::realization_file_name("bitstream_test_err.265", "../error_plr_10", offset, modality);
+
+      ifs.open(file_name, ios::binary);
+      string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      ifs.close();
+
+      ifs.open("bitstream_test_single_err.265", ios::binary);
+      string data_single_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      ifs.close();
+
+      EXPECT_TRUE(md5(data_single_err) == md5(data_err)) << file_name;
+
+      remove(file_name.c_str());
+      remove("bitstream_test_single_err.265");
+    }
+  }
+}
+
+TEST(TestSimulator, TestIoUringRealizationsMatchSingleRuns)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "0", "0",
+                            "--offsets", "0:20:5", "--modalities", "0,1,2", "--jobs", "4",
+                            "--io-uring", "on", "--flush-size", "4096" };
+  const vector<int> offsets = { 0, 5, 10, 15, 20 };
+  ifstream ifs;
+
+  Parameters p(cmdLine);
+  p.parse_options(16, cmdLine, 6);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  for (const auto offset : offsets) {
+    for (int modality = 0; modality <= 2; modality++) {
+      const string offset_str = to_string(offset);
+      const string modality_str = to_string(modality);
+      const char* singleCmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_single_err.265", "../error_plr_10",
+                                      offset_str.c_str(), modality_str.c_str() };
+      Parameters single_p(singleCmdLine);
+      Simulator single_s(single_p);
+      single_s.run_simulator();
+
+      const string file_name = Simulator::realization_file_name("bitstream_test_err.265", "../error_plr_10", offset, modality);
+
+      ifs.open(file_name, ios::binary);
+      string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      ifs.close();
+
+      ifs.open("bitstream_test_single_err.265", ios::binary);
+      string data_single_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      ifs.close();
+
+      EXPECT_TRUE(md5(data_single_err) == md5(data_err)) << file_name;
+
+      remove(file_name.c_str());
+      remove("bitstream_test_single_err.265");
+    }
+  }
+}
+
+TEST(TestSimulator, TestLinkedRealizationsMatchSingleRuns)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_err.265", "../error_plr_10", "0", "0",
+                            "--offsets", "0:20:5", "--modalities", "0,1,2", "--jobs", "4", "--dedupe", "link" };
+  const vector<int> offsets = { 0, 5, 10, 15, 20 };
+  ifstream ifs;
+
+  Parameters p(cmdLine);
+  p.parse_options(14, cmdLine, 6);
+
+  Simulator s(p);
+
+  s.run_simulator();
+
+  // Every realization is listed in the manifest, after the header line
+  ifs.open("bitstream_test_err.265.manifest");
+  size_t num_lines = 0;
+  for (string line; getline(ifs, line);) {
+    num_lines++;
+  }
+  ifs.close();
+  EXPECT_EQ(offsets.size() * 3 + 1, num_lines);
+
+  for (const auto offset : offsets) {
+    for (int modality = 0; modality <= 2; modality++) {
+      const string offset_str = to_string(offset);
+      const string modality_str = to_string(modality);
+      const char* singleCmdLine[] = { "transmitter-simulator-hevc.exe", "../unit-tests/bitstream_test.265", "bitstream_test_single_err.265", "../error_plr_10",
+                                      offset_str.c_str(), modality_str.c_str() };
+      Parameters single_p(singleCmdLine);
+      Simulator single_s(single_p);
+      single_s.run_simulator();
+
+      const string file_name = Simulator::realization_file_name("bitstream_test_err.265", "../error_plr_10", offset, modality);
+
+      ifs.open(file_name, ios::binary);
+      string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      ifs.close();
+
+      ifs.open("bitstream_test_single_err.265", ios::binary);
+      string data_single_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      ifs.close();
+
+      EXPECT_TRUE(md5(data_single_err) == md5(data_err)) << file_name;
+
+      remove(file_name.c_str());
+      remove("bitstream_test_single_err.265");
+    }
+  }
+  remove("bitstream_test_err.265.manifest");
+}
+
+TEST(TestSimulator, TestIndexedRunsGiveTheExpectMD5)
+{
+  const char* cmdLine[] = { "transmitter-simulator-hevc.exe", "bitstream_test_copy.265", "bitstream_test_err.265", "../error_plr_10", "10", "0",
+                            "--index", "on" };
+  const string index_file_name = NaluIndex::file_name("bitstream_test_copy.265");
+  ifstream ifs;
+  ofstream ofs;
+  const string expected_md5 = "d9d736adbf923b559aebd96ba05e59b2";
+
+  ifs.open("../unit-tests/bitstream_test.265", ios::binary);
+  string data_original = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  ifs.close();
+
+  ofs.open("bitstream_test_copy.265", ios::binary);
+  ofs << data_original;
+  ofs.close();
+
+  Parameters p(cmdLine);
+  p.parse_options(8, cmdLine, 6);
+
+  // The first run builds the index, the second one reads the NAL units from it
+  for (int run = 0; run < 2; run++) {
+    Simulator s(p);
+
+    s.run_simulator();
+
+    ifs.open("bitstream_test_err.265", ios::binary);
+    string data_err = string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    ifs.close();
+
+    EXPECT_TRUE(expected_md5 == md5(data_err)) << "run " << run;
+
+    remove("bitstream_test_err.265");
+  }
+
+  // A bitstream changed after the index has been built makes the index stale
+  NaluIndex index;
+  uint64_t size, hash;
+
+  EXPECT_TRUE(index.load(index_file_name));
+  EXPECT_EQ(size_t(index.source_size), data_original.size());
+
+  ofs.open("bitstream_test_copy.265", ios::binary | ios::app);
+  ofs << string(3, '\0');
+  ofs.close();
+
+  NaluIndex::hash_file("bitstream_test_copy.265", size, hash);
+  EXPECT_FALSE(index.matches(2, 1, size, hash));
+
+  {
+    Simulator s(p);
+
+    s.run_simulator();
+  }
+
+  NaluIndex::hash_file("bitstream_test_copy.265", size, hash);
+  EXPECT_TRUE(index.load(index_file_name));
+  EXPECT_TRUE(index.matches(2, 1, size, hash));
+
+  remove("bitstream_test_err.265");
+  remove("bitstream_test_copy.265");
+  remove(index_file_name.c_str());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);